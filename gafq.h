@@ -161,6 +161,8 @@ GAFQ_API void  (gafq_pushnil) (gafq_State *L);
 GAFQ_API void  (gafq_pushnumber) (gafq_State *L, gafq_Number n);
 GAFQ_API void  (gafq_pushinteger) (gafq_State *L, gafq_Integer n);
 GAFQ_API void  (gafq_pushgstring) (gafq_State *L, const char *s, size_t l);
+GAFQ_API void  (gafq_pushsubstring) (gafq_State *L, int idx, size_t i,
+                                     size_t l);
 GAFQ_API void  (gafq_pushstring) (gafq_State *L, const char *s);
 GAFQ_API const char *(gafq_pushvfstring) (gafq_State *L, const char *fmt,
                                                       va_list argp);
@@ -243,6 +245,10 @@ GAFQ_API void  (gafq_concat) (gafq_State *L, int n);
 GAFQ_API gafq_Alloc (gafq_getallocf) (gafq_State *L, void **ud);
 GAFQ_API void gafq_setallocf (gafq_State *L, gafq_Alloc f, void *ud);
 
+GAFQ_API void  (gafq_setbuiltin) (gafq_State *L, const char *name,
+                                  gafq_CFunction f);
+GAFQ_API gafq_Number *(gafq_tonumarray) (gafq_State *L, int idx, int n);
+
 
 
 /* 
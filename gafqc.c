@@ -27,6 +27,7 @@
 #define	OUTPUT		PROGNAME ".out"	/* default output file */
 
 static int listing=0;			/* list bytecodes? */
+static int optimizing=0;		/* optimize bytecodes? */
 static int dumping=1;			/* dump bytecodes? */
 static int stripping=0;			/* strip debug information? */
 static char Output[]={ OUTPUT };	/* default output file name */
@@ -57,6 +58,7 @@ static void usage(const char* message)
  "  -        process stdin\n"
  "  -l       list\n"
  "  -o name  output to file " GAFQ_QL("name") " (default is \"%s\")\n"
+ "  -O       optimize\n"
  "  -p       parse only\n"
  "  -s       strip debug information\n"
  "  -v       show version information\n"
@@ -92,6 +94,8 @@ static int doargs(int argc, char* argv[])
    if (output==NULL || *output==0) usage(GAFQ_QL("-o") " needs argument");
    if (IS("-")) output=NULL;
   }
+  else if (IS("-O"))			/* optimize */
+   optimizing=1;
   else if (IS("-p"))			/* parse only */
    dumping=0;
   else if (IS("-s"))			/* strip debug information */
@@ -167,6 +171,8 @@ static int pmain(gafq_State* L)
  {
   const char* filename=IS("-") ? NULL : argv[i];
   if (gafqL_loadfile(L,filename)!=0) fatal(gafq_tostring(L,-1));
+  if (optimizing && !gafqU_optimize(L,toproto(L,-1)))
+   fatal("optimized code does not check");
  }
  f=combine(L,argc);
  if (listing) gafqU_print(f,listing>1);
@@ -313,6 +313,18 @@
 #define GAFQI_GCMUL	200 /* GC runs 'twice the speed' of memory allocation */
 
 
+/*
+@@ GAFQ_USE_JUMPTABLE controls the use of direct-threaded dispatch in
+@* the interpreter loop ('gafqV_execute').
+** CHANGE it (undefine it) if your compiler does not support the "labels
+** as values" extension from GCC; the interpreter then dispatches each
+** instruction through a plain 'switch'.
+*/
+#if defined(__GNUC__) && !defined(GAFQ_ANSI)
+#define GAFQ_USE_JUMPTABLE
+#endif
+
+
 
 /*
 @@ GAFQ_COMPAT_GETN controls compatibility with old getn behavior.
@@ -480,6 +492,21 @@
 #define GAFQI_MAXUPVALUES	60
 
 
+/*
+@@ GAFQI_MAXINLINE is the size (in instructions) up to which the compiler
+@* inlines calls to a local function; 0 turns inlining off. Errors in
+@* inlined code still name its locals, but tracebacks lack its frame.
+*/
+#define GAFQI_MAXINLINE		12
+
+
+/*
+@@ GAFQI_MINSWITCH is the number of `x == constant' tests in an if/elseif
+@* chain from which the compiler dispatches on a table instead.
+*/
+#define GAFQI_MINSWITCH		4
+
+
 /*
 @@ GAFQL_BUFFERSIZE is the buffer size used by the gauxlib buffer system.
 */
@@ -542,6 +569,118 @@
 #endif
 
 
+/*
+@@ GAFQ_NANBOXING packs every value into 8 bytes instead of 16.
+** Stacks, table arrays and hash nodes shrink accordingly.  CHANGE it
+** (define it) only on 64-bit systems whose user-space pointers fit in
+** 47 bits (e.g., x86-64 Linux) and with 'double' numbers; light userdata
+** must then also be valid user-space addresses.
+*/
+/* #define GAFQ_NANBOXING */
+
+
+/*
+@@ GAFQI_INT is the type of the integer subtype of numbers.
+@@ GAFQI_MAXINT is the largest magnitude kept in that subtype.
+** Integral numbers within +-GAFQI_MAXINT may be stored as a GAFQI_INT,
+** so that counters, indices and integer arithmetic need no conversions
+** to and from gafq_Number. CHANGE them only if your system lacks 'long
+** long'; GAFQI_MAXINT must never exceed the integers that a gafq_Number
+** represents exactly, as both forms of a number must behave the same.
+*/
+#if defined(GAFQ_ANSI)
+#define GAFQI_INT	long
+#define GAFQI_MAXINT	2147483647L
+#elif defined(GAFQ_NANBOXING)
+#define GAFQI_INT	long long
+#define GAFQI_MAXINT	70368744177663LL  /* 2^46-1, fits a boxed payload */
+#else
+#define GAFQI_INT	long long
+#define GAFQI_MAXINT	9007199254740992LL  /* 2^53 */
+#endif
+
+
+/*
+@@ GAFQ_PACKEDARRAYS keeps the array part of a table that holds only
+** numbers as a plain vector of gafq_Number, half the size of TValues
+** ('gtable.c'); the first other value stored turns it back. Reads of
+** packed entries are slower than reads of TValues. CHANGE it (define
+** it) to trade that speed for memory. It needs 'double' numbers (nil
+** entries are a NaN) and buys nothing with GAFQ_NANBOXING.
+*/
+/* #define GAFQ_PACKEDARRAYS */
+
+#if defined(GAFQ_PACKEDARRAYS) && \
+    (!defined(GAFQ_NUMBER_DOUBLE) || defined(GAFQ_NANBOXING))
+#undef GAFQ_PACKEDARRAYS
+#endif
+
+
+/*
+@@ GAFQ_SWISSTABLE keeps the hash part of tables with open addressing,
+** probing a group of 16 one-byte hash tags at a time (with SSE2 when the
+** compiler targets it), instead of chained scatter ('gtable.c'). Nodes
+** lose their chain pointer, but up to 1/8 of them are kept free.
+** CHANGE it (define it) to try it.
+*/
+/* #define GAFQ_SWISSTABLE */
+
+
+/*
+@@ GAFQI_INCRREHASH is the size of the node part of a table from which
+** it grows a step at a time: a new node part takes its place at once,
+** but the entries of the old one move to it GAFQI_REHASHSTEP nodes with
+** each new key, instead of all of them with one store. A string table
+** of that many buckets resizes in the same way, moving GAFQI_REHASHSTEP
+** lists with each new string. CHANGE them if large tables need shorter
+** or fewer pauses; GAFQI_REHASHSTEP must be at least 2.
+*/
+#define GAFQI_INCRREHASH	(1 << 16)
+#define GAFQI_REHASHSTEP	8
+
+
+/*
+@@ GAFQI_MAXSHORTLEN is the length up to which strings are interned.
+** Longer strings are made without looking them up in the string table
+** (nor hashing them until they index a table), and they are compared
+** by contents. CHANGE it if long strings are compared more often than
+** made; it must not be smaller than the longest reserved word.
+*/
+#define GAFQI_MAXSHORTLEN	40
+
+
+/*
+@@ GAFQI_VIEWRATIO bounds the strings that substrings may share.
+** string.sub and pattern captures return a long result as a view of
+** the chars of its subject when the subject is at most GAFQI_VIEWRATIO
+** times as long, and copy it otherwise, so that a small view does not
+** keep a huge subject alive. CHANGE it to trade memory for copying.
+*/
+#define GAFQI_VIEWRATIO		16
+
+
+/*
+@@ GAFQ_USE_JIT compiles hot Gafq functions to native code ('gjit.c').
+** CHANGE it (define it) to try the baseline compiler. It needs x86-64
+** with the System V calling convention (Linux, the BSDs, Mac OS X) and
+** 'mmap', so it is turned off again anywhere else, and also with
+** GAFQ_NANBOXING and in C++ builds (errors cannot be thrown across
+** the generated code).
+@@ GAFQI_JITCALLS is the number of calls after which a function is compiled.
+@@ GAFQI_TRACELOOPS is the number of iterations after which a numeric
+** 'for' loop of compiled code is recorded as a trace.
+*/
+/* #define GAFQ_USE_JIT */
+
+#if defined(GAFQ_USE_JIT) && (!defined(__x86_64__) || defined(_WIN32) || \
+    defined(GAFQ_ANSI) || defined(GAFQ_NANBOXING) || defined(__cplusplus))
+#undef GAFQ_USE_JIT
+#endif
+
+#define GAFQI_JITCALLS	50
+#define GAFQI_TRACELOOPS	100
+
+
 /*
 @@ gafq_number2int is a macro to convert gafq_Number to int.
 @@ gafq_number2integer is a macro to convert gafq_Number to gafq_Integer.
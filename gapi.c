@@ -324,7 +324,9 @@ GAFQ_API gafq_Number gafq_tonumber (gafq_State *L, int idx) {
 GAFQ_API gafq_Integer gafq_tointeger (gafq_State *L, int idx) {
   TValue n;
   const TValue *o = index2adr(L, idx);
-  if (tonumber(o, &n)) {
+  if (ttisint(o))
+    return cast(gafq_Integer, ivalue(o));
+  else if (tonumber(o, &n)) {
     gafq_Integer res;
     gafq_Number num = nvalue(o);
     gafq_number2integer(res, num);
@@ -354,6 +356,13 @@ GAFQ_API const char *gafq_togstring (gafq_State *L, int idx, size_t *len) {
     o = index2adr(L, idx);  /* previous call may reallocate the stack */
     gafq_unlock(L);
   }
+  else if (isview(rawtsvalue(o))) {  /* C needs the ending `\0' */
+    gafq_lock(L);
+    gafqS_unview(L, rawtsvalue(o));  /* view now shares an exact copy */
+    gafqC_checkGC(L);
+    o = index2adr(L, idx);
+    gafq_unlock(L);
+  }
   if (len != NULL) *len = tsvalue(o)->len;
   return svalue(o);
 }
@@ -437,7 +446,12 @@ GAFQ_API void gafq_pushnumber (gafq_State *L, gafq_Number n) {
 //插入一个整数
 GAFQ_API void gafq_pushinteger (gafq_State *L, gafq_Integer n) {
   gafq_lock(L);
-  setnvalue(L->top, cast_num(n));
+  if (fitsint(n)) {
+    setivalue(L->top, cast_lint(n));
+  }
+  else {
+    setnvalue(L->top, cast_num(n));
+  }
   api_incr_top(L);
   gafq_unlock(L);
 }
@@ -452,6 +466,19 @@ GAFQ_API void gafq_pushgstring (gafq_State *L, const char *s, size_t len) {
 }
 
 
+GAFQ_API void gafq_pushsubstring (gafq_State *L, int idx, size_t i,
+                                  size_t len) {
+  StkId o;
+  gafq_lock(L);
+  gafqC_checkGC(L);
+  o = index2adr(L, idx);
+  api_check(L, ttisstring(o) && i + len <= tsvalue(o)->len);
+  setsvalue2s(L, L->top, gafqS_newview(L, rawtsvalue(o), i, len));
+  api_incr_top(L);
+  gafq_unlock(L);
+}
+
+
 GAFQ_API void gafq_pushstring (gafq_State *L, const char *s) {
   if (s == NULL)
     gafq_pushnil(L);
@@ -557,20 +584,22 @@ GAFQ_API void gafq_getfield (gafq_State *L, int idx, const char *k) {
 
 GAFQ_API void gafq_rawget (gafq_State *L, int idx) {
   StkId t;
+  TValue v;
   gafq_lock(L);
   t = index2adr(L, idx);
   api_check(L, ttistable(t));
-  setobj2s(L, L->top - 1, gafqH_get(hvalue(t), L->top - 1));
+  setobj2s(L, L->top - 1, gafqH_getv(hvalue(t), L->top - 1, &v));
   gafq_unlock(L);
 }
 
 
 GAFQ_API void gafq_rawgeti (gafq_State *L, int idx, int n) {
   StkId o;
+  TValue v;
   gafq_lock(L);
   o = index2adr(L, idx);
   api_check(L, ttistable(o));
-  setobj2s(L, L->top, gafqH_getnum(hvalue(o), n));
+  setobj2s(L, L->top, gafqH_getnumv(hvalue(o), n, &v));
   api_incr_top(L);
   gafq_unlock(L);
 }
@@ -675,8 +704,7 @@ GAFQ_API void gafq_rawset (gafq_State *L, int idx) {
   api_checknelems(L, 2);
   t = index2adr(L, idx);
   api_check(L, ttistable(t));
-  setobj2t(L, gafqH_set(L, hvalue(t), L->top-2), L->top-1);
-  gafqC_barriert(L, hvalue(t), L->top-1);
+  gafqH_setobj(L, hvalue(t), L->top-2, L->top-1);
   L->top -= 2;
   gafq_unlock(L);
 }
@@ -688,8 +716,7 @@ GAFQ_API void gafq_rawseti (gafq_State *L, int idx, int n) {
   api_checknelems(L, 1);
   o = index2adr(L, idx);
   api_check(L, ttistable(o));
-  setobj2t(L, gafqH_setnum(L, hvalue(o), n), L->top-1);
-  gafqC_barriert(L, hvalue(o), L->top-1);
+  gafqH_setint(L, hvalue(o), n, L->top-1);
   L->top--;
   gafq_unlock(L);
 }
@@ -1023,6 +1050,51 @@ GAFQ_API void gafq_setallocf (gafq_State *L, gafq_Alloc f, void *ud) {
 }
 
 
+/* library functions the VM may run inline (ORDER BI) */
+static const char *const builtinnames[] = {
+  "select", "math.floor", "math.abs", "math.sqrt", "math.min", "math.max",
+  "string.byte", "table.insert"
+};
+
+
+GAFQ_API void gafq_setbuiltin (gafq_State *L, const char *name,
+                               gafq_CFunction f) {
+  int i;
+  gafq_lock(L);
+  for (i=0; i<BI_N; i++) {
+    if (strcmp(name, builtinnames[i]) == 0)
+      G(L)->builtin[i] = f;
+  }
+  gafq_unlock(L);
+}
+
+
+/*
+** the numbers t[1..n] of the table at `idx' as a C array, when its array
+** part is packed and none of them is nil; NULL otherwise. The array is
+** valid until the next store into the table.
+*/
+GAFQ_API gafq_Number *gafq_tonumarray (gafq_State *L, int idx, int n) {
+  gafq_Number *a = NULL;
+  StkId t;
+  gafq_lock(L);
+  t = index2adr(L, idx);
+  api_check(L, ttistable(t));
+  if (ispacked(hvalue(t)) && 0 <= n && n <= hvalue(t)->sizearray) {
+    int i;
+    a = packedarray(hvalue(t));
+    for (i = 0; i < n; i++) {
+      if (ishole(a[i])) {
+        a = NULL;
+        break;
+      }
+    }
+  }
+  gafq_unlock(L);
+  return a;
+}
+
+
 GAFQ_API void *gafq_newuserdata (gafq_State *L, size_t size) {
   Udata *u;
   gafq_lock(L);
@@ -629,6 +629,7 @@ static void base_open (gafq_State *L) {
   gafq_setglobal(L, "_G");
   /* open lib into global table */
   gafqL_register(L, "_G", base_funcs);
+  gafq_setbuiltin(L, "select", gafqB_select);  /* see OP_VARARG */
   gafq_pushliteral(L, GAFQ_VERSION);
   gafq_setglobal(L, "_VERSION");  /* set global _VERSION */
   /* `ipairs' and `pairs' need auxiliary functions as upvalues */
@@ -5,7 +5,10 @@
 */
 
 
+#include <limits.h>
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define gcode_c
 #define GAFQ_CORE
@@ -21,6 +24,7 @@
 #include "gobject.h"
 #include "gopcodes.h"
 #include "gparser.h"
+#include "gstring.h"
 #include "gtable.h"
 
 
@@ -256,7 +260,7 @@ int gafqK_stringK (FuncState *fs, TString *s) {
 
 int gafqK_numberK (FuncState *fs, gafq_Number r) {
   TValue o;
-  setnvalue(&o, r);
+  gafqO_setnumber(&o, r);
   return addk(fs, &o, &o);
 }
 
@@ -469,6 +473,67 @@ int gafqK_exp2RK (FuncState *fs, expdesc *e) {
 }
 
 
+/* is RK `x' the constant 1? */
+static int isone (FuncState *fs, int x) {
+  return ISK(x) && ttisnumber(&fs->f->k[INDEXK(x)]) &&
+         nvalue(&fs->f->k[INDEXK(x)]) == 1;
+}
+
+
+/*
+** `t[#t+1] = v' with a local `t': the key came from `LEN k t; ADD k k 1',
+** and the value from code that only works in registers above `k' and
+** makes no calls, so (short of metamethods) nothing can have changed `#t'
+** meanwhile. Drop the key code and append instead. A `t' that is no
+** local is loaded twice, and each load may run metamethods, so that code
+** is kept as it is.
+*/
+static int append (FuncState *fs, expdesc *var, int e) {
+  Instruction *code = fs->f->code;
+  int t = var->u.s.info;
+  int k = var->u.s.aux;
+  int add, from, pc;
+  Instruction i;
+  if (ISK(k)) return 0;
+  for (add = fs->pc - 1; add > 0 && GETARG_A(code[add]) > k; add--) ;
+  i = code[add];
+  if (add < 1 || GET_OPCODE(i) != OP_ADD || GETARG_A(i) != k ||
+      !((GETARG_B(i) == k && isone(fs, GETARG_C(i))) ||
+        (GETARG_C(i) == k && isone(fs, GETARG_B(i)))))
+    return 0;
+  for (pc = add + 1; pc < fs->pc; pc++) {  /* the value code */
+    switch (GET_OPCODE(code[pc])) {
+      case OP_MOVE: case OP_LOADK: case OP_LOADNIL: case OP_GETUPVAL:
+      case OP_GETGLOBAL: case OP_GETTABLE: case OP_NEWTABLE:
+      case OP_SETTABLE: case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+      case OP_MOD: case OP_POW: case OP_UNM: case OP_NOT: case OP_LEN:
+      case OP_CONCAT:
+        break;
+      case OP_LOADBOOL:
+        if (GETARG_C(code[pc]) != 0) return 0;  /* part of a test */
+        break;
+      case OP_SETLIST:
+        if (GETARG_C(code[pc]) == 0) return 0;
+        break;
+      default: return 0;
+    }
+  }
+  from = add - 1;
+  i = code[from];
+  if (GET_OPCODE(i) != OP_LEN || GETARG_A(i) != k || GETARG_B(i) != t ||
+      t >= fs->nactvar)
+    return 0;
+  if (fs->lasttarget > from) return 0;  /* some jump goes into the key */
+  for (pc = add + 1; pc < fs->pc; pc++) {  /* remove the key code */
+    code[pc - (add + 1 - from)] = code[pc];
+    fs->f->lineinfo[pc - (add + 1 - from)] = fs->f->lineinfo[pc];
+  }
+  fs->pc -= add + 1 - from;
+  gafqK_codeABC(fs, OP_APPEND, t, e, k);
+  return 1;
+}
+
+
 void gafqK_storevar (FuncState *fs, expdesc *var, expdesc *ex) {
   switch (var->k) {
     case VLOCAL: {
@@ -488,7 +553,8 @@ void gafqK_storevar (FuncState *fs, expdesc *var, expdesc *ex) {
     }
     case VINDEXED: {
       int e = gafqK_exp2RK(fs, ex);
-      gafqK_codeABC(fs, OP_SETTABLE, var->u.s.info, var->u.s.aux, e);
+      if (!append(fs, var, e))
+        gafqK_codeABC(fs, OP_SETTABLE, var->u.s.info, var->u.s.aux, e);
       break;
     }
     default: {
@@ -829,3 +895,620 @@ void gafqK_setlist (FuncState *fs, int base, int nelems, int tostore) {
   fs->freereg = base + 1;  /* free registers with list values */
 }
 
+
+/*
+** Jump tables for `if x == K1 then ... elseif x == K2 then ...'. The
+** tests `EQ 0 x Ki; JMP next' stay where they are, but the first one
+** becomes a jump to dispatch code after the statement:
+**	SWITCH x T n; JMP no-case; JMP case-1; ...; JMP case-n
+** where constant T is a table from each Ki to its case number i.
+*/
+
+/* does a table find key `o' exactly when `==' would? */
+static int casekey (const TValue *o) {
+  if (ttisstring(o)) return 1;
+  else if (ttisint(o))  /* big ones could be keys either way */
+    return cast_lint(cast_int(ivalue(o))) == ivalue(o);
+  else if (ttisnumber(o)) {
+    gafq_Number n = nvalue(o);
+    if (gafqi_numisnan(n)) return 0;
+    return (n != floor(n) || (-MAX_INT <= n && n <= MAX_INT));
+  }
+  else return 0;
+}
+
+
+/* is the condition with false exit `list' a test `x == K' that could be
+   a case of a switch on `*reg' (any register, if NO_REG)? */
+int gafqK_iscase (FuncState *fs, int list, int *reg) {
+  Instruction i;
+  int b, c, r;
+  if (list != fs->pc - 1 || list < 1 || getjump(fs, list) != NO_JUMP)
+    return 0;
+  i = fs->f->code[list - 1];
+  b = GETARG_B(i);
+  c = GETARG_C(i);
+  if (GET_OPCODE(i) != OP_EQ || GETARG_A(i) != 0 || ISK(b) == ISK(c) ||
+      !casekey(&fs->f->k[INDEXK(ISK(b) ? b : c)]))
+    return 0;
+  r = ISK(b) ? c : b;
+  if (*reg != NO_REG && r != *reg) return 0;
+  *reg = r;
+  return 1;
+}
+
+
+/* dispatch the `n' cases whose tests start at `first'; `deflt' is where
+   no case goes (or NO_JUMP, for the end of the statement, which the
+   returned jumps must reach) */
+int gafqK_switch (FuncState *fs, int first, int n, int deflt, int line) {
+  Proto *f = fs->f;
+  Instruction i = f->code[first];
+  int reg = ISK(GETARG_B(i)) ? GETARG_C(i) : GETARG_B(i);
+  int pc = first;
+  int escape, sw, list, j;
+  Table *t;
+  TValue o;
+  if (fs->nk > MAXARG_B) return NO_JUMP;  /* no room for the table */
+  escape = gafqK_jump(fs);  /* the last block must not run into the table */
+  t = gafqH_new(fs->L, 0, n);
+  sethvalue(fs->L, &o, t);
+  sw = gafqK_codeABC(fs, OP_SWITCH, reg, addk(fs, &o, &o), n);
+  gafqK_fixline(fs, line);
+  list = gafqK_jump(fs);
+  gafqK_fixline(fs, line);
+  if (deflt != NO_JUMP) {
+    gafqK_patchlist(fs, list, deflt);
+    list = NO_JUMP;
+  }
+  for (j = 1; j <= n; j++) {
+    int b, c;
+    TValue *v;
+    i = f->code[pc];
+    b = GETARG_B(i);
+    c = GETARG_C(i);
+    v = gafqH_set(fs->L, t, &f->k[INDEXK(ISK(b) ? b : c)]);
+    if (ttisnil(v)) setivalue(v, j);  /* the first of equal cases wins */
+    gafqK_patchlist(fs, gafqK_jump(fs), pc + 2);
+    gafqK_fixline(fs, line);
+    if (j < n) pc += 2 + GETARG_sBx(f->code[pc + 1]);  /* next test */
+  }
+  f->code[first] = CREATE_ABx(OP_JMP, 0, sw - (first + 1) + MAXARG_sBx);
+  gafqK_concat(fs, &escape, list);
+  return escape;
+}
+
+
+
+/*
+** turn the first instruction of each of the most frequent opcode pairs
+** into a superinstruction, which the VM runs together with the next one
+*/
+void gafqK_fuse (Proto *f) {
+  int pc;
+  for (pc = 0; pc + 1 < f->sizecode; pc++) {
+    Instruction *i = &f->code[pc];
+    OpCode next = GET_OPCODE(*(i+1));
+    OpCode sup;
+    switch (GET_OPCODE(*i)) {
+      case OP_MOVE: {
+        if (next == OP_MOVE) sup = OP_MOVE2;
+        else if (next == OP_CALL) sup = OP_MOVECALL;
+        else continue;
+        break;
+      }
+      case OP_GETTABLE: {
+        if (next != OP_GETTABLE) continue;
+        sup = OP_GETTABLE2;
+        break;
+      }
+      case OP_GETGLOBAL: {
+        if (next != OP_GETTABLE) continue;
+        sup = OP_GLOBALGET;
+        break;
+      }
+      case OP_SETLIST: {
+        if (GETARG_C(*i) == 0) pc++;  /* skip the `instruction' holding C */
+        continue;
+      }
+      case OP_CLOSURE: {
+        pc += f->p[GETARG_Bx(*i)]->nups;  /* skip upvalue pseudo-instructions */
+        continue;
+      }
+      default: continue;
+    }
+    SET_OPCODE(*i, sup);
+    pc++;  /* pairs do not overlap */
+  }
+}
+
+
+/*
+** Inlining of small local functions. Once a function is complete, each
+** call `f(args)' to a local `f' bound to a closure of at most
+** GAFQI_MAXINLINE instructions, and never assigned again, is replaced by
+** a copy of the closure's code. Only leaves qualify (no calls, closures
+** or varargs) that do not touch globals (`setfenv' could give the closure
+** another environment). The copy works in the registers above the call,
+** where the frame would live, and keeps the callee's lines and the names
+** of its locals, so error messages do not change; but tracebacks, hooks
+** and the rest of the debug library see no frame for the callee.
+*/
+
+/* number of words after `code[pc]' that are no instructions */
+static int datawords (Proto *f, int pc) {
+  Instruction i = f->code[pc];
+  switch (GET_OPCODE(i)) {
+    case OP_SETLIST: return (GETARG_C(i) == 0);
+    case OP_CLOSURE: return f->p[GETARG_Bx(i)]->nups;
+    default: return 0;
+  }
+}
+
+
+/* is `code[pc]' the count of a SETLIST? (other data never looks like
+   the instructions we look for) */
+static int setlistcount (Proto *f, int pc) {
+  return (pc > 0 && GET_OPCODE(f->code[pc-1]) == OP_SETLIST &&
+          GETARG_C(f->code[pc-1]) == 0);
+}
+
+
+static int inlinable (Proto *p) {
+  int pc;
+  if (p->sizecode > GAFQI_MAXINLINE || p->is_vararg) return 0;
+  for (pc = 0; pc < p->sizecode; pc++) {
+    Instruction i = BASEINSTR(p->code[pc]);
+    switch (GET_OPCODE(i)) {
+      case OP_CALL: case OP_TAILCALL: case OP_VARARG: case OP_CLOSURE:
+      case OP_CLOSE: case OP_TFORLOOP: case OP_INTRINSIC:
+      case OP_GETGLOBAL: case OP_SETGLOBAL:  /* setfenv may change them */
+      case OP_SWITCH:  /* its table is not copied */
+        return 0;
+      case OP_RETURN:
+        if (GETARG_B(i) == 0) return 0;
+        break;
+      case OP_SETLIST:
+        if (GETARG_B(i) == 0 || GETARG_C(i) == 0) return 0;
+        break;
+      default: break;
+    }
+  }
+  return 1;
+}
+
+
+/* may instruction `i' set register `r'? */
+static int setsreg (Instruction i, int r) {
+  int a = GETARG_A(i);
+  int b = GETARG_B(i);
+  int c = GETARG_C(i);
+  switch (GET_OPCODE(i)) {
+    case OP_LOADNIL: return (a <= r && r <= b);
+    case OP_SELF: return (r == a || r == a+1);
+    case OP_CALL: case OP_INTRINSIC:
+      return (r >= a && (c == 0 || r <= a+c-2));
+    case OP_APPEND: return (r == c);
+    case OP_VARARG: return (r >= a && (b == 0 || r <= a+b-2));
+    case OP_TFORLOOP: return (a+3 <= r && r <= a+2+c);
+    case OP_FORLOOP: case OP_FORPREP: return (a <= r && r <= a+3);
+    case OP_TEST: return 0;
+    default: return (testAMode(GET_OPCODE(i)) && r == a);
+  }
+}
+
+
+/* does a function with upvalue `u' (or one nested in it) assign to it? */
+static int setsupval (Proto *p, int u) {
+  int pc, j;
+  for (pc = 0; pc < p->sizecode; pc++) {
+    Instruction i = p->code[pc];
+    if (GET_OPCODE(i) == OP_SETUPVAL && GETARG_B(i) == u) return 1;
+    if (GET_OPCODE(i) == OP_CLOSURE) {
+      Proto *q = p->p[GETARG_Bx(i)];
+      for (j = 0; j < q->nups; j++) {
+        Instruction pseudo = p->code[pc+1+j];
+        if (GET_OPCODE(pseudo) == OP_GETUPVAL && GETARG_B(pseudo) == u &&
+            setsupval(q, j))
+          return 1;
+      }
+    }
+    pc += datawords(p, pc);
+  }
+  return 0;
+}
+
+
+/* is register `r' assigned to, or captured by a closure that assigns to
+   it, between `from' and `to'? */
+static int reassigned (Proto *f, int r, int from, int to) {
+  int pc, j;
+  for (pc = from; pc < to; pc++) {
+    Instruction i = f->code[pc];
+    if (setsreg(i, r)) return 1;
+    if (GET_OPCODE(i) == OP_CLOSURE) {
+      Proto *q = f->p[GETARG_Bx(i)];
+      for (j = 0; j < q->nups; j++) {
+        Instruction pseudo = f->code[pc+1+j];
+        if (GET_OPCODE(pseudo) == OP_MOVE && GETARG_B(pseudo) == r &&
+            setsupval(q, j))
+          return 1;
+      }
+    }
+    pc += datawords(f, pc);
+  }
+  return 0;
+}
+
+
+/* highest register of `p' that must be nil on entry when only the first
+   `lo' registers are set (-1 if none) */
+static int nilregs (Proto *p, int lo) {
+  lu_byte set[MAXSTACK];
+  int pc, r, hi = (lo < p->numparams) ? p->numparams - 1 : -1;
+  for (r = 0; r < p->maxstacksize; r++) set[r] = (r < lo);
+  for (r = p->numparams; r < p->sizelocvars; r++)  /* locals with no LOADNIL */
+    if (p->locvars[r].startpc == 0 && r > hi) hi = r;
+  for (pc = 0; pc < p->sizecode; pc++) {
+    Instruction i = BASEINSTR(p->code[pc]);
+    OpCode op = GET_OPCODE(i);
+    int a = GETARG_A(i);
+    int b = GETARG_B(i);
+    int c = GETARG_C(i);
+    int first = 0, last = -1;  /* range of registers read besides B and C */
+    switch (op) {
+      case OP_SETGLOBAL: case OP_SETUPVAL: case OP_SETTABLE: case OP_TEST:
+        first = last = a; break;
+      case OP_RETURN: first = a; last = a+b-2; break;
+      case OP_FORLOOP: case OP_FORPREP: first = a; last = a+2; break;
+      case OP_SETLIST: first = a; last = a+b; break;
+      case OP_CONCAT: first = b; last = c; break;
+      default: break;
+    }
+    if (getOpMode(op) == iABC && op != OP_LOADNIL && op != OP_TEST) {
+      if (getBMode(op) == OpArgR || (getBMode(op) == OpArgK && !ISK(b)))
+        if (!set[b] && b > hi) hi = b;
+      if (getCMode(op) == OpArgR || (getCMode(op) == OpArgK && !ISK(c)))
+        if (!set[c] && c > hi) hi = c;
+    }
+    for (r = first; r <= last; r++)
+      if (!set[r] && r > hi) hi = r;
+    /* registers surely set from now on (in code order) */
+    if (op == OP_LOADNIL) {
+      for (r = a; r <= b; r++) set[r] = 1;
+    }
+    else if (op == OP_SELF) set[a] = set[a+1] = 1;
+    else if (op == OP_FORLOOP) set[a] = set[a+3] = 1;
+    else if (testAMode(op) && op != OP_TEST && op != OP_TESTSET) set[a] = 1;
+  }
+  return hi;
+}
+
+
+/* replace instruction at `pc' by the `n' in `ins' */
+static void replacecode (FuncState *fs, int pc, Instruction *ins, int *lines,
+                         int n) {
+  Proto *f = fs->f;
+  int j, d = n - 1;
+  while (f->sizecode < fs->pc + d)
+    gafqM_growvector(fs->L, f->code, f->sizecode, f->sizecode, Instruction,
+                    MAX_INT, "code size overflow");
+  while (f->sizelineinfo < fs->pc + d)
+    gafqM_growvector(fs->L, f->lineinfo, f->sizelineinfo, f->sizelineinfo,
+                    int, MAX_INT, "code size overflow");
+  for (j = 0; j < fs->pc; j++) {  /* mend jumps over `pc' */
+    Instruction *i = &f->code[j];
+    OpCode op = GET_OPCODE(*i);
+    if (op == OP_JMP || op == OP_FORLOOP || op == OP_FORPREP) {
+      int t = j + 1 + GETARG_sBx(*i);
+      if (j < pc && t > pc) SETARG_sBx(*i, GETARG_sBx(*i) + d);
+      else if (j > pc && t <= pc) SETARG_sBx(*i, GETARG_sBx(*i) - d);
+    }
+    j += datawords(f, j);
+  }
+  memmove(f->code + pc + n, f->code + pc + 1,
+          (fs->pc - pc - 1) * sizeof(Instruction));
+  memmove(f->lineinfo + pc + n, f->lineinfo + pc + 1,
+          (fs->pc - pc - 1) * sizeof(int));
+  memcpy(f->code + pc, ins, n * sizeof(Instruction));
+  memcpy(f->lineinfo + pc, lines, n * sizeof(int));
+  fs->pc += d;
+  for (j = 0; j < fs->nlocvars; j++) {
+    if (f->locvars[j].startpc > pc) f->locvars[j].startpc += d;
+    if (f->locvars[j].endpc > pc) f->locvars[j].endpc += d;
+  }
+}
+
+
+static int copyk (FuncState *fs, const TValue *v) {
+  switch (ttype(v)) {
+    case GAFQ_TNIL: return nilK(fs);
+    case GAFQ_TBOOLEAN: return boolK(fs, bvalue(v));
+    case GAFQ_TNUMBER: return gafqK_numberK(fs, nvalue(v));
+    default: return gafqK_stringK(fs, rawtsvalue(v));
+  }
+}
+
+
+/* translate register or constant operand `x' of mode `m' */
+static int operand (int x, enum OpArgMask m, int base, const int *kmap) {
+  if (m == OpArgK && ISK(x)) return RKASK(kmap[INDEXK(x)]);
+  else if (m == OpArgR || m == OpArgK) return x + base;
+  else return x;
+}
+
+
+/* does some jump of `p' go to `t'? */
+static int jumpsto (Proto *p, int t) {
+  int pc;
+  for (pc = 0; pc < p->sizecode; pc++) {
+    OpCode op = GET_OPCODE(p->code[pc]);
+    if ((op == OP_JMP || op == OP_FORLOOP || op == OP_FORPREP) &&
+        pc + 1 + GETARG_sBx(p->code[pc]) == t)
+      return 1;
+    pc += datawords(p, pc);
+  }
+  return 0;
+}
+
+
+/* last instruction of `p' worth copying */
+static int lastcopied (Proto *p) {
+  int last = p->sizecode - 1;
+  if (last > 0 && GET_OPCODE(p->code[last-1]) == OP_RETURN &&
+      !jumpsto(p, last))
+    last--;  /* final return is unreachable */
+  return last;
+}
+
+
+/* number of values every copied return of `p' gives, or -1 */
+static int nreturns (Proto *p) {
+  int pc, n = -1;
+  for (pc = 0; pc <= lastcopied(p); pc++) {
+    Instruction i = p->code[pc];
+    if (GET_OPCODE(i) == OP_RETURN) {
+      if (n != -1 && n != GETARG_B(i) - 1) return -1;
+      n = GETARG_B(i) - 1;
+    }
+    pc += datawords(p, pc);
+  }
+  return n;
+}
+
+
+/* the call at `pc' passes all its results on to the next instruction;
+   if there are `nret' of them, what is the B the latter needs? (0 if
+   none does) */
+static int openresults (FuncState *fs, int pc, int nret) {
+  Instruction next;
+  int b;
+  if (nret < 0 || nret + 1 > MAXARG_C || pc + 1 >= fs->pc) return 0;
+  next = fs->f->code[pc+1];
+  if (GETARG_B(next) != 0) return 0;
+  b = GETARG_A(fs->f->code[pc]) + nret - GETARG_A(next);
+  switch (GET_OPCODE(next)) {
+    case OP_CALL: break;
+    case OP_RETURN: b++; break;
+    case OP_SETLIST: b--; break;
+    default: return 0;
+  }
+  return (0 < b && b <= MAXARG_B) ? b : 0;
+}
+
+
+/*
+** name the registers of the copy of `p' now at `pc' (`n' instructions,
+** placed as `off' tells) for error messages: hidden locals for those
+** between our active locals and `base', then the locals of `p'
+*/
+static void inlinelocals (FuncState *fs, int pc, int n, Proto *p, int base,
+                          const int *off) {
+  Proto *f = fs->f;
+  int nact = 0, at, cnt, j, k;
+  TString *hidden = gafqS_newliteral(fs->L, "(inline)");
+  for (at = 0; at < fs->nlocvars && f->locvars[at].startpc <= pc; at++)
+    if (pc < f->locvars[at].endpc) nact++;
+  cnt = base - nact;
+  for (j = 0; j < p->sizelocvars; j++)
+    if (p->locvars[j].startpc < p->locvars[j].endpc) cnt++;
+  if (fs->nlocvars + cnt > SHRT_MAX) return;  /* leave them unnamed */
+  k = f->sizelocvars;
+  while (f->sizelocvars < fs->nlocvars + cnt)
+    gafqM_growvector(fs->L, f->locvars, f->sizelocvars, f->sizelocvars,
+                    LocVar, SHRT_MAX, "too many local variables");
+  while (k < f->sizelocvars) f->locvars[k++].varname = NULL;
+  memmove(f->locvars + at + cnt, f->locvars + at,
+          (fs->nlocvars - at) * sizeof(LocVar));
+  fs->nlocvars += cnt;
+  for (k = at; nact < base; nact++, k++) {
+    f->locvars[k].varname = hidden;
+    f->locvars[k].startpc = pc;
+    f->locvars[k].endpc = pc + n;
+  }
+  for (j = 0; j < p->sizelocvars; j++) {
+    LocVar *lv = &p->locvars[j];
+    if (lv->startpc >= lv->endpc) continue;
+    f->locvars[k].varname = lv->varname;
+    f->locvars[k].startpc = pc + ((lv->startpc == 0) ? 0 : off[lv->startpc]);
+    f->locvars[k++].endpc = pc + off[lv->endpc];
+    gafqC_objbarrier(fs->L, f, lv->varname);
+  }
+  gafqC_objbarrier(fs->L, f, hidden);
+}
+
+
+/* inline at `pc' a call to `p', which the CLOSURE at `cpc' made and the
+   MOVE at `m' loaded */
+static void inlinecall (FuncState *fs, int pc, int m, Proto *p, int cpc) {
+  Proto *f = fs->f;
+  Instruction call = f->code[pc];
+  int base = GETARG_A(call) + 1;
+  int nres = GETARG_C(call) - 1;
+  int lo = (GETARG_B(call) - 1 < p->numparams) ? GETARG_B(call) - 1
+                                                : p->numparams;
+  int hi = nilregs(p, lo);
+  int size = p->sizecode * (nres + 3) + 1;
+  Instruction *ins = gafqM_newvector(fs->L, size, Instruction);
+  int *lines = gafqM_newvector(fs->L, size, int);
+  int *off = gafqM_newvector(fs->L, p->sizecode + 1, int);
+  int *kmap = gafqM_newvector(fs->L, p->sizek, int);
+  int last = lastcopied(p);
+  int j, n = 0, end;
+  for (j = 0; j < p->sizek; j++) kmap[j] = copyk(fs, &p->k[j]);
+  if (hi >= lo) {
+    lines[n] = p->lineinfo[0];
+    ins[n++] = CREATE_ABC(OP_LOADNIL, base + lo, base + hi, 0);
+  }
+  for (j = 0; j <= last; j++) {  /* where each instruction goes */
+    Instruction i = p->code[j];
+    off[j] = n;
+    if (GET_OPCODE(i) == OP_RETURN) {
+      int nmov = (GETARG_B(i) - 1 < nres) ? GETARG_B(i) - 1 : nres;
+      n += nmov + (nmov < nres);  /* moves, then nils for the rest */
+      if (j < last) n++;  /* jump to the end */
+    }
+    else n++;
+  }
+  for (; j <= p->sizecode; j++) off[j] = n;
+  end = n;
+  n = off[0];
+  for (j = 0; j <= last; j++) {
+    Instruction i = BASEINSTR(p->code[j]);
+    OpCode op = GET_OPCODE(i);
+    int a = GETARG_A(i);
+    gafq_assert(n == off[j]);
+    switch (op) {
+      case OP_RETURN: {
+        int nret = GETARG_B(i) - 1;
+        int r;
+        for (r = 0; r < nres && r < nret; r++) {
+          lines[n] = p->lineinfo[j];
+          ins[n++] = CREATE_ABC(OP_MOVE, base - 1 + r, base + a + r, 0);
+        }
+        if (r < nres) {
+          lines[n] = p->lineinfo[j];
+          ins[n++] = CREATE_ABC(OP_LOADNIL, base - 1 + r, base - 1 + nres - 1, 0);
+        }
+        if (j < last) {
+          lines[n] = p->lineinfo[j];
+          ins[n] = CREATE_ABx(OP_JMP, 0, end - (n + 1) + MAXARG_sBx);
+          n++;
+        }
+        continue;
+      }
+      case OP_JMP: case OP_FORLOOP: case OP_FORPREP: {
+        int t = j + 1 + GETARG_sBx(i);
+        i = CREATE_ABx(op, (op == OP_JMP) ? 0 : a + base,
+                       off[t] - (n + 1) + MAXARG_sBx);
+        break;
+      }
+      case OP_LOADK: case OP_GETGLOBAL: case OP_SETGLOBAL: {
+        i = CREATE_ABx(op, a + base, kmap[GETARG_Bx(i)]);
+        break;
+      }
+      case OP_GETUPVAL: case OP_SETUPVAL: {
+        Instruction pseudo = f->code[cpc + 1 + GETARG_B(i)];
+        int v = GETARG_B(pseudo);
+        if (GET_OPCODE(pseudo) == OP_GETUPVAL)  /* an upvalue of ours */
+          i = CREATE_ABC(op, a + base, v, 0);
+        else if (op == OP_GETUPVAL)  /* one of our locals */
+          i = CREATE_ABC(OP_MOVE, a + base, v, 0);
+        else
+          i = CREATE_ABC(OP_MOVE, v, a + base, 0);
+        break;
+      }
+      case OP_TEST: {
+        SETARG_A(i, a + base);
+        break;
+      }
+      default: {
+        int b = GETARG_B(i);
+        int c = GETARG_C(i);
+        if (op != OP_EQ && op != OP_LT && op != OP_LE) a += base;
+        i = CREATE_ABC(op, a, operand(b, getBMode(op), base, kmap),
+                              operand(c, getCMode(op), base, kmap));
+        break;
+      }
+    }
+    lines[n] = p->lineinfo[j];
+    ins[n++] = i;
+  }
+  gafq_assert(n == end);
+  replacecode(fs, pc, ins, lines, n);
+  inlinelocals(fs, pc, n, p, base, off);
+  replacecode(fs, m, ins, lines, 0);  /* the function itself is not needed */
+  gafqM_freearray(fs->L, kmap, p->sizek, int);
+  gafqM_freearray(fs->L, off, p->sizecode + 1, int);
+  gafqM_freearray(fs->L, lines, size, int);
+  gafqM_freearray(fs->L, ins, size, Instruction);
+}
+
+
+static int inlineall (FuncState *fs) {
+  Proto *f = fs->f;
+  int cpc, pc, j, done = 0;
+  for (cpc = fs->pc - 1; cpc >= 0; cpc--) {
+    Instruction cl = f->code[cpc];
+    Proto *p;
+    int rf, start, end, nact;
+    if (GET_OPCODE(cl) != OP_CLOSURE || setlistcount(f, cpc)) continue;
+    p = f->p[GETARG_Bx(cl)];
+    rf = GETARG_A(cl);
+    start = cpc + 1 + p->nups;
+    if (!inlinable(p)) continue;
+    for (j = 0; j < p->nups; j++)  /* recursive? */
+      if (GET_OPCODE(f->code[cpc+1+j]) == OP_MOVE &&
+          GETARG_B(f->code[cpc+1+j]) == rf) break;
+    if (j < p->nups) continue;
+    /* find the local the closure initializes */
+    for (j = 0, nact = 0; j < fs->nlocvars; j++) {
+      LocVar *lv = &f->locvars[j];
+      if (lv->startpc <= start && start < lv->endpc) {
+        if (lv->startpc == start && nact == rf) break;
+        nact++;
+      }
+    }
+    if (j == fs->nlocvars) continue;
+    end = f->locvars[j].endpc;
+    if (reassigned(f, rf, start, end)) continue;
+    for (pc = end - 1; pc >= start; pc--) {  /* calls, from the last one */
+      Instruction i = f->code[pc];
+      int a = GETARG_A(i), m, k, b = 0;
+      if (GET_OPCODE(i) == OP_CALL && GETARG_C(i) == 0)
+        b = openresults(fs, pc, nreturns(p));
+      if (GET_OPCODE(i) != OP_CALL || setlistcount(f, pc) ||
+          GETARG_B(i) == 0 || (GETARG_C(i) == 0 && b == 0) ||
+          a + 1 + p->maxstacksize > MAXSTACK ||
+          fs->nk + p->sizek > MAXINDEXRK + 1)
+        continue;
+      for (m = pc - 1; m >= start && !setsreg(f->code[m], a); m--) ;
+      if (m < start || f->code[m] != CREATE_ABC(OP_MOVE, a, rf, 0) ||
+          setlistcount(f, m))
+        continue;
+      for (k = 0; k < fs->pc; k++) {  /* no jumps into the call from outside */
+        int t = -1;
+        OpCode op = GET_OPCODE(f->code[k]);
+        if (op == OP_JMP || op == OP_FORLOOP || op == OP_FORPREP)
+          t = k + 1 + GETARG_sBx(f->code[k]);
+        if ((k < m || k > pc) && m < t && t <= pc) break;
+        k += datawords(f, k);
+      }
+      if (k < fs->pc) continue;
+      if (a + 1 + p->maxstacksize > f->maxstacksize)
+        f->maxstacksize = cast_byte(a + 1 + p->maxstacksize);
+      if (b != 0) {  /* results are now fixed */
+        SETARG_B(f->code[pc+1], b);
+        SETARG_C(f->code[pc], nreturns(p) + 1);
+      }
+      inlinecall(fs, pc, m, p, cpc);
+      done = 1;
+    }
+  }
+  return done;
+}
+
+
+void gafqK_inline (FuncState *fs) {
+  while (inlineall(fs)) ;  /* an inlined call may fix the arguments of another */
+}
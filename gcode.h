@@ -71,6 +71,11 @@ GAFQI_FUNC void gafqK_prefix (FuncState *fs, UnOpr op, expdesc *v);
 GAFQI_FUNC void gafqK_infix (FuncState *fs, BinOpr op, expdesc *v);
 GAFQI_FUNC void gafqK_posfix (FuncState *fs, BinOpr op, expdesc *v1, expdesc *v2);
 GAFQI_FUNC void gafqK_setlist (FuncState *fs, int base, int nelems, int tostore);
+GAFQI_FUNC int gafqK_iscase (FuncState *fs, int list, int *reg);
+GAFQI_FUNC int gafqK_switch (FuncState *fs, int first, int n, int deflt,
+                             int line);
+GAFQI_FUNC void gafqK_fuse (Proto *f);
+GAFQI_FUNC void gafqK_inline (FuncState *fs);
 
 
 #endif
@@ -326,6 +326,13 @@ static Instruction symbexec (const Proto *pt, int lastpc, int reg) {
     int b = 0;
     int c = 0;
     check(op < NUM_OPCODES);
+    if (FIRST_SUPER <= op && op < FIRST_QUICK) {  /* superinstruction? */
+      OpCode next;
+      check(pc+1 < pt->sizecode);
+      next = GET_OPCODE(pt->code[pc+1]);
+      check(next < NUM_OPCODES && baseOp(next) == pairOp(op));
+    }
+    op = baseOp(op);  /* quickened instructions check as their originals */
     checkreg(pt, a);
     switch (getOpMode(op)) {
       case iABC: {
@@ -403,6 +410,10 @@ static Instruction symbexec (const Proto *pt, int lastpc, int reg) {
         check(b < c);  /* at least two operands */
         break;
       }
+      case OP_APPEND: {
+        if (reg == c) last = pc;  /* the key it may compute */
+        break;
+      }
       case OP_TFORLOOP: {
         check(c >= 1);  /* at least one result (control variable) */
         checkreg(pt, a+2+c);  /* space for results */
@@ -420,6 +431,10 @@ static Instruction symbexec (const Proto *pt, int lastpc, int reg) {
           pc += b;  /* do the jump */
         break;
       }
+      case OP_INTRINSIC:
+        check(FIRST_INTRINSIC <= b && b < BI_N);
+        b = biargs(b) + 1;
+        /* go through */
       case OP_CALL:
       case OP_TAILCALL: {
         if (b != 0) {
@@ -468,6 +483,14 @@ static Instruction symbexec (const Proto *pt, int lastpc, int reg) {
         checkreg(pt, a+b-1);
         break;
       }
+      case OP_SWITCH: {
+        int j;
+        check(b < pt->sizek && ttistable(&pt->k[b]));
+        check(pc+1+c < pt->sizecode);
+        for (j = 1; j <= c+1; j++)  /* its jumps */
+          check(GET_OPCODE(pt->code[pc+j]) == OP_JMP);
+        break;
+      }
       default: break;
     }
   }
@@ -505,7 +528,7 @@ static const char *getobjname (gafq_State *L, CallInfo *ci, int stackpos,
       return "local";
     i = symbexec(p, pc, stackpos);  /* try symbolic execution */
     gafq_assert(pc != -1);
-    switch (GET_OPCODE(i)) {
+    switch (baseOp(GET_OPCODE(i))) {
       case OP_GETGLOBAL: {
         int g = GETARG_Bx(i);  /* global index */
         gafq_assert(ttisstring(&p->k[g]));
@@ -548,7 +571,7 @@ static const char *getfuncname (gafq_State *L, CallInfo *ci, const char **name)
   ci--;  /* calling function */
   i = ci_func(ci)->l.p->code[currentpc(L, ci)];
   if (GET_OPCODE(i) == OP_CALL || GET_OPCODE(i) == OP_TAILCALL ||
-      GET_OPCODE(i) == OP_TFORLOOP)
+      GET_OPCODE(i) == OP_INTRINSIC || GET_OPCODE(i) == OP_TFORLOOP)
     return getobjname(L, ci, GETARG_A(i), name);
   else
     return NULL;  /* no useful name can be found */
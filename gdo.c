@@ -397,7 +397,8 @@ static void resume (gafq_State *L, void *ud) {
     if (!f_isGafq(ci)) {  /* `common' yield? */
       /* finish interrupted execution of `OP_CALL' */
       gafq_assert(GET_OPCODE(*((ci-1)->savedpc - 1)) == OP_CALL ||
-                 GET_OPCODE(*((ci-1)->savedpc - 1)) == OP_TAILCALL);
+                 GET_OPCODE(*((ci-1)->savedpc - 1)) == OP_TAILCALL ||
+                 GET_OPCODE(*((ci-1)->savedpc - 1)) == OP_INTRINSIC);
       if (gafqD_poscall(L, firstArg))  /* complete it... */
         L->top = L->ci->top;  /* and correct top if not multiple results */
     }
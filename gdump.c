@@ -12,7 +12,9 @@
 #include "gafq.h"
 
 #include "gobject.h"
+#include "gopcodes.h"
 #include "gstate.h"
+#include "gtable.h"
 #include "gundump.h"
 
 typedef struct {
@@ -52,6 +54,11 @@ static void DumpNumber(gafq_Number x, DumpState* D)
  DumpVar(x,D);
 }
 
+static void DumpInteger(l_int x, DumpState* D)
+{
+ DumpVar(x,D);
+}
+
 static void DumpVector(const void* b, int n, size_t size, DumpState* D)
 {
  DumpInt(n,D);
@@ -73,36 +80,73 @@ static void DumpString(const TString* s, DumpState* D)
  }
 }
 
-#define DumpCode(f,D)	 DumpVector(f->code,f->sizecode,sizeof(Instruction),D)
+static void DumpCode(const Proto* f, DumpState* D)
+{
+ int i,n=f->sizecode;
+ DumpInt(n,D);
+ for (i=0; i<n; i++)			/* undo quickening (see gvm.c) */
+ {
+  Instruction c=f->code[i];
+  OpCode o=GET_OPCODE(c);
+  if (o==OP_SETLIST && GETARG_C(c)==0)	/* next word is no instruction */
+  {
+   DumpVar(c,D);
+   c=f->code[++i];
+  }
+  else if (o>=FIRST_QUICK)
+   c=BASEINSTR(c);
+  DumpVar(c,D);
+ }
+}
 
 static void DumpFunction(const Proto* f, const TString* p, DumpState* D);
 
-static void DumpConstants(const Proto* f, DumpState* D)
+static void DumpConstant(const TValue* o, DumpState* D)
 {
- int i,n=f->sizek;
- DumpInt(n,D);
- for (i=0; i<n; i++)
+ DumpChar(rttype(o),D);
+ switch (rttype(o))
  {
-  const TValue* o=&f->k[i];
-  DumpChar(ttype(o),D);
-  switch (ttype(o))
-  {
-   case GAFQ_TNIL:
+  case GAFQ_TNIL:
 	break;
-   case GAFQ_TBOOLEAN:
+  case GAFQ_TBOOLEAN:
 	DumpChar(bvalue(o),D);
 	break;
-   case GAFQ_TNUMBER:
-	DumpNumber(nvalue(o),D);
+  case GAFQ_TNUMBER:
+	DumpNumber(fltvalue(o),D);
 	break;
-   case GAFQ_TSTRING:
+  case GAFQ_TNUMINT:
+	DumpInteger(ivalue(o),D);
+	break;
+  case GAFQ_TSTRING:
 	DumpString(rawtsvalue(o),D);
 	break;
-   default:
-	gafq_assert(0);			/* cannot happen */
+  case GAFQ_TTABLE:			/* cases of a SWITCH: keys in case order */
+  {
+	Table* t=hvalue(o);
+	TValue kv[2];
+	int j,n=0;
+	setnilvalue(&kv[0]);
+	while (gafqH_next(D->L,t,kv)) if (ivalue(&kv[1])>n) n=(int)ivalue(&kv[1]);
+	DumpInt(n,D);
+	for (j=1; j<=n; j++)
+	{
+	 setnilvalue(&kv[0]);
+	 while (gafqH_next(D->L,t,kv) && ivalue(&kv[1])!=j) ;
+	 if (ttisnil(&kv[0])) DumpChar(GAFQ_TNIL,D); else DumpConstant(&kv[0],D);
+	}
 	break;
   }
+  default:
+	gafq_assert(0);			/* cannot happen */
+	break;
  }
+}
+
+static void DumpConstants(const Proto* f, DumpState* D)
+{
+ int i,n=f->sizek;
+ DumpInt(n,D);
+ for (i=0; i<n; i++) DumpConstant(&f->k[i],D);
  n=f->sizep;
  DumpInt(n,D);
  for (i=0; i<n; i++) DumpFunction(f->p[i],f->source,D);
@@ -14,6 +14,7 @@
 
 #include "gfunc.h"
 #include "ggc.h"
+#include "gjit.h"
 #include "gmem.h"
 #include "gobject.h"
 #include "gstate.h"
@@ -121,6 +122,10 @@ Proto *gafqF_newproto (gafq_State *L) {
   f->sizep = 0;
   f->code = NULL;
   f->sizecode = 0;
+  f->icache = NULL;
+  f->sizeicache = 0;
+  f->jit = NULL;
+  f->jitcount = 0;
   f->sizelineinfo = 0;
   f->sizeupvalues = 0;
   f->nups = 0;
@@ -138,8 +143,25 @@ Proto *gafqF_newproto (gafq_State *L) {
 }
 
 
+/*
+** create the inline caches of a finished prototype (see 'gvm.c'); every
+** hint starts at node 0, which always exists
+*/
+void gafqF_initcache (gafq_State *L, Proto *f) {
+  int i;
+  gafq_assert(f->icache == NULL);
+  f->icache = gafqM_newvector(L, f->sizecode, int);
+  f->sizeicache = f->sizecode;
+  for (i = 0; i < f->sizeicache; i++) f->icache[i] = 0;
+}
+
+
 void gafqF_freeproto (gafq_State *L, Proto *f) {
+#if defined(GAFQ_USE_JIT)
+  if (f->jit) gafqJ_free(L, f);
+#endif
   gafqM_freearray(L, f->code, f->sizecode, Instruction);
+  gafqM_freearray(L, f->icache, f->sizeicache, int);
   gafqM_freearray(L, f->p, f->sizep, Proto *);
   gafqM_freearray(L, f->k, f->sizek, TValue);
   gafqM_freearray(L, f->lineinfo, f->sizelineinfo, int);
@@ -24,6 +24,7 @@ GAFQI_FUNC Closure *gafqF_newLclosure (gafq_State *L, int nelems, Table *e);
 GAFQI_FUNC UpVal *gafqF_newupval (gafq_State *L);
 GAFQI_FUNC UpVal *gafqF_findupval (gafq_State *L, StkId level);
 GAFQI_FUNC void gafqF_close (gafq_State *L, StkId level);
+GAFQI_FUNC void gafqF_initcache (gafq_State *L, Proto *f);
 GAFQI_FUNC void gafqF_freeproto (gafq_State *L, Proto *f);
 GAFQI_FUNC void gafqF_freeclosure (gafq_State *L, Closure *c);
 GAFQI_FUNC void gafqF_freeupval (gafq_State *L, UpVal *uv);
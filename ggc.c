@@ -71,6 +71,8 @@ static void reallymarkobject (global_State *g, GCObject *o) {
   white2gray(o);
   switch (o->gch.tt) {
     case GAFQ_TSTRING: {
+      if (isview(rawgco2ts(o)))  /* keep its chars alive */
+        stringmark(viewparent(rawgco2ts(o)));
       return;
     }
     case GAFQ_TUSERDATA: {
@@ -155,6 +157,22 @@ size_t gafqC_separateudata (gafq_State *L, int all) {
 }
 
 
+static void traversenodes (global_State *g, Node *node, int size,
+                           int weakkey, int weakvalue) {
+  while (size--) {
+    Node *n = &node[size];
+    gafq_assert(ttype(gkey(n)) != GAFQ_TDEADKEY || ttisnil(gval(n)));
+    if (ttisnil(gval(n)))
+      removeentry(n);  /* remove empty entries */
+    else {
+      gafq_assert(!ttisnil(gkey(n)));
+      if (!weakkey) markvalue(g, gkey(n));
+      if (!weakvalue) markvalue(g, gval(n));
+    }
+  }
+}
+
+
 static int traversetable (global_State *g, Table *h) {
   int i;
   int weakkey = 0;
@@ -175,23 +193,14 @@ static int traversetable (global_State *g, Table *h) {
     }
   }
   if (weakkey && weakvalue) return 1;
-  if (!weakvalue) {
+  if (!weakvalue && !ispacked(h)) {  /* (packed arrays hold no objects) */
     i = h->sizearray;
     while (i--)
       markvalue(g, &h->array[i]);
   }
-  i = sizenode(h);
-  while (i--) {
-    Node *n = gnode(h, i);
-    gafq_assert(ttype(gkey(n)) != GAFQ_TDEADKEY || ttisnil(gval(n)));
-    if (ttisnil(gval(n)))
-      removeentry(n);  /* remove empty entries */
-    else {
-      gafq_assert(!ttisnil(gkey(n)));
-      if (!weakkey) markvalue(g, gkey(n));
-      if (!weakvalue) markvalue(g, gval(n));
-    }
-  }
+  traversenodes(g, h->node, sizenode(h), weakkey, weakvalue);
+  if (h->oldnode)  /* still moving an old node part? */
+    traversenodes(g, h->oldnode, twoto(h->oldlsize), weakkey, weakvalue);
   return weakkey || weakvalue;
 }
 
@@ -284,8 +293,8 @@ static l_mem propagatemark (global_State *g) {
       g->gray = h->gclist;
       if (traversetable(g, h))  /* table is weak? */
         black2gray(o);  /* keep it gray */
-      return sizeof(Table) + sizeof(TValue) * h->sizearray +
-                             sizeof(Node) * sizenode(h);
+      return sizeof(Table) + arraysize(h) + nodesize(sizenode(h)) +
+             (h->oldnode ? nodesize(twoto(h->oldlsize)) : 0);
     }
     case GAFQ_TFUNCTION: {
       Closure *cl = gco2cl(o);
@@ -338,6 +347,8 @@ static int iscleared (const TValue *o, int iskey) {
   if (!iscollectable(o)) return 0;
   if (ttisstring(o)) {
     stringmark(rawtsvalue(o));  /* strings are `values', so are never weak */
+    if (isview(rawtsvalue(o)))
+      stringmark(viewparent(rawtsvalue(o)));
     return 0;
   }
   return iswhite(gcvalue(o)) ||
@@ -345,6 +356,18 @@ static int iscleared (const TValue *o, int iskey) {
 }
 
 
+static void clearnodes (Node *node, int size) {
+  while (size--) {
+    Node *n = &node[size];
+    if (!ttisnil(gval(n)) &&  /* non-empty entry? */
+        (iscleared(key2tval(n), 1) || iscleared(gval(n), 0))) {
+      setnilvalue(gval(n));  /* remove value ... */
+      removeentry(n);  /* remove entry from table */
+    }
+  }
+}
+
+
 /*
 ** clear collected entries from weaktables
 */
@@ -354,22 +377,16 @@ static void cleartable (GCObject *l) {
     int i = h->sizearray;
     gafq_assert(testbit(h->marked, VALUEWEAKBIT) ||
                testbit(h->marked, KEYWEAKBIT));
-    if (testbit(h->marked, VALUEWEAKBIT)) {
+    if (testbit(h->marked, VALUEWEAKBIT) && !ispacked(h)) {
       while (i--) {
         TValue *o = &h->array[i];
         if (iscleared(o, 0))  /* value was collected? */
           setnilvalue(o);  /* remove value */
       }
     }
-    i = sizenode(h);
-    while (i--) {
-      Node *n = gnode(h, i);
-      if (!ttisnil(gval(n)) &&  /* non-empty entry? */
-          (iscleared(key2tval(n), 1) || iscleared(gval(n), 0))) {
-        setnilvalue(gval(n));  /* remove value ... */
-        removeentry(n);  /* remove entry from table */
-      }
-    }
+    clearnodes(h->node, sizenode(h));
+    if (h->oldnode)
+      clearnodes(h->oldnode, twoto(h->oldlsize));
     l = h->gclist;
   }
 }
@@ -387,8 +404,12 @@ static void freeobj (gafq_State *L, GCObject *o) {
       break;
     }
     case GAFQ_TSTRING: {
-      G(L)->strt.nuse--;
-      gafqM_freemem(L, o, sizestring(gco2ts(o)));
+      if (!gafqS_islong(rawgco2ts(o)))  /* in the string table? */
+        G(L)->strt.nuse--;
+      if (isview(rawgco2ts(o)))
+        gafqM_freemem(L, o, sizeof(StrView));
+      else
+        gafqM_freemem(L, o, sizestring(gco2ts(o)));
       break;
     }
     case GAFQ_TUSERDATA: {
@@ -432,7 +453,7 @@ static void checkSizes (gafq_State *L) {
   global_State *g = G(L);
   /* check size of string hash */
   if (g->strt.nuse < cast(lu_int32, g->strt.size/4) &&
-      g->strt.size > MINSTRTABSIZE*2)
+      g->strt.size > MINSTRTABSIZE*2 && g->strt.oldpos == 0)
     gafqS_resize(L, g->strt.size/2);  /* table is too big */
   /* check size of buffer */
   if (gafqZ_sizebuffer(&g->buff) > GAFQ_MINBUFFER*2) {  /* buffer too big? */
@@ -485,8 +506,10 @@ void gafqC_freeall (gafq_State *L) {
   int i;
   g->currentwhite = WHITEBITS | bitmask(SFIXEDBIT);  /* mask to collect all elements */
   sweepwholelist(L, &g->rootgc);
-  for (i = 0; i < g->strt.size; i++)  /* free all string lists */
-    sweepwholelist(L, &g->strt.hash[i]);
+  for (i = 0; i < g->strt.size + g->strt.oldpos; i++) {  /* all strings */
+    GCObject **p = gafqS_list(&g->strt, i);
+    if (p) sweepwholelist(L, p);
+  }
 }
 
 
@@ -571,8 +594,9 @@ static l_mem singlestep (gafq_State *L) {
     }
     case GCSsweepstring: {
       lu_mem old = g->totalbytes;
-      sweepwholelist(L, &g->strt.hash[g->sweepstrgc++]);
-      if (g->sweepstrgc >= g->strt.size)  /* nothing more to sweep? */
+      GCObject **p = gafqS_list(&g->strt, g->sweepstrgc++);
+      if (p) sweepwholelist(L, p);
+      if (g->sweepstrgc >= g->strt.size + g->strt.oldpos)  /* all swept? */
         g->gcstate = GCSsweep;  /* end sweep-string phase */
       gafq_assert(old >= g->totalbytes);
       g->estimate -= old - g->totalbytes;
@@ -581,12 +605,12 @@ static l_mem singlestep (gafq_State *L) {
     case GCSsweep: {
       lu_mem old = g->totalbytes;
       g->sweepgc = sweeplist(L, g->sweepgc, GCSWEEPMAX);
+      gafq_assert(old >= g->totalbytes);
+      g->estimate -= old - g->totalbytes;
       if (*g->sweepgc == NULL) {  /* nothing more to sweep? */
-        checkSizes(L);
+        checkSizes(L);  /* (a string table that shrinks may grow first) */
         g->gcstate = GCSfinalize;  /* end sweep phase */
       }
-      gafq_assert(old >= g->totalbytes);
-      g->estimate -= old - g->totalbytes;
       return GCSWEEPMAX*GCSWEEPCOST;
     }
     case GCSfinalize: {
@@ -0,0 +1,1985 @@
+/*
+** $Id: gjit.c $
+** Baseline compiler from bytecode to x86-64 machine code
+** See Copyright Notice in gafq.h
+*/
+
+
+#define gjit_c
+#define GAFQ_CORE
+
+#include "gafq.h"
+
+#if defined(GAFQ_USE_JIT)
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "gdebug.h"
+#include "gdo.h"
+#include "gfunc.h"
+#include "ggc.h"
+#include "gjit.h"
+#include "gmem.h"
+#include "gobject.h"
+#include "gopcodes.h"
+#include "gstate.h"
+#include "gtable.h"
+#include "gtm.h"
+#include "gvm.h"
+
+
+/*
+** A function that has been called GAFQI_JITCALLS times is translated
+** instruction by instruction: each opcode is stamped out as a fixed
+** template with its operands as immediates, so the code needs neither
+** fetch nor dispatch. Simple opcodes (moves, constants, jumps, tests,
+** numeric `for' loops and the numeric cases of arithmetic and compares)
+** run inline; everything else calls a helper below that does exactly
+** what the interpreter does for that opcode. Hot numeric `for' loops
+** may then get a trace (see `Loop traces' below).
+**
+** Native code keeps `L' in rbx, `base' in r12, the constants in r13 and
+** the closure in r14, and may be entered at any instruction (see
+** `gafqJ_execute'). It leaves through a common epilogue with a JIT_*
+** code: to start a Gafq call, when a C function yields, and to let the
+** interpreter run returns, tail calls and anything while hooks are on
+** (noticed after every helper and on every backward jump, like the fast
+** interpreter loop does). `L->savedpc' is set before each helper, so
+** errors and the debug interface see the right instruction.
+*/
+
+
+/* results from compiled code */
+#define JIT_EXIT	1	/* continue interpreting at `L->savedpc' */
+#define JIT_CALL	2	/* entered a Gafq function (as PCRGAFQ) */
+#define JIT_YIELD	3	/* C function yielded */
+#define JIT_DONE	4	/* returned from the last frame */
+
+
+/* a numeric `for' loop of compiled code (see `h_trace') */
+typedef struct JitLoop {
+  const unsigned char *target;  /* where its back edge goes */
+  unsigned char *trace;  /* mapping of its trace, if any */
+  size_t size;
+  int pc;  /* the FORLOOP */
+} JitLoop;
+
+
+typedef struct JitCode {
+  unsigned char *mcode;  /* entry point, followed by the instructions */
+  size_t size;  /* size of the mapping */
+  JitLoop *loops;
+  int sizeloops;
+  int sizemap;
+  int map[1];  /* offset in `mcode' of each instruction */
+} JitCode;
+
+#define sizejitcode(n)	(sizeof(JitCode) + ((n)-1)*sizeof(int))
+
+
+/* what compiled code returns (in rax:rdx) */
+typedef struct JitExit {
+  size_t code;  /* JIT_* */
+  size_t nexeccalls;
+} JitExit;
+
+/* what calls and returns give back to compiled code (in rax:rdx) */
+typedef struct JitJump {
+  const unsigned char *target;  /* code of the new frame, if compiled */
+  size_t code;  /* otherwise, JIT_* (or 0 to continue after a C call) */
+} JitJump;
+
+typedef JitExit (*Entry) (gafq_State *L, const unsigned char *target,
+                          size_t nexeccalls);
+typedef int (*Helper) (gafq_State *L, Instruction i, int *ic);
+
+
+typedef struct JitState {
+  Proto *f;
+  JitCode *jc;
+  unsigned char *buf;  /* NULL while only measuring the code */
+  int n;  /* current offset */
+  int pc;  /* instruction being compiled */
+  int enter;  /* offset of the code entering the current frame */
+  int leave;  /* offset of the epilogue */
+  int exitkeep;  /* offset of the exit with `L->savedpc' already set */
+  int exitrdx;  /* offset of the exit with the code in rdx */
+  int nloop;  /* FORLOOPs so far */
+} JitState;
+
+
+/* registers */
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+       R8, R9, R10, R11, R12, R13, R14, R15 };
+
+#define rL	RBX
+#define rBASE	R12
+#define rK	R13
+#define rCL	R14
+#define rN	R15	/* `nexeccalls' */
+
+/* condition codes */
+#define CC_O	0x0
+#define CC_B	0x2
+#define CC_AE	0x3
+#define CC_E	0x4
+#define CC_NE	0x5
+#define CC_BE	0x6
+#define CC_A	0x7
+#define CC_S	0x8
+#define CC_P	0xA
+#define CC_L	0xC
+#define CC_LE	0xE
+#define CC_G	0xF
+#define CC_JMP	(-1)
+
+#define R(x)	(cast_int(sizeof(TValue)) * (x))
+#define VOFF	cast_int(offsetof(TValue, value))
+#define TOFF	cast_int(offsetof(TValue, tt))
+#define LOFF(f)	cast_int(offsetof(gafq_State, f))
+
+#define ptr(p)	cast(lu_int, cast(size_t, (p)))
+
+#define HOOKMASK	(GAFQ_MASKLINE | GAFQ_MASKCOUNT)
+
+
+/*
+** {======================================================
+** Machine code emission
+** =======================================================
+*/
+
+static void b1 (JitState *J, int b) {
+  if (J->buf) J->buf[J->n] = cast(unsigned char, b);
+  J->n++;
+}
+
+
+static void b4 (JitState *J, int v) {
+  if (J->buf) memcpy(J->buf + J->n, &v, 4);
+  J->n += 4;
+}
+
+
+static void b8 (JitState *J, lu_int v) {
+  if (J->buf) memcpy(J->buf + J->n, &v, 8);
+  J->n += 8;
+}
+
+
+/* instruction `op' (one or two bytes) with a memory operand [base+disp] */
+static void mem (JitState *J, int pfx, int w, int op, int reg, int base,
+                 int disp) {
+  int rex = (w << 3) | ((reg & 8) >> 1) | ((base & 8) >> 3);
+  int small = (-128 <= disp && disp <= 127);
+  if (pfx) b1(J, pfx);
+  if (rex) b1(J, 0x40 | rex);
+  if (op > 0xff) b1(J, op >> 8);
+  b1(J, op & 0xff);
+  b1(J, (small ? 0x40 : 0x80) | ((reg & 7) << 3) | (base & 7));
+  if ((base & 7) == RSP) b1(J, 0x24);  /* SIB byte for rsp and r12 */
+  if (small) b1(J, disp);
+  else b4(J, disp);
+}
+
+
+/* instruction `op' between two registers */
+static void rr (JitState *J, int w, int op, int reg, int rm) {
+  int rex = (w << 3) | ((reg & 8) >> 1) | ((rm & 8) >> 3);
+  if (rex) b1(J, 0x40 | rex);
+  b1(J, op);
+  b1(J, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+
+static void movi64 (JitState *J, int reg, lu_int v) {
+  b1(J, 0x48 | ((reg & 8) >> 3));
+  b1(J, 0xB8 + (reg & 7));
+  b8(J, v);
+}
+
+
+static void movi32 (JitState *J, int reg, int v) {
+  if (reg & 8) b1(J, 0x41);
+  b1(J, 0xB8 + (reg & 7));
+  b4(J, v);
+}
+
+
+/* jump (CC_JMP) or conditional jump to be patched by `here' */
+static int jcc (JitState *J, int cc) {
+  if (cc == CC_JMP) b1(J, 0xE9);
+  else { b1(J, 0x0F); b1(J, 0x80 | cc); }
+  b4(J, 0);
+  return J->n - 4;
+}
+
+
+static void here (JitState *J, int pos) {
+  if (pos >= 0 && J->buf) {
+    int rel = J->n - (pos + 4);
+    memcpy(J->buf + pos, &rel, 4);
+  }
+}
+
+
+static void jccto (JitState *J, int cc, int offset) {
+  int pos = jcc(J, cc);
+  if (J->buf) {
+    int rel = offset - (pos + 4);
+    memcpy(J->buf + pos, &rel, 4);
+  }
+}
+
+
+/* jump to instruction `idx' (whose offset is only known in the 2nd pass) */
+#define tolabel(J,cc,idx)	jccto(J, cc, (J)->jc->map[idx])
+
+/* cmp dword [base+disp], imm8 */
+#define cmpi(J,base,disp,v)	(mem(J, 0, 0, 0x83, 7, base, disp), b1(J, v))
+
+/* mov dword [base+disp], imm32 */
+#define movmi(J,base,disp,v)	(mem(J, 0, 0, 0xC7, 0, base, disp), b4(J, v))
+
+/* copy a TValue */
+#define copytv(J,db,dd,sb,sd) \
+	(mem(J, 0, 0, 0x0F10, 0, sb, sd), mem(J, 0, 0, 0x0F11, 0, db, dd))
+
+#define loadbase(J)	mem(J, 0, 1, 0x8B, rBASE, rL, LOFF(base))
+
+/* test byte [L->hookmask] */
+#define testhooks(J)	(mem(J, 0, 0, 0xF6, 0, rL, LOFF(hookmask)), \
+			 b1(J, HOOKMASK))
+
+
+static void savepc (JitState *J, int idx) {
+  movi64(J, RAX, ptr(J->f->code + idx));
+  mem(J, 0, 1, 0x89, RAX, rL, LOFF(savedpc));
+}
+
+
+/* leave for the interpreter, which resumes at instruction `idx' */
+static void exitto (JitState *J, int idx) {
+  savepc(J, idx);
+  movi32(J, RAX, JIT_EXIT);
+  jccto(J, CC_JMP, J->leave);
+}
+
+
+/* jump to instruction `target'; backward jumps look for new hooks first */
+static void jumpto (JitState *J, int target) {
+  if (target <= J->pc) {
+    testhooks(J);
+    tolabel(J, CC_E, target);
+    exitto(J, target);
+  }
+  else
+    tolabel(J, CC_JMP, target);
+}
+
+
+static void emitcall (JitState *J, lu_int h, int *ic) {
+  savepc(J, J->pc + 1);
+  rr(J, 1, 0x89, rL, RDI);
+  movi32(J, RSI, cast_int(BASEINSTR(J->f->code[J->pc])));
+  movi64(J, RDX, ptr(ic));
+  rr(J, 1, 0x89, rN, RCX);
+  movi64(J, RAX, h);
+  b1(J, 0xFF); b1(J, 0xD0);  /* call rax */
+  loadbase(J);  /* helper may change the stack */
+}
+
+#define callhelper(J,h,ic)	emitcall(J, ptr(h), ic)
+
+
+/* after a call or return: switch frames or leave */
+static void jump (JitState *J) {
+  rr(J, 1, 0x85, RAX, RAX);
+  jccto(J, CC_NE, J->enter);
+  rr(J, 0, 0x85, RDX, RDX);
+  jccto(J, CC_NE, J->exitrdx);
+}
+
+
+/* after a helper, give way to new hooks before instruction `next' */
+static void checkhooks (JitState *J, int next) {
+  testhooks(J);
+  if (next == J->pc + 1)  /* `L->savedpc' already points there */
+    jccto(J, CC_NE, J->exitkeep);
+  else {
+    int skip = jcc(J, CC_E);
+    exitto(J, next);
+    here(J, skip);
+  }
+}
+
+
+/* branch to the labels `f1' and `f2' when the value is false */
+static void testfalse (JitState *J, int base, int disp, int *f1, int *f2) {
+  int t;
+  cmpi(J, base, disp + TOFF, GAFQ_TNIL);
+  *f1 = jcc(J, CC_E);
+  cmpi(J, base, disp + TOFF, GAFQ_TBOOLEAN);
+  t = jcc(J, CC_NE);
+  cmpi(J, base, disp + VOFF, 0);
+  *f2 = jcc(J, CC_E);
+  here(J, t);
+}
+
+
+static void rkop (JitState *J, int x, int *base, int *disp) {
+  if (ISK(x)) { *base = rK; *disp = R(INDEXK(x)); }
+  else { *base = rBASE; *disp = R(x); }
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Helpers (each one is the interpreter's body of its opcode)
+** =======================================================
+*/
+
+static void compile (gafq_State *L, Proto *p);
+static void trace (gafq_State *L, JitLoop *lp);
+
+
+/*
+** code continuing the current frame at `L->savedpc', or NULL when the
+** interpreter must run it; new calls count towards compilation
+*/
+static const unsigned char *resume (gafq_State *L) {
+  Proto *p = curr_func(L)->l.p;
+  JitCode *jc;
+  if (L->hookmask & HOOKMASK)  /* compiled code never runs hooks */
+    return NULL;
+  if ((jc = p->jit) == NULL) {
+    if (L->savedpc == p->code && p->jitcount < GAFQI_JITCALLS)
+      p->jitcount++;  /* one more call */
+    if (p->jitcount != GAFQI_JITCALLS)  /* not hot (or failed before)? */
+      return NULL;
+    compile(L, p);
+    if ((jc = p->jit) == NULL) {
+      p->jitcount++;  /* do not try again */
+      return NULL;
+    }
+  }
+  return jc->mcode + jc->map[L->savedpc - p->code];
+}
+
+
+#define hK	(curr_func(L)->l.p->k)
+#define hRA(i)	(L->base + GETARG_A(i))
+#define hRB(i)	(L->base + GETARG_B(i))
+#define hRK(x)	(ISK(x) ? hK + INDEXK(x) : L->base + (x))
+
+
+static int h_getglobal (gafq_State *L, Instruction i, int *ic) {
+  TValue g;
+  sethvalue(L, &g, curr_func(L)->l.env);
+  gafqV_gettablecached(L, &g, hK + GETARG_Bx(i), hRA(i), ic);
+  return 0;
+}
+
+
+static int h_setglobal (gafq_State *L, Instruction i, int *ic) {
+  TValue g;
+  sethvalue(L, &g, curr_func(L)->l.env);
+  gafqV_settablecached(L, &g, hK + GETARG_Bx(i), hRA(i), ic);
+  return 0;
+}
+
+
+/* `ic' is NULL unless the key is a constant string */
+static int h_gettable (gafq_State *L, Instruction i, int *ic) {
+  if (ic) gafqV_gettablecached(L, hRB(i), hRK(GETARG_C(i)), hRA(i), ic);
+  else gafqV_gettable(L, hRB(i), hRK(GETARG_C(i)), hRA(i));
+  return 0;
+}
+
+
+static int h_settable (gafq_State *L, Instruction i, int *ic) {
+  if (ic) gafqV_settablecached(L, hRA(i), hRK(GETARG_B(i)),
+                               hRK(GETARG_C(i)), ic);
+  else gafqV_settable(L, hRA(i), hRK(GETARG_B(i)), hRK(GETARG_C(i)));
+  return 0;
+}
+
+
+static int h_append (gafq_State *L, Instruction i, int *ic) {
+  StkId ra = hRA(i);
+  TValue *rb = hRK(GETARG_B(i));
+  UNUSED(ic);
+  if (ttistable(ra) &&
+      fasttm(L, hvalue(ra)->metatable, TM_NEWINDEX) == NULL)
+    gafqH_append(L, hvalue(ra), rb);
+  else {  /* as `LEN C A; ADD C C 1; SETTABLE A C B' */
+    TValue one;
+    setivalue(&one, 1);
+    gafqV_objlen(L, L->base + GETARG_C(i), hRA(i));
+    gafqV_arith(L, L->base + GETARG_C(i), L->base + GETARG_C(i), &one,
+                TM_ADD);
+    gafqV_settable(L, hRA(i), L->base + GETARG_C(i), hRK(GETARG_B(i)));
+  }
+  return 0;
+}
+
+
+static int h_self (gafq_State *L, Instruction i, int *ic) {
+  StkId ra = hRA(i);
+  setobjs2s(L, ra+1, hRB(i));
+  return h_gettable(L, i, ic);
+}
+
+
+static int h_setupval (gafq_State *L, Instruction i, int *ic) {
+  UpVal *uv = curr_func(L)->l.upvals[GETARG_B(i)];
+  StkId ra = hRA(i);
+  UNUSED(ic);
+  setobj(L, uv->v, ra);
+  gafqC_barrier(L, uv, ra);
+  return 0;
+}
+
+
+static int h_newtable (gafq_State *L, Instruction i, int *ic) {
+  UNUSED(ic);
+  sethvalue(L, hRA(i), gafqH_new(L, gafqO_fb2int(GETARG_B(i)),
+                                    gafqO_fb2int(GETARG_C(i))));
+  gafqC_checkGC(L);
+  return 0;
+}
+
+
+static int h_arith (gafq_State *L, Instruction i, int *ic) {
+  TMS op = cast(TMS, TM_ADD + (GET_OPCODE(i) - OP_ADD));  /* ORDER TM */
+  UNUSED(ic);
+  if (op == TM_UNM)
+    gafqV_arith(L, hRA(i), hRB(i), hRB(i), op);
+  else
+    gafqV_arith(L, hRA(i), hRK(GETARG_B(i)), hRK(GETARG_C(i)), op);
+  return 0;
+}
+
+
+static int h_not (gafq_State *L, Instruction i, int *ic) {
+  int res = l_isfalse(hRB(i));
+  UNUSED(ic);
+  setbvalue(hRA(i), res);
+  return 0;
+}
+
+
+static int h_len (gafq_State *L, Instruction i, int *ic) {
+  UNUSED(ic);
+  gafqV_objlen(L, hRA(i), hRB(i));
+  return 0;
+}
+
+
+static int h_concat (gafq_State *L, Instruction i, int *ic) {
+  int b = GETARG_B(i);
+  int c = GETARG_C(i);
+  UNUSED(ic);
+  gafqV_concat(L, c-b+1, c);
+  gafqC_checkGC(L);
+  setobjs2s(L, hRA(i), L->base+b);
+  return 0;
+}
+
+
+/* compares return whether to jump */
+static int h_eq (gafq_State *L, Instruction i, int *ic) {
+  TValue *rb = hRK(GETARG_B(i));
+  TValue *rc = hRK(GETARG_C(i));
+  UNUSED(ic);
+  return equalobj(L, rb, rc) == GETARG_A(i);
+}
+
+
+static int h_lt (gafq_State *L, Instruction i, int *ic) {
+  UNUSED(ic);
+  return gafqV_lessthan(L, hRK(GETARG_B(i)), hRK(GETARG_C(i))) == GETARG_A(i);
+}
+
+
+static int h_le (gafq_State *L, Instruction i, int *ic) {
+  UNUSED(ic);
+  return gafqV_lessequal(L, hRK(GETARG_B(i)), hRK(GETARG_C(i))) ==
+         GETARG_A(i);
+}
+
+
+static JitJump h_call (gafq_State *L, Instruction i, int *ic,
+                       size_t nexeccalls) {
+  StkId ra = hRA(i);
+  int b = GETARG_B(i);
+  int nresults = GETARG_C(i) - 1;
+  JitJump j;
+  UNUSED(ic); UNUSED(nexeccalls);
+  j.target = NULL;
+  j.code = 0;
+  if (b != 0) L->top = ra+b;  /* else previous instruction set top */
+  switch (gafqD_precall(L, ra, nresults)) {
+    case PCRGAFQ: {
+      if ((j.target = resume(L)) == NULL)
+        j.code = JIT_CALL;  /* let the interpreter run it */
+      break;
+    }
+    case PCRC: {
+      /* it was a C function (`precall' called it); adjust results */
+      if (nresults >= 0) L->top = L->ci->top;
+      break;
+    }
+    default: {
+      j.code = JIT_YIELD;
+      break;
+    }
+  }
+  return j;
+}
+
+
+static JitJump h_intrinsic (gafq_State *L, Instruction i, int *ic,
+                            size_t nexeccalls) {
+  int b = GETARG_B(i);
+  if (gafqV_intrinsic(L, hRA(i), b, GETARG_C(i) - 1)) {
+    JitJump j;
+    j.target = NULL;
+    j.code = 0;
+    return j;
+  }
+  i = CREATE_ABC(OP_CALL, GETARG_A(i), biargs(b) + 1, GETARG_C(i));
+  return h_call(L, i, ic, nexeccalls);
+}
+
+
+static JitJump h_return (gafq_State *L, Instruction i, int *ic,
+                         size_t nexeccalls) {
+  StkId ra = hRA(i);
+  int b = GETARG_B(i);
+  JitJump j;
+  UNUSED(ic);
+  if (b != 0) L->top = ra+b-1;
+  if (L->openupval) gafqF_close(L, L->base);
+  b = gafqD_poscall(L, ra);
+  j.target = NULL;
+  if (nexeccalls == 1)  /* was the first frame of `gafqV_execute'? */
+    j.code = JIT_DONE;
+  else {
+    if (b) L->top = L->ci->top;
+    j.target = resume(L);
+    j.code = JIT_EXIT;  /* interpret the caller, unless compiled */
+  }
+  return j;
+}
+
+
+/* loops over gafq_Number (the integer loop is inline) */
+static int h_forloop (gafq_State *L, Instruction i, int *ic) {
+  StkId ra = hRA(i);
+  gafq_Number step = nvalue(ra+2);
+  gafq_Number idx = gafqi_numadd(nvalue(ra), step); /* increment index */
+  gafq_Number limit = nvalue(ra+1);
+  UNUSED(ic);
+  if (gafqi_numlt(0, step) ? gafqi_numle(idx, limit)
+                          : gafqi_numle(limit, idx)) {
+    setnvalue(ra, idx);  /* update internal index... */
+    setnvalue(ra+3, idx);  /* ...and external index */
+    return 1;
+  }
+  return 0;
+}
+
+
+static int h_forprep (gafq_State *L, Instruction i, int *ic) {
+  UNUSED(ic);
+  gafqV_forprep(L, hRA(i));
+  return 0;
+}
+
+
+static int h_tforloop (gafq_State *L, Instruction i, int *ic) {
+  StkId ra = hRA(i);
+  StkId cb = ra + 3;  /* call base */
+  UNUSED(ic);
+  setobjs2s(L, cb+2, ra+2);
+  setobjs2s(L, cb+1, ra+1);
+  setobjs2s(L, cb, ra);
+  L->top = cb+3;  /* func. + 2 args (state and index) */
+  gafqD_call(L, cb, GETARG_C(i));
+  L->top = L->ci->top;
+  cb = hRA(i) + 3;  /* previous call may change the stack */
+  if (!ttisnil(cb)) {  /* continue loop? */
+    setobjs2s(L, cb-1, cb);  /* save control variable */
+    return 1;
+  }
+  return 0;
+}
+
+
+static int h_setlist (gafq_State *L, Instruction i, int *ic) {
+  StkId ra = hRA(i);
+  int n = GETARG_B(i);
+  int c = GETARG_C(i);
+  int last;
+  UNUSED(ic);
+  if (n == 0) {
+    n = cast_int(L->top - ra) - 1;
+    L->top = L->ci->top;
+  }
+  if (c == 0) c = cast_int(*L->savedpc);
+  if (!ttistable(ra)) return 0;
+  last = ((c-1)*LFIELDS_PER_FLUSH) + n;
+  gafqH_setlist(L, hvalue(ra), last, ra+1, n);
+  return 0;
+}
+
+
+static int h_close (gafq_State *L, Instruction i, int *ic) {
+  UNUSED(ic);
+  gafqF_close(L, hRA(i));
+  return 0;
+}
+
+
+static int h_closure (gafq_State *L, Instruction i, int *ic) {
+  LClosure *cl = &curr_func(L)->l;
+  const Instruction *pc = L->savedpc;
+  Proto *p = cl->p->p[GETARG_Bx(i)];
+  int nup = p->nups;
+  Closure *ncl = gafqF_newLclosure(L, nup, cl->env);
+  int j;
+  UNUSED(ic);
+  ncl->l.p = p;
+  for (j=0; j<nup; j++, pc++) {
+    if (GET_OPCODE(*pc) == OP_GETUPVAL)
+      ncl->l.upvals[j] = cl->upvals[GETARG_B(*pc)];
+    else {
+      gafq_assert(GET_OPCODE(*pc) == OP_MOVE);
+      ncl->l.upvals[j] = gafqF_findupval(L, L->base + GETARG_B(*pc));
+    }
+  }
+  setclvalue(L, hRA(i), ncl);
+  gafqC_checkGC(L);
+  return 0;
+}
+
+
+static int h_vararg (gafq_State *L, Instruction i, int *ic) {
+  CallInfo *ci = L->ci;
+  int b = GETARG_B(i) - 1;
+  int n = cast_int(ci->base - ci->func) - curr_func(L)->l.p->numparams - 1;
+  int j;
+  StkId ra;
+  UNUSED(ic);
+  if (b == GAFQ_MULTRET) {
+    gafqD_checkstack(L, n);
+    b = n;
+    L->top = hRA(i) + n;
+  }
+  ra = hRA(i);
+  for (j = 0; j < b; j++) {
+    if (j < n) {
+      setobjs2s(L, ra + j, ci->base - n + j);
+    }
+    else {
+      setnilvalue(ra + j);
+    }
+  }
+  return 0;
+}
+
+
+/* returns the case to jump to, or 0 for none */
+static int h_switch (gafq_State *L, Instruction i, int *ic) {
+  TValue v;
+  const TValue *n = gafqH_getv(hvalue(hK + GETARG_B(i)), hRA(i), &v);
+  UNUSED(ic);
+  if (ttisint(n) && 0 < ivalue(n) && ivalue(n) <= GETARG_C(i))
+    return cast_int(ivalue(n));
+  return 0;
+}
+
+
+/*
+** a loop got hot: try to record a trace for it; returns where its back
+** edge goes from now on
+*/
+static const unsigned char *h_trace (gafq_State *L, Instruction i,
+                                     int *ic) {
+  Proto *p = curr_func(L)->l.p;
+  JitCode *jc = p->jit;
+  int pc = cast_int(ic - p->icache);
+  JitLoop *lp = jc->loops;
+  while (lp->pc != pc) lp++;
+  lp->target = jc->mcode + jc->map[pc + 1 + GETARG_sBx(i)];
+  trace(L, lp);
+  return lp->target;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Templates
+** =======================================================
+*/
+
+static int *kstrcache (JitState *J, int x);
+
+
+/* helper for a plain instruction */
+static void helper (JitState *J, Helper h, int *ic) {
+  callhelper(J, h, ic);
+  checkhooks(J, J->pc + 1);
+}
+
+
+/*
+** Table templates. `probe' checks the inline cache of the instruction
+** for constant string `key' in the table at rax and `slot' looks up an
+** integer key in its array part; both leave the TValue found in rcx (at
+** offset NVAL for nodes) or add a jump to `m'. The fast paths need an
+** entry that is not nil and, to store, a table that is not black.
+*/
+#define NVAL	cast_int(offsetof(Node, i_val))
+#define NKEY	cast_int(offsetof(Node, i_key))
+
+#define MAXMISS	8
+
+typedef struct Miss {
+  int pos[MAXMISS];
+  int n;
+} Miss;
+
+#define miss(m,p)	(gafq_assert((m)->n < MAXMISS), (m)->pos[(m)->n++] = (p))
+
+
+static void loadtable (JitState *J, int base, int disp, Miss *m) {
+  cmpi(J, base, disp + TOFF, GAFQ_TTABLE);
+  miss(m, jcc(J, CC_NE));
+  mem(J, 0, 1, 0x8B, RAX, base, disp + VOFF);
+}
+
+
+#define loadenv(J) \
+	mem(J, 0, 1, 0x8B, RAX, rCL, cast_int(offsetof(LClosure, env)))
+
+
+static void probe (JitState *J, TString *key, int *ic, Miss *m) {
+  mem(J, 0, 0, 0x0FB6, RCX, RAX, cast_int(offsetof(Table, lsizenode)));
+  movi32(J, RDX, 1);
+  rr(J, 0, 0xD3, 4, RDX);  /* shl edx, cl: size of the node part */
+  movi64(J, R8, ptr(ic));
+  mem(J, 0, 0, 0x8B, RCX, R8, 0);  /* the hint */
+  rr(J, 0, 0x39, RDX, RCX);
+  miss(m, jcc(J, CC_AE));
+  rr(J, 1, 0x69, RCX, RCX); b4(J, cast_int(sizeof(Node)));  /* imul */
+  mem(J, 0, 1, 0x03, RCX, RAX, cast_int(offsetof(Table, node)));
+  cmpi(J, RCX, NKEY + TOFF, GAFQ_TSTRING);
+  miss(m, jcc(J, CC_NE));
+  movi64(J, RDX, ptr(key));
+  mem(J, 0, 1, 0x39, RDX, RCX, NKEY + VOFF);
+  miss(m, jcc(J, CC_NE));
+  cmpi(J, RCX, NVAL + TOFF, GAFQ_TNIL);
+  miss(m, jcc(J, CC_E));
+}
+
+
+static void slot (JitState *J, int base, int disp, Miss *m) {
+#if defined(GAFQ_PACKEDARRAYS)
+  mem(J, 0, 0, 0x80, 7, RAX, cast_int(offsetof(Table, packed)));
+  b1(J, 0);  /* cmp byte [rax+packed], 0: packed arrays go to the helper */
+  miss(m, jcc(J, CC_NE));
+#endif
+  cmpi(J, base, disp + TOFF, GAFQ_TNUMINT);
+  miss(m, jcc(J, CC_NE));
+  mem(J, 0, 1, 0x8B, RCX, base, disp + VOFF);
+  b1(J, 0x48); b1(J, 0x83); b1(J, 0xE9); b1(J, 1);  /* sub rcx, 1 */
+  mem(J, 0, 0, 0x8B, RDX, RAX, cast_int(offsetof(Table, sizearray)));
+  rr(J, 1, 0x39, RDX, RCX);
+  miss(m, jcc(J, CC_AE));
+  b1(J, 0x48); b1(J, 0xC1); b1(J, 0xE1); b1(J, 4);  /* shl rcx, 4 */
+  mem(J, 0, 1, 0x03, RCX, RAX, cast_int(offsetof(Table, array)));
+}
+
+
+/* about to store into the table at rax (see `gafqC_barriert') */
+static void storecheck (JitState *J, Miss *m) {
+  mem(J, 0, 0, 0xF6, 0, RAX, cast_int(offsetof(Table, marked)));
+  b1(J, bitmask(BLACKBIT));
+  miss(m, jcc(J, CC_NE));
+  mem(J, 0, 0, 0xC6, 0, RAX, cast_int(offsetof(Table, flags)));
+  b1(J, 0);
+}
+
+
+/* end of a fast path: the misses call the helper */
+static void fallback (JitState *J, Miss *m, Helper h, int *ic) {
+  int done = jcc(J, CC_JMP);
+  while (m->n > 0) here(J, m->pos[--m->n]);
+  helper(J, h, ic);
+  here(J, done);
+}
+
+
+/* can operand `x' be an integer key? */
+#define intkey(J,x)	(!ISK(x) || ttisnumber((J)->f->k + INDEXK(x)))
+
+
+static void gettable (JitState *J, Instruction i, Helper h) {
+  int *ic = kstrcache(J, GETARG_C(i));
+  int kb, kd;
+  Miss m;
+  m.n = 0;
+  if (ic == NULL && !intkey(J, GETARG_C(i))) {
+    helper(J, h, NULL);
+    return;
+  }
+  loadtable(J, rBASE, R(GETARG_B(i)), &m);
+  if (ic) {
+    probe(J, rawtsvalue(J->f->k + INDEXK(GETARG_C(i))), ic, &m);
+    copytv(J, rBASE, R(GETARG_A(i)), RCX, NVAL);
+  }
+  else {
+    rkop(J, GETARG_C(i), &kb, &kd);
+    slot(J, kb, kd, &m);
+    cmpi(J, RCX, TOFF, GAFQ_TNIL);
+    miss(&m, jcc(J, CC_E));
+    copytv(J, rBASE, R(GETARG_A(i)), RCX, 0);
+  }
+  fallback(J, &m, h, ic);
+}
+
+
+static void settable (JitState *J, Instruction i) {
+  int *ic = kstrcache(J, GETARG_B(i));
+  int kb, kd, vb, vd;
+  Miss m;
+  m.n = 0;
+  if (ic == NULL && !intkey(J, GETARG_B(i))) {
+    helper(J, h_settable, NULL);
+    return;
+  }
+  rkop(J, GETARG_C(i), &vb, &vd);
+  loadtable(J, rBASE, R(GETARG_A(i)), &m);
+  if (ic) {
+    probe(J, rawtsvalue(J->f->k + INDEXK(GETARG_B(i))), ic, &m);
+    storecheck(J, &m);
+    copytv(J, RCX, NVAL, vb, vd);
+  }
+  else {
+    int old;
+    rkop(J, GETARG_B(i), &kb, &kd);
+    slot(J, kb, kd, &m);
+    cmpi(J, RCX, TOFF, GAFQ_TNIL);  /* new entries need no metatable */
+    old = jcc(J, CC_NE);
+    mem(J, 0, 1, 0x83, 7, RAX, cast_int(offsetof(Table, metatable)));
+    b1(J, 0);
+    miss(&m, jcc(J, CC_NE));
+    here(J, old);
+    storecheck(J, &m);
+    copytv(J, RCX, 0, vb, vd);
+  }
+  fallback(J, &m, h_settable, ic);
+}
+
+
+static int *kstrcache (JitState *J, int x) {
+  if (ISK(x) && ttisstring(J->f->k + INDEXK(x)))
+    return J->f->icache + J->pc;
+  return NULL;
+}
+
+
+/*
+** ADD, SUB, MUL and DIV: both operands in the integer subtype (`iop' is
+** the x86 add or sub, with the same range check as `fitslint'), both
+** floats, or the helper
+*/
+static void arith (JitState *J, Instruction i, int sseop, int iop) {
+  int ad = R(GETARG_A(i));
+  int bb, bd, cb, cd;
+  int s1, s2, ovf = -1, ni1 = -1, ni2 = -1, done1 = -1, done2;
+  rkop(J, GETARG_B(i), &bb, &bd);
+  rkop(J, GETARG_C(i), &cb, &cd);
+  if (iop) {
+    cmpi(J, bb, bd + TOFF, GAFQ_TNUMINT);
+    ni1 = jcc(J, CC_NE);
+    cmpi(J, cb, cd + TOFF, GAFQ_TNUMINT);
+    ni2 = jcc(J, CC_NE);
+    mem(J, 0, 1, 0x8B, RAX, bb, bd + VOFF);
+    mem(J, 0, 1, iop, RAX, cb, cd + VOFF);
+    movi64(J, RCX, cast(lu_int, GAFQI_MAXINT));
+    rr(J, 1, 0x89, RAX, RDX);  /* rdx = rax + MAXINT */
+    rr(J, 1, 0x01, RCX, RDX);
+    rr(J, 1, 0x01, RCX, RCX);  /* rcx = 2*MAXINT */
+    rr(J, 1, 0x39, RCX, RDX);
+    ovf = jcc(J, CC_A);
+    mem(J, 0, 1, 0x89, RAX, rBASE, ad + VOFF);
+    movmi(J, rBASE, ad + TOFF, GAFQ_TNUMINT);
+    done1 = jcc(J, CC_JMP);
+    here(J, ni1);
+    here(J, ni2);
+  }
+  cmpi(J, bb, bd + TOFF, GAFQ_TNUMBER);
+  s1 = jcc(J, CC_NE);
+  cmpi(J, cb, cd + TOFF, GAFQ_TNUMBER);
+  s2 = jcc(J, CC_NE);
+  mem(J, 0xF2, 0, 0x0F10, 0, bb, bd + VOFF);  /* movsd xmm0, [rb] */
+  mem(J, 0xF2, 0, 0x0F00 | sseop, 0, cb, cd + VOFF);
+  mem(J, 0xF2, 0, 0x0F11, 0, rBASE, ad + VOFF);
+  movmi(J, rBASE, ad + TOFF, GAFQ_TNUMBER);
+  done2 = jcc(J, CC_JMP);
+  here(J, s1);
+  here(J, s2);
+  here(J, ovf);
+  helper(J, h_arith, NULL);
+  here(J, done1);
+  here(J, done2);
+}
+
+
+/* jump (to be patched) unless `reg' fits in 32 bits (see `intmod') */
+static int notint32 (JitState *J, int reg) {
+  rr(J, 1, 0x63, RDX, reg);  /* movsxd rdx, reg */
+  rr(J, 1, 0x39, reg, RDX);
+  return jcc(J, CC_NE);
+}
+
+
+/*
+** MOD of two integers of 32 bits (as `intmod_'); a zero divisor and
+** everything else go to the helper
+*/
+static void modulo (JitState *J, Instruction i) {
+  int ad = R(GETARG_A(i));
+  int bb, bd, cb, cd;
+  int s1, s2, s3, s4, s5, pos, done;
+  rkop(J, GETARG_B(i), &bb, &bd);
+  rkop(J, GETARG_C(i), &cb, &cd);
+  cmpi(J, bb, bd + TOFF, GAFQ_TNUMINT);
+  s1 = jcc(J, CC_NE);
+  cmpi(J, cb, cd + TOFF, GAFQ_TNUMINT);
+  s2 = jcc(J, CC_NE);
+  mem(J, 0, 1, 0x8B, RAX, bb, bd + VOFF);
+  mem(J, 0, 1, 0x8B, RCX, cb, cd + VOFF);
+  s4 = notint32(J, RAX);
+  s5 = notint32(J, RCX);
+  rr(J, 1, 0x85, RCX, RCX);
+  s3 = jcc(J, CC_E);
+  b1(J, 0x48); b1(J, 0x99);  /* cqo */
+  rr(J, 1, 0xF7, 7, RCX);  /* idiv rcx */
+  rr(J, 1, 0x85, RDX, RDX);
+  pos = jcc(J, CC_E);
+  rr(J, 1, 0x89, RDX, RAX);
+  rr(J, 1, 0x31, RCX, RAX);  /* result must have the sign of the divisor */
+  b1(J, 0x79); b1(J, 3);  /* jns over the add */
+  rr(J, 1, 0x01, RCX, RDX);
+  here(J, pos);
+  mem(J, 0, 1, 0x89, RDX, rBASE, ad + VOFF);
+  movmi(J, rBASE, ad + TOFF, GAFQ_TNUMINT);
+  done = jcc(J, CC_JMP);
+  here(J, s1);
+  here(J, s2);
+  here(J, s3);
+  here(J, s4);
+  here(J, s5);
+  helper(J, h_arith, NULL);
+  here(J, done);
+}
+
+
+/*
+** EQ, LT and LE compare integers inline (`cc' is the condition for a true
+** result); the jump is the next instruction
+*/
+static void compare (JitState *J, Instruction i, Helper h, int cc) {
+  int target = J->pc + 2 + GETARG_sBx(J->f->code[J->pc + 1]);
+  int bb, bd, cb, cd;
+  int s1, s2, take;
+  rkop(J, GETARG_B(i), &bb, &bd);
+  rkop(J, GETARG_C(i), &cb, &cd);
+  cmpi(J, bb, bd + TOFF, GAFQ_TNUMINT);
+  s1 = jcc(J, CC_NE);
+  cmpi(J, cb, cd + TOFF, GAFQ_TNUMINT);
+  s2 = jcc(J, CC_NE);
+  mem(J, 0, 1, 0x8B, RAX, bb, bd + VOFF);
+  mem(J, 0, 1, 0x3B, RAX, cb, cd + VOFF);  /* cmp rax, [rc] */
+  take = jcc(J, GETARG_A(i) ? cc : cc ^ 1);
+  tolabel(J, CC_JMP, J->pc + 2);
+  here(J, s1);
+  here(J, s2);
+  callhelper(J, h, NULL);
+  b1(J, 0x85); b1(J, 0xC0);  /* test eax, eax */
+  tolabel(J, CC_E, J->pc + 2);
+  here(J, take);
+  jumpto(J, target);
+}
+
+
+/* TEST and TESTSET (with `rb' >= 0) */
+static void test (JitState *J, Instruction i, int rb) {
+  int target = J->pc + 2 + GETARG_sBx(J->f->code[J->pc + 1]);
+  int f1, f2;
+  testfalse(J, rBASE, R(rb < 0 ? GETARG_A(i) : rb), &f1, &f2);
+  if (!GETARG_C(i)) {  /* jump if false */
+    tolabel(J, CC_JMP, J->pc + 2);
+    here(J, f1);
+    here(J, f2);
+  }
+  if (rb >= 0) copytv(J, rBASE, R(GETARG_A(i)), rBASE, R(rb));
+  jumpto(J, target);
+  if (GETARG_C(i)) {
+    here(J, f1);
+    here(J, f2);
+    tolabel(J, CC_JMP, J->pc + 2);
+  }
+}
+
+
+/*
+** the back edge of a numeric `for' loop jumps through the `target' of its
+** JitLoop, which first counts iterations towards a trace
+*/
+static void backedge (JitState *J, int target) {
+  JitLoop *lp = J->buf ? J->jc->loops + J->nloop : NULL;
+  int *count = J->f->icache + J->pc;  /* free for FORLOOP */
+  int skip;
+  J->nloop++;
+  testhooks(J);
+  skip = jcc(J, CC_E);
+  exitto(J, target);
+  here(J, skip);
+  movi64(J, RAX, lp ? ptr(&lp->target) : 0);
+  b1(J, 0xFF); b1(J, 0x20);  /* jmp [rax] */
+  if (lp) {
+    lp->target = J->buf + J->n;
+    lp->trace = NULL;
+    lp->size = 0;
+    lp->pc = J->pc;
+  }
+  movi64(J, RAX, ptr(count));
+  mem(J, 0, 0, 0xFF, 0, RAX, 0);  /* inc dword [rax] */
+  mem(J, 0, 0, 0x81, 7, RAX, 0);
+  b4(J, GAFQI_TRACELOOPS);
+  tolabel(J, CC_B, target);
+  callhelper(J, h_trace, count);
+  b1(J, 0xFF); b1(J, 0xE0);  /* jmp rax */
+}
+
+
+static void forloop (JitState *J, Instruction i) {
+  int target = J->pc + 1 + GETARG_sBx(i);
+  int ra = R(GETARG_A(i));
+  int slow, neg, cont, cont2;
+  cmpi(J, rBASE, ra + TOFF, GAFQ_TNUMINT);
+  slow = jcc(J, CC_NE);
+  mem(J, 0, 1, 0x8B, RAX, rBASE, ra + VOFF);
+  mem(J, 0, 1, 0x8B, RCX, rBASE, R(2) + ra + VOFF);  /* step */
+  mem(J, 0, 1, 0x8B, RDX, rBASE, R(1) + ra + VOFF);  /* limit */
+  rr(J, 1, 0x01, RCX, RAX);
+  rr(J, 1, 0x85, RCX, RCX);
+  neg = jcc(J, CC_LE);
+  rr(J, 1, 0x39, RDX, RAX);  /* cmp idx, limit */
+  tolabel(J, CC_G, J->pc + 1);
+  cont = jcc(J, CC_JMP);
+  here(J, neg);
+  rr(J, 1, 0x39, RDX, RAX);
+  tolabel(J, CC_L, J->pc + 1);
+  here(J, cont);
+  mem(J, 0, 1, 0x89, RAX, rBASE, ra + VOFF);
+  mem(J, 0, 1, 0x89, RAX, rBASE, R(3) + ra + VOFF);
+  movmi(J, rBASE, R(3) + ra + TOFF, GAFQ_TNUMINT);
+  cont2 = jcc(J, CC_JMP);
+  here(J, slow);
+  callhelper(J, h_forloop, NULL);
+  b1(J, 0x85); b1(J, 0xC0);  /* test eax, eax */
+  tolabel(J, CC_E, J->pc + 1);
+  here(J, cont2);
+  backedge(J, target);
+}
+
+
+/* compile one instruction; returns the number of code words it takes */
+static int compileop (JitState *J) {
+  Instruction i = BASEINSTR(J->f->code[J->pc]);
+  int pc = J->pc;
+  int a = GETARG_A(i);
+  switch (GET_OPCODE(i)) {
+    case OP_MOVE: {
+      copytv(J, rBASE, R(a), rBASE, R(GETARG_B(i)));
+      break;
+    }
+    case OP_LOADK: {
+      copytv(J, rBASE, R(a), rK, R(GETARG_Bx(i)));
+      break;
+    }
+    case OP_LOADBOOL: {
+      movmi(J, rBASE, R(a) + VOFF, GETARG_B(i));
+      movmi(J, rBASE, R(a) + TOFF, GAFQ_TBOOLEAN);
+      if (GETARG_C(i)) tolabel(J, CC_JMP, pc + 2);
+      break;
+    }
+    case OP_LOADNIL: {
+      int r;
+      for (r = a; r <= GETARG_B(i); r++)
+        movmi(J, rBASE, R(r) + TOFF, GAFQ_TNIL);
+      break;
+    }
+    case OP_GETUPVAL: {
+      mem(J, 0, 1, 0x8B, RAX, rCL, cast_int(offsetof(LClosure, upvals)) +
+                                    GETARG_B(i) * cast_int(sizeof(UpVal *)));
+      mem(J, 0, 1, 0x8B, RAX, RAX, cast_int(offsetof(UpVal, v)));
+      copytv(J, rBASE, R(a), RAX, 0);
+      break;
+    }
+    case OP_GETGLOBAL: {
+      Miss m;
+      m.n = 0;
+      loadenv(J);
+      probe(J, rawtsvalue(J->f->k + GETARG_Bx(i)), J->f->icache + pc, &m);
+      copytv(J, rBASE, R(a), RCX, NVAL);
+      fallback(J, &m, h_getglobal, J->f->icache + pc);
+      break;
+    }
+    case OP_SETGLOBAL: {
+      Miss m;
+      m.n = 0;
+      loadenv(J);
+      probe(J, rawtsvalue(J->f->k + GETARG_Bx(i)), J->f->icache + pc, &m);
+      storecheck(J, &m);
+      copytv(J, RCX, NVAL, rBASE, R(a));
+      fallback(J, &m, h_setglobal, J->f->icache + pc);
+      break;
+    }
+    case OP_GETTABLE: gettable(J, i, h_gettable); break;
+    case OP_SETTABLE: settable(J, i); break;
+    case OP_APPEND: helper(J, h_append, NULL); break;
+    case OP_SELF: {
+      copytv(J, rBASE, R(a + 1), rBASE, R(GETARG_B(i)));
+      gettable(J, i, h_self);
+      break;
+    }
+    case OP_SETUPVAL: {
+      Miss m;
+      m.n = 0;
+      mem(J, 0, 1, 0x8B, RAX, rCL, cast_int(offsetof(LClosure, upvals)) +
+                                    GETARG_B(i) * cast_int(sizeof(UpVal *)));
+      mem(J, 0, 0, 0xF6, 0, RAX, cast_int(offsetof(UpVal, marked)));
+      b1(J, bitmask(BLACKBIT));  /* see `gafqC_barrier' */
+      miss(&m, jcc(J, CC_NE));
+      mem(J, 0, 1, 0x8B, RCX, RAX, cast_int(offsetof(UpVal, v)));
+      copytv(J, RCX, 0, rBASE, R(a));
+      fallback(J, &m, h_setupval, NULL);
+      break;
+    }
+    case OP_NEWTABLE: helper(J, h_newtable, NULL); break;
+    case OP_ADD: arith(J, i, 0x58, 0x03); break;
+    case OP_SUB: arith(J, i, 0x5C, 0x2B); break;
+    case OP_MUL: arith(J, i, 0x59, 0); break;
+    case OP_DIV: arith(J, i, 0x5E, 0); break;
+    case OP_MOD: modulo(J, i); break;
+    case OP_POW: case OP_UNM: helper(J, h_arith, NULL); break;
+    case OP_NOT: helper(J, h_not, NULL); break;
+    case OP_LEN: helper(J, h_len, NULL); break;
+    case OP_CONCAT: helper(J, h_concat, NULL); break;
+    case OP_JMP: jumpto(J, pc + 1 + GETARG_sBx(i)); break;
+    case OP_EQ: compare(J, i, h_eq, CC_E); break;
+    case OP_LT: compare(J, i, h_lt, CC_L); break;
+    case OP_LE: compare(J, i, h_le, CC_LE); break;
+    case OP_TEST: test(J, i, -1); break;
+    case OP_TESTSET: test(J, i, GETARG_B(i)); break;
+    case OP_CALL: case OP_INTRINSIC: {
+      int c;
+      if (GET_OPCODE(i) == OP_CALL) callhelper(J, h_call, NULL);
+      else callhelper(J, h_intrinsic, NULL);
+      rr(J, 1, 0x85, RAX, RAX);
+      c = jcc(J, CC_E);
+      b1(J, 0x49); b1(J, 0xFF); b1(J, 0xC7);  /* inc r15 */
+      jccto(J, CC_JMP, J->enter);  /* into the called function */
+      here(J, c);
+      rr(J, 0, 0x85, RDX, RDX);
+      jccto(J, CC_NE, J->exitrdx);  /* Gafq call left to the interpreter */
+      checkhooks(J, pc + 1);
+      break;
+    }
+    case OP_TAILCALL: {
+      exitto(J, pc);  /* the interpreter moves the frame down */
+      break;
+    }
+    case OP_RETURN: {
+      callhelper(J, h_return, NULL);
+      b1(J, 0x49); b1(J, 0xFF); b1(J, 0xCF);  /* dec r15 */
+      jump(J);  /* back into the caller, or leave */
+      break;
+    }
+    case OP_FORLOOP: forloop(J, i); break;
+    case OP_FORPREP: {
+      callhelper(J, h_forprep, NULL);
+      jumpto(J, pc + 1 + GETARG_sBx(i));
+      break;
+    }
+    case OP_TFORLOOP: {
+      callhelper(J, h_tforloop, NULL);
+      b1(J, 0x85); b1(J, 0xC0);  /* test eax, eax */
+      tolabel(J, CC_E, pc + 2);
+      jumpto(J, pc + 2 + GETARG_sBx(J->f->code[pc + 1]));
+      break;
+    }
+    case OP_SETLIST: {
+      int n = (GETARG_C(i) == 0) ? 2 : 1;  /* C == 0: next word is the block */
+      callhelper(J, h_setlist, NULL);
+      checkhooks(J, pc + n);
+      return n;
+    }
+    case OP_CLOSE: helper(J, h_close, NULL); break;
+    case OP_CLOSURE: {
+      int nup = J->f->p[GETARG_Bx(i)]->nups;
+      callhelper(J, h_closure, NULL);
+      checkhooks(J, pc + 1 + nup);
+      return 1 + nup;  /* skip the upvalue pseudo-instructions */
+    }
+    case OP_VARARG: helper(J, h_vararg, NULL); break;
+    case OP_SWITCH: {
+      int j;
+      callhelper(J, h_switch, NULL);
+      for (j = 1; j <= GETARG_C(i); j++) {
+        b1(J, 0x3D); b4(J, j);  /* cmp eax, j */
+        tolabel(J, CC_E, pc + 1 + j);  /* to the jump of that case */
+      }
+      break;  /* none: on to the default jump */
+    }
+    default: gafq_assert(0);  /* quickened opcodes are undone above */
+  }
+  return 1;
+}
+
+
+/* code common to all functions */
+static void prologue (JitState *J) {
+  b1(J, 0x53);  /* push rbx */
+  b1(J, 0x41); b1(J, 0x54);  /* push r12 */
+  b1(J, 0x41); b1(J, 0x55);  /* push r13 */
+  b1(J, 0x41); b1(J, 0x56);  /* push r14 */
+  b1(J, 0x41); b1(J, 0x57);  /* push r15 */
+  rr(J, 1, 0x89, RDI, rL);
+  rr(J, 1, 0x89, RDX, rN);
+  rr(J, 1, 0x89, RSI, RAX);
+  J->enter = J->n;  /* enter the frame of `L->ci' at rax */
+  loadbase(J);
+  mem(J, 0, 1, 0x8B, RCX, rL, LOFF(ci));
+  mem(J, 0, 1, 0x8B, RCX, RCX, cast_int(offsetof(CallInfo, func)));
+  mem(J, 0, 1, 0x8B, rCL, RCX, VOFF);
+  mem(J, 0, 1, 0x8B, rK, rCL, cast_int(offsetof(LClosure, p)));
+  mem(J, 0, 1, 0x8B, rK, rK, cast_int(offsetof(Proto, k)));
+  b1(J, 0xFF); b1(J, 0xE0);  /* jmp rax */
+  J->leave = J->n;
+  rr(J, 1, 0x89, rN, RDX);
+  b1(J, 0x41); b1(J, 0x5F);  /* pop r15 */
+  b1(J, 0x41); b1(J, 0x5E);  /* pop r14 */
+  b1(J, 0x41); b1(J, 0x5D);  /* pop r13 */
+  b1(J, 0x41); b1(J, 0x5C);  /* pop r12 */
+  b1(J, 0x5B);  /* pop rbx */
+  b1(J, 0xC3);  /* ret */
+  J->exitkeep = J->n;
+  movi32(J, RAX, JIT_EXIT);
+  jccto(J, CC_JMP, J->leave);
+  J->exitrdx = J->n;
+  rr(J, 0, 0x89, RDX, RAX);
+  jccto(J, CC_JMP, J->leave);
+}
+
+
+static void compileall (JitState *J) {
+  Proto *f = J->f;
+  int pc = 0;
+  J->n = 0;
+  J->nloop = 0;
+  prologue(J);
+  while (pc < f->sizecode) {
+    int n;
+    gafq_assert(J->buf == NULL || J->jc->map[pc] == J->n);
+    J->jc->map[pc] = J->n;
+    J->pc = pc;
+    n = compileop(J);
+    while (--n > 0)  /* words that are not instructions */
+      J->jc->map[++pc] = J->n;
+    pc++;
+  }
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Loop traces
+** =======================================================
+*/
+
+/*
+** Once a numeric `for' loop of compiled code has run GAFQI_TRACELOOPS
+** times, `trace' records one iteration of its body: it runs the
+** instructions on a copy of the registers, follows the branches they
+** take and notes the type of each value on the way. When that path gets
+** back to the FORLOOP with the types it started with, it becomes a
+** trace: straight-line code specialized to those types, with guards on
+** what could change the next time (loaded values, integer overflow, the
+** direction of each branch). A failed guard leaves for the compiled
+** function at that instruction; a failed check on entry drops the trace.
+** Traces keep to arithmetic, moves, compares and the array part of
+** tables: nothing in them can call out, raise an error or collect.
+*/
+
+#define MAXTRACE	64	/* longest trace, in instructions */
+#define MAXEXIT		(4*MAXTRACE)
+
+typedef struct Trace {
+  JitState J;
+  JitLoop *lp;
+  int body;  /* first instruction of the loop */
+  int n;  /* instructions recorded */
+  int pc[MAXTRACE];
+  lu_byte tb[MAXTRACE], tc[MAXTRACE];  /* types of operands B and C */
+  lu_byte res[MAXTRACE];  /* type of the result, or whether it jumped */
+  lu_byte entry[MAXSTACK];  /* types when the trace starts */
+  lu_byte guard[MAXSTACK];  /* registers read before written */
+  int nexit;
+  int exitpos[MAXEXIT];  /* jumps to side exits... */
+  int exitpc[MAXEXIT];  /* ...and where they continue */
+} Trace;
+
+
+#define isnum(o)	(ttisint(o) || ttisflt(o))
+
+
+/* operand `x' of the recorded instruction */
+static TValue *rkrec (Trace *T, TValue *r, lu_byte *def, int x) {
+  if (ISK(x)) return T->J.f->k + INDEXK(x);
+  if (!def[x]) T->guard[x] = 1;
+  return r + x;
+}
+
+
+/* record the arithmetic instruction `i' (see `gafqV_arith') */
+static int recarith (gafq_State *L, Trace *T, TValue *r, lu_byte *def,
+                     Instruction i) {
+  OpCode op = GET_OPCODE(i);
+  TValue *rb = rkrec(T, r, def, GETARG_B(i));
+  TValue *rc = (op == OP_UNM) ? rb : rkrec(T, r, def, GETARG_C(i));
+  TValue res;
+  int k = T->n;
+  if (!isnum(rb) || !isnum(rc) || op == OP_POW)
+    return 0;
+  gafqV_arith(L, &res, rb, rc, cast(TMS, TM_ADD + (op - OP_ADD)));
+  T->tb[k] = cast_byte(rttype(rb));
+  T->tc[k] = cast_byte(rttype(rc));
+  T->res[k] = cast_byte(rttype(&res));
+  if (ttisint(rb) && ttisint(rc)) {  /* integer unless DIV */
+    if (ttisint(&res) != (op != OP_DIV))
+      return 0;
+  }
+  else if (op == OP_MOD || (op == OP_UNM && !ttisflt(rb)))
+    return 0;
+  setobj(L, r + GETARG_A(i), &res);
+  return 1;
+}
+
+
+/* the array slot for a table operand and key, if any */
+static const TValue *recslot (TValue *t, TValue *key) {
+  Table *h;
+  l_int n;
+  if (!ttistable(t) || !ttisint(key))
+    return NULL;
+  h = hvalue(t);
+  n = ivalue(key);
+  if (ispacked(h)) return NULL;
+  return (1 <= n && n <= h->sizearray) ? &h->array[n - 1] : NULL;
+}
+
+
+/*
+** run one iteration of the loop from `T->body' over `r', filling the
+** trace; returns 0 if it cannot be a trace
+*/
+static int record (gafq_State *L, Trace *T, TValue *r) {
+  Proto *f = T->J.f;
+  int last = T->lp->pc;
+  int pc = T->body;
+  lu_byte def[MAXSTACK];
+  memset(def, 0, sizeof(def));
+  memset(T->guard, 0, sizeof(T->guard));
+  for (T->n = 0; T->n < MAXTRACE; T->n++) {
+    Instruction i = BASEINSTR(f->code[pc]);
+    int a = GETARG_A(i);
+    int k = T->n;
+    int next = pc + 1;
+    T->pc[k] = pc;
+    switch (GET_OPCODE(i)) {
+      case OP_MOVE: {
+        setobj(L, r + a, rkrec(T, r, def, GETARG_B(i)));
+        break;
+      }
+      case OP_LOADK: {
+        setobj(L, r + a, f->k + GETARG_Bx(i));
+        break;
+      }
+      case OP_LOADBOOL: {
+        setbvalue(r + a, GETARG_B(i));
+        if (GETARG_C(i)) next++;
+        break;
+      }
+      case OP_LOADNIL: {
+        int b = GETARG_B(i);
+        for (; a < b; a++) { setnilvalue(r + a); def[a] = 1; }
+        setnilvalue(r + a);
+        break;
+      }
+      case OP_GETUPVAL: {
+        setobj(L, r + a, curr_func(L)->l.upvals[GETARG_B(i)]->v);
+        T->res[k] = cast_byte(rttype(r + a));
+        break;
+      }
+      case OP_GETTABLE: {
+        const TValue *v = recslot(rkrec(T, r, def, GETARG_B(i)),
+                                  rkrec(T, r, def, GETARG_C(i)));
+        if (v == NULL || ttisnil(v))
+          return 0;
+        setobj(L, r + a, v);
+        T->res[k] = cast_byte(rttype(v));
+        break;
+      }
+      case OP_SETTABLE: {  /* only checked: the store happens later */
+        TValue *t = rkrec(T, r, def, a);
+        rkrec(T, r, def, GETARG_C(i));
+        if (recslot(t, rkrec(T, r, def, GETARG_B(i))) == NULL)
+          return 0;
+        a = -1;
+        break;
+      }
+      case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+      case OP_MOD: case OP_POW: case OP_UNM: {
+        if (!recarith(L, T, r, def, i))
+          return 0;
+        break;
+      }
+      case OP_JMP: {
+        next = pc + 1 + GETARG_sBx(i);
+        a = -1;
+        break;
+      }
+      case OP_EQ: case OP_LT: case OP_LE: {
+        TValue *rb = rkrec(T, r, def, GETARG_B(i));
+        TValue *rc = rkrec(T, r, def, GETARG_C(i));
+        int res;
+        if (!isnum(rb) || !isnum(rc))
+          return 0;
+        switch (GET_OPCODE(i)) {
+          case OP_EQ: res = equalobj(L, rb, rc); break;
+          case OP_LT: res = gafqV_lessthan(L, rb, rc); break;
+          default: res = gafqV_lessequal(L, rb, rc); break;
+        }
+        T->tb[k] = cast_byte(rttype(rb));
+        T->tc[k] = cast_byte(rttype(rc));
+        T->res[k] = cast_byte(res == a);
+        next = T->res[k] ? pc + 2 + GETARG_sBx(f->code[pc + 1]) : pc + 2;
+        a = -1;  /* A is no register here */
+        break;
+      }
+      case OP_TEST: {
+        TValue *ra = rkrec(T, r, def, a);
+        T->tb[k] = cast_byte(rttype(ra));
+        T->res[k] = cast_byte(l_isfalse(ra) != GETARG_C(i));
+        next = T->res[k] ? pc + 2 + GETARG_sBx(f->code[pc + 1]) : pc + 2;
+        a = -1;
+        break;
+      }
+      case OP_FORLOOP: {
+        int x;
+        if (pc != last)
+          return 0;
+        for (x = a; x < a + 3; x++) {  /* see `gafqV_forprep' */
+          rkrec(T, r, def, x);
+          if (!isnum(r + x) || (ttisint(r + a) && !ttisint(r + x)))
+            return 0;
+        }
+        T->tb[k] = cast_byte(rttype(r + a));
+        T->tc[k] = cast_byte(rttype(r + a + 1));
+        T->res[k] = cast_byte(rttype(r + a + 2));
+        r[a + 3].tt = rttype(r + a);
+        T->n++;
+        for (x = 0; x < f->maxstacksize; x++) {  /* same types again? */
+          if (T->guard[x] && rttype(r + x) != T->entry[x])
+            return 0;
+        }
+        return 1;
+      }
+      default: return 0;
+    }
+    if (a >= 0) def[a] = 1;  /* register written */
+    if (next <= pc || next > last)  /* leaves the loop? */
+      return 0;
+    pc = next;
+  }
+  return 0;
+}
+
+
+/* a guard: jump to a side exit that continues at instruction `pc' */
+static void sidexit (Trace *T, int cc, int pc) {
+  gafq_assert(T->nexit < MAXEXIT);
+  T->exitpos[T->nexit] = jcc(&T->J, cc);
+  T->exitpc[T->nexit++] = pc;
+}
+
+
+static void missexit (Trace *T, Miss *m, int pc) {
+  while (m->n > 0) {
+    gafq_assert(T->nexit < MAXEXIT);
+    T->exitpos[T->nexit] = m->pos[--m->n];
+    T->exitpc[T->nexit++] = pc;
+  }
+}
+
+
+/* jump to instruction `pc' of the compiled function */
+static void jumpabs (JitState *J, int pc) {
+  movi64(J, RAX, J->buf ? ptr(J->jc->mcode + J->jc->map[pc]) : 0);
+  b1(J, 0xFF); b1(J, 0xE0);  /* jmp rax */
+}
+
+
+/* SSE instruction between xmm registers */
+static void xx (JitState *J, int pfx, int op, int reg, int rm) {
+  b1(J, pfx); b1(J, 0x0F); b1(J, op);
+  b1(J, 0xC0 | (reg << 3) | rm);
+}
+
+
+/* xmm `x' = the number at [base+disp] with type `t' */
+static void loadnum (JitState *J, int x, int base, int disp, int t) {
+  if (t == GAFQ_TNUMINT)
+    mem(J, 0xF2, 1, 0x0F2A, x, base, disp + VOFF);  /* cvtsi2sd */
+  else
+    mem(J, 0xF2, 0, 0x0F10, x, base, disp + VOFF);  /* movsd */
+}
+
+
+/* exit unless rax is in the integer subtype (see `fitslint') */
+static void intrange (Trace *T, int pc) {
+  JitState *J = &T->J;
+  movi64(J, RCX, cast(lu_int, GAFQI_MAXINT));
+  rr(J, 1, 0x89, RAX, RDX);
+  rr(J, 1, 0x01, RCX, RDX);
+  rr(J, 1, 0x01, RCX, RCX);
+  rr(J, 1, 0x39, RCX, RDX);
+  sidexit(T, CC_A, pc);
+}
+
+
+static void emitarith (Trace *T, int k, Instruction i) {
+  static const int sse[] = {0x58, 0x5C, 0x59, 0x5E};  /* ADD SUB MUL DIV */
+  JitState *J = &T->J;
+  OpCode op = GET_OPCODE(i);
+  int pc = T->pc[k];
+  int ad = R(GETARG_A(i));
+  int bb, bd, cb, cd;
+  rkop(J, GETARG_B(i), &bb, &bd);
+  if (op == OP_UNM) { cb = bb; cd = bd; }
+  else rkop(J, GETARG_C(i), &cb, &cd);
+  if (T->res[k] == GAFQ_TNUMINT) {
+    mem(J, 0, 1, 0x8B, RAX, bb, bd + VOFF);
+    switch (op) {
+      case OP_ADD: case OP_SUB: {
+        mem(J, 0, 1, op == OP_ADD ? 0x03 : 0x2B, RAX, cb, cd + VOFF);
+        intrange(T, pc);
+        break;
+      }
+      case OP_MUL: {
+        int nz;
+        mem(J, 0, 1, 0x0FAF, RAX, cb, cd + VOFF);  /* imul */
+        sidexit(T, CC_O, pc);
+        intrange(T, pc);
+        rr(J, 1, 0x85, RAX, RAX);
+        nz = jcc(J, CC_NE);
+        mem(J, 0, 1, 0x8B, RDX, bb, bd + VOFF);
+        mem(J, 0, 1, 0x0B, RDX, cb, cd + VOFF);
+        sidexit(T, CC_S, pc);  /* would be -0 */
+        here(J, nz);
+        break;
+      }
+      case OP_MOD: {
+        int pos;
+        mem(J, 0, 1, 0x8B, RCX, cb, cd + VOFF);
+        rr(J, 1, 0x63, RDX, RAX);  /* operands must fit in 32 bits */
+        rr(J, 1, 0x39, RAX, RDX);
+        sidexit(T, CC_NE, pc);
+        rr(J, 1, 0x63, RDX, RCX);
+        rr(J, 1, 0x39, RCX, RDX);
+        sidexit(T, CC_NE, pc);
+        rr(J, 1, 0x85, RCX, RCX);
+        sidexit(T, CC_E, pc);
+        b1(J, 0x48); b1(J, 0x99);  /* cqo */
+        rr(J, 1, 0xF7, 7, RCX);  /* idiv rcx */
+        rr(J, 1, 0x85, RDX, RDX);
+        pos = jcc(J, CC_E);
+        rr(J, 1, 0x89, RDX, RAX);
+        rr(J, 1, 0x31, RCX, RAX);
+        b1(J, 0x79); b1(J, 3);  /* jns over the add */
+        rr(J, 1, 0x01, RCX, RDX);
+        here(J, pos);
+        rr(J, 1, 0x89, RDX, RAX);
+        break;
+      }
+      default: {
+        gafq_assert(op == OP_UNM);
+        rr(J, 1, 0xF7, 3, RAX);  /* neg rax */
+        sidexit(T, CC_E, pc);  /* would be -0 */
+        break;
+      }
+    }
+    mem(J, 0, 1, 0x89, RAX, rBASE, ad + VOFF);
+    movmi(J, rBASE, ad + TOFF, GAFQ_TNUMINT);
+  }
+  else if (op == OP_UNM) {
+    mem(J, 0, 1, 0x8B, RAX, bb, bd + VOFF);
+    b1(J, 0x48); b1(J, 0x0F); b1(J, 0xBA); b1(J, 0xF8); b1(J, 63);  /* btc */
+    mem(J, 0, 1, 0x89, RAX, rBASE, ad + VOFF);
+    movmi(J, rBASE, ad + TOFF, GAFQ_TNUMBER);
+  }
+  else {
+    int s = sse[op - OP_ADD];
+    loadnum(J, 0, bb, bd, T->tb[k]);
+    if (T->tc[k] == GAFQ_TNUMBER)
+      mem(J, 0xF2, 0, 0x0F00 | s, 0, cb, cd + VOFF);
+    else {
+      loadnum(J, 1, cb, cd, T->tc[k]);
+      xx(J, 0xF2, s, 0, 1);
+    }
+    mem(J, 0xF2, 0, 0x0F11, 0, rBASE, ad + VOFF);
+    movmi(J, rBASE, ad + TOFF, GAFQ_TNUMBER);
+  }
+}
+
+
+/*
+** EQ, LT, LE and TEST: exit when the branch would not go the recorded
+** way (`cond' is the outcome of the compare that makes it jump)
+*/
+static void emitbranch (Trace *T, int k, Instruction i) {
+  JitState *J = &T->J;
+  int pc = T->pc[k];
+  int taken = T->res[k];
+  int other = taken ? pc + 2 : pc + 2 + GETARG_sBx(J->f->code[pc + 1]);
+  int bb, bd, cb, cd, exitif;
+  if (GET_OPCODE(i) == OP_TEST) {
+    if (T->tb[k] == GAFQ_TBOOLEAN) {  /* else the type decides */
+      cmpi(J, rBASE, R(GETARG_A(i)) + VOFF, 0);  /* E: false */
+      exitif = ((GETARG_C(i) != 0) == taken);
+      sidexit(T, exitif ? CC_E : CC_NE, other);
+    }
+    return;
+  }
+  exitif = (GETARG_A(i) != taken);
+  rkop(J, GETARG_B(i), &bb, &bd);
+  rkop(J, GETARG_C(i), &cb, &cd);
+  if (T->tb[k] == GAFQ_TNUMINT && T->tc[k] == GAFQ_TNUMINT) {
+    int cc = (GET_OPCODE(i) == OP_EQ) ? CC_E :
+             (GET_OPCODE(i) == OP_LT) ? CC_L : CC_LE;
+    mem(J, 0, 1, 0x8B, RAX, bb, bd + VOFF);
+    mem(J, 0, 1, 0x3B, RAX, cb, cd + VOFF);
+    sidexit(T, exitif ? cc : cc ^ 1, other);
+    return;
+  }
+  loadnum(J, 0, bb, bd, T->tb[k]);
+  loadnum(J, 1, cb, cd, T->tc[k]);
+  if (GET_OPCODE(i) == OP_EQ) {  /* equal and ordered */
+    xx(J, 0x66, 0x2E, 0, 1);  /* ucomisd xmm0, xmm1 */
+    if (exitif) {
+      int skip = jcc(J, CC_P);
+      sidexit(T, CC_E, other);
+      here(J, skip);
+    }
+    else {
+      sidexit(T, CC_P, other);
+      sidexit(T, CC_NE, other);
+    }
+  }
+  else {  /* c > b or c >= b; unordered is false */
+    int cc = (GET_OPCODE(i) == OP_LT) ? CC_A : CC_AE;
+    xx(J, 0x66, 0x2E, 1, 0);  /* ucomisd xmm1, xmm0 */
+    sidexit(T, exitif ? cc : cc ^ 1, other);
+  }
+}
+
+
+static void emitforloop (Trace *T, int k, Instruction i, int loop) {
+  JitState *J = &T->J;
+  int ra = R(GETARG_A(i));
+  int neg, cont;
+  if (T->tb[k] == GAFQ_TNUMINT) {
+    mem(J, 0, 1, 0x8B, RAX, rBASE, ra + VOFF);
+    mem(J, 0, 1, 0x8B, RCX, rBASE, R(2) + ra + VOFF);  /* step */
+    mem(J, 0, 1, 0x8B, RDX, rBASE, R(1) + ra + VOFF);  /* limit */
+    rr(J, 1, 0x01, RCX, RAX);
+    rr(J, 1, 0x85, RCX, RCX);
+    neg = jcc(J, CC_LE);
+    rr(J, 1, 0x39, RDX, RAX);
+    sidexit(T, CC_G, T->pc[k] + 1);
+    cont = jcc(J, CC_JMP);
+    here(J, neg);
+    rr(J, 1, 0x39, RDX, RAX);
+    sidexit(T, CC_L, T->pc[k] + 1);
+    here(J, cont);
+    mem(J, 0, 1, 0x89, RAX, rBASE, ra + VOFF);
+    mem(J, 0, 1, 0x89, RAX, rBASE, R(3) + ra + VOFF);
+  }
+  else {
+    loadnum(J, 2, rBASE, ra + R(2), T->res[k]);  /* step */
+    loadnum(J, 1, rBASE, ra + R(1), T->tc[k]);  /* limit */
+    mem(J, 0xF2, 0, 0x0F10, 0, rBASE, ra + VOFF);
+    xx(J, 0xF2, 0x58, 0, 2);  /* idx */
+    xx(J, 0x66, 0x57, 3, 3);  /* xorpd xmm3, xmm3 */
+    xx(J, 0x66, 0x2E, 2, 3);
+    neg = jcc(J, CC_BE);  /* not 0 < step */
+    xx(J, 0x66, 0x2E, 1, 0);
+    sidexit(T, CC_B, T->pc[k] + 1);  /* not idx <= limit */
+    cont = jcc(J, CC_JMP);
+    here(J, neg);
+    xx(J, 0x66, 0x2E, 0, 1);
+    sidexit(T, CC_B, T->pc[k] + 1);  /* not limit <= idx */
+    here(J, cont);
+    mem(J, 0xF2, 0, 0x0F11, 0, rBASE, ra + VOFF);
+    mem(J, 0xF2, 0, 0x0F11, 0, rBASE, R(3) + ra + VOFF);
+  }
+  movmi(J, rBASE, R(3) + ra + TOFF, T->tb[k]);
+  testhooks(J);
+  sidexit(T, CC_NE, T->body);
+  jccto(J, CC_JMP, loop);
+}
+
+
+static void emittrace (Trace *T) {
+  JitState *J = &T->J;
+  Proto *f = J->f;
+  int k, x, drop, loop;
+  J->n = 0;
+  T->nexit = 0;
+  drop = J->n;  /* entry checks failed: forget the trace */
+  movi64(J, RAX, ptr(&T->lp->target));
+  movi64(J, RCX, J->buf ? ptr(J->jc->mcode + J->jc->map[T->body]) : 0);
+  mem(J, 0, 1, 0x89, RCX, RAX, 0);
+  b1(J, 0xFF); b1(J, 0xE1);  /* jmp rcx */
+  J->enter = J->n;
+  for (x = 0; x < f->maxstacksize; x++) {
+    if (T->guard[x]) {
+      cmpi(J, rBASE, R(x) + TOFF, T->entry[x]);
+      jccto(J, CC_NE, drop);
+    }
+  }
+  loop = J->n;
+  for (k = 0; k < T->n; k++) {
+    Instruction i = BASEINSTR(f->code[T->pc[k]]);
+    int a = R(GETARG_A(i));
+    int b, d;
+    switch (GET_OPCODE(i)) {
+      case OP_MOVE: {
+        copytv(J, rBASE, a, rBASE, R(GETARG_B(i)));
+        break;
+      }
+      case OP_LOADK: {
+        copytv(J, rBASE, a, rK, R(GETARG_Bx(i)));
+        break;
+      }
+      case OP_LOADBOOL: {
+        movmi(J, rBASE, a + VOFF, GETARG_B(i));
+        movmi(J, rBASE, a + TOFF, GAFQ_TBOOLEAN);
+        break;
+      }
+      case OP_LOADNIL: {
+        for (x = GETARG_A(i); x <= GETARG_B(i); x++)
+          movmi(J, rBASE, R(x) + TOFF, GAFQ_TNIL);
+        break;
+      }
+      case OP_GETUPVAL: {
+        mem(J, 0, 1, 0x8B, RAX, rCL, cast_int(offsetof(LClosure, upvals)) +
+                                      GETARG_B(i) * cast_int(sizeof(UpVal *)));
+        mem(J, 0, 1, 0x8B, RAX, RAX, cast_int(offsetof(UpVal, v)));
+        cmpi(J, RAX, TOFF, T->res[k]);
+        sidexit(T, CC_NE, T->pc[k]);
+        copytv(J, rBASE, a, RAX, 0);
+        break;
+      }
+      case OP_GETTABLE: {
+        Miss m;
+        m.n = 0;
+        mem(J, 0, 1, 0x8B, RAX, rBASE, R(GETARG_B(i)) + VOFF);
+        rkop(J, GETARG_C(i), &b, &d);
+        slot(J, b, d, &m);
+        cmpi(J, RCX, TOFF, T->res[k]);
+        miss(&m, jcc(J, CC_NE));
+        copytv(J, rBASE, a, RCX, 0);
+        missexit(T, &m, T->pc[k]);
+        break;
+      }
+      case OP_SETTABLE: {
+        Miss m;
+        int old, vb, vd;
+        m.n = 0;
+        mem(J, 0, 1, 0x8B, RAX, rBASE, a + VOFF);
+        rkop(J, GETARG_B(i), &b, &d);
+        slot(J, b, d, &m);
+        cmpi(J, RCX, TOFF, GAFQ_TNIL);  /* new entries need no metatable */
+        old = jcc(J, CC_NE);
+        mem(J, 0, 1, 0x83, 7, RAX, cast_int(offsetof(Table, metatable)));
+        b1(J, 0);
+        miss(&m, jcc(J, CC_NE));
+        here(J, old);
+        storecheck(J, &m);
+        rkop(J, GETARG_C(i), &vb, &vd);
+        copytv(J, RCX, 0, vb, vd);
+        missexit(T, &m, T->pc[k]);
+        break;
+      }
+      case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+      case OP_MOD: case OP_UNM: {
+        emitarith(T, k, i);
+        break;
+      }
+      case OP_EQ: case OP_LT: case OP_LE: case OP_TEST: {
+        emitbranch(T, k, i);
+        break;
+      }
+      case OP_FORLOOP: {
+        emitforloop(T, k, i, loop);
+        break;
+      }
+      default: break;  /* JMP */
+    }
+  }
+  for (k = 0; k < T->nexit; k++) {
+    here(J, T->exitpos[k]);
+    jumpabs(J, T->exitpc[k]);
+  }
+}
+
+
+static void trace (gafq_State *L, JitLoop *lp) {
+  Trace T;
+  TValue r[MAXSTACK];
+  Proto *p = curr_func(L)->l.p;
+  void *m;
+  size_t size;
+  int x;
+  for (x = 0; x < p->maxstacksize; x++) {
+    setobj(L, r + x, L->base + x);
+    T.entry[x] = cast_byte(rttype(r + x));
+  }
+  T.J.f = p;
+  T.J.jc = p->jit;
+  T.lp = lp;
+  T.body = lp->pc + 1 + GETARG_sBx(p->code[lp->pc]);
+  if (!record(L, &T, r))
+    return;
+  T.J.buf = NULL;
+  emittrace(&T);  /* measure */
+  size = cast(size_t, T.J.n);
+  m = mmap(NULL, size, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (m == MAP_FAILED)
+    return;
+  T.J.buf = cast(unsigned char *, m);
+  emittrace(&T);
+  if (mprotect(m, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(m, size);
+    return;
+  }
+  lp->trace = T.J.buf;
+  lp->size = size;
+  lp->target = T.J.buf + T.J.enter;
+}
+
+/* }====================================================== */
+
+
+
+static void compile (gafq_State *L, Proto *p) {
+  JitState J;
+  JitCode *jc;
+  void *m;
+  gafq_assert(p->jit == NULL);
+  jc = cast(JitCode *, gafqM_malloc(L, sizejitcode(p->sizecode)));
+  jc->sizemap = p->sizecode;
+  jc->loops = NULL;
+  jc->sizeloops = 0;
+  memset(jc->map, 0, p->sizecode * sizeof(int));
+  J.f = p;
+  J.jc = jc;
+  J.buf = NULL;
+  compileall(&J);  /* measure the code (and find every label) */
+  jc->size = cast(size_t, J.n);
+  jc->loops = gafqM_newvector(L, J.nloop, JitLoop);
+  jc->sizeloops = J.nloop;
+  m = mmap(NULL, jc->size, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (m == MAP_FAILED) {  /* leave the function to the interpreter */
+    gafqM_freearray(L, jc->loops, jc->sizeloops, JitLoop);
+    gafqM_freemem(L, jc, sizejitcode(jc->sizemap));
+    return;
+  }
+  J.buf = jc->mcode = cast(unsigned char *, m);
+  compileall(&J);
+  gafq_assert(cast(size_t, J.n) == jc->size);
+  p->jit = jc;
+  if (mprotect(m, jc->size, PROT_READ | PROT_EXEC) != 0)
+    gafqJ_free(L, p);
+}
+
+
+/*
+** run the frames of a `gafqV_execute' activation in compiled code for as
+** long as possible; compiled code itself follows calls and returns
+** between compiled functions. Returns the new `nexeccalls' when the
+** interpreter must take over the current frame at `L->savedpc', or -1
+** when that activation is over (its last frame returned or a C
+** function yielded).
+*/
+int gafqJ_execute (gafq_State *L, int nexeccalls) {
+  const unsigned char *target = resume(L);
+  JitExit r;
+  Entry e;
+  if (target == NULL)
+    return nexeccalls;
+  e = cast(Entry, cast(size_t, curr_func(L)->l.p->jit->mcode));
+  r = (*e)(L, target, cast(size_t, nexeccalls));
+  switch (r.code) {
+    case JIT_CALL: return cast_int(r.nexeccalls) + 1;
+    case JIT_EXIT: return cast_int(r.nexeccalls);
+    default: return -1;  /* JIT_DONE, JIT_YIELD */
+  }
+}
+
+
+void gafqJ_free (gafq_State *L, Proto *p) {
+  JitCode *jc = p->jit;
+  int i;
+  for (i = 0; i < jc->sizeloops; i++) {
+    if (jc->loops[i].trace)
+      munmap(jc->loops[i].trace, jc->loops[i].size);
+  }
+  gafqM_freearray(L, jc->loops, jc->sizeloops, JitLoop);
+  munmap(jc->mcode, jc->size);
+  gafqM_freemem(L, jc, sizejitcode(jc->sizemap));
+  p->jit = NULL;
+}
+
+#endif
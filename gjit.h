@@ -0,0 +1,17 @@
+/*
+** $Id: gjit.h $
+** Baseline compiler from bytecode to x86-64 machine code
+** See Copyright Notice in gafq.h
+*/
+
+#ifndef gjit_h
+#define gjit_h
+
+
+#include "gobject.h"
+
+
+GAFQI_FUNC int gafqJ_execute (gafq_State *L, int nexeccalls);
+GAFQI_FUNC void gafqJ_free (gafq_State *L, Proto *p);
+
+#endif
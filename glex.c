@@ -107,6 +107,8 @@ TString *gafqX_newstring(LexState *ls, const char *str, size_t l)
         setbvalue(o, 1); /* make sure `str' will not be collected */
         gafqC_checkGC(L);
     }
+    else /* long strings are not interned: keep the one anchored already */
+        ts = rawtsvalue(keyfromval(o));
     return ts;
 }
 
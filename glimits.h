@@ -51,6 +51,11 @@ typedef GAFQI_USER_ALIGNMENT_T L_Umaxalign;
 typedef GAFQI_UACNUMBER l_uacNumber;
 
 
+/* type of the integer subtype of numbers */
+typedef GAFQI_INT l_int;
+typedef unsigned GAFQI_INT lu_int;
+
+
 /* internal assertions for in-house debugging */
 #ifdef gafq_assert
 
@@ -77,6 +82,7 @@ typedef GAFQI_UACNUMBER l_uacNumber;
 
 #define cast_byte(i)	cast(lu_byte, (i))
 #define cast_num(i)	cast(gafq_Number, (i))
+#define cast_lint(i)	cast(l_int, (i))
 #define cast_int(i)	cast(int, (i))
 
 
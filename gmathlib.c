@@ -250,6 +250,11 @@ static const gafqL_Reg mathlib[] = {
 */
 GAFQLIB_API int gafqopen_math (gafq_State *L) {
   gafqL_register(L, GAFQ_MATHLIBNAME, mathlib);
+  gafq_setbuiltin(L, "math.floor", math_floor);  /* see OP_INTRINSIC */
+  gafq_setbuiltin(L, "math.abs", math_abs);
+  gafq_setbuiltin(L, "math.sqrt", math_sqrt);
+  gafq_setbuiltin(L, "math.min", math_min);
+  gafq_setbuiltin(L, "math.max", math_max);
   gafq_pushnumber(L, PI);
   gafq_setfield(L, -2, "pi");
   gafq_pushnumber(L, HUGE_VAL);
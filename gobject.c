@@ -24,7 +24,7 @@
 
 
 
-const TValue gafqO_nilobject_ = {{NULL}, GAFQ_TNIL};
+const TValue gafqO_nilobject_ = {NILCONSTANT};
 
 
 /*
@@ -77,17 +77,38 @@ int gafqO_rawequalObj (const TValue *t1, const TValue *t2) {
     case GAFQ_TNIL:
       return 1;
     case GAFQ_TNUMBER:
+      if (ttisint(t1) && ttisint(t2))
+        return ivalue(t1) == ivalue(t2);
       return gafqi_numeq(nvalue(t1), nvalue(t2));
     case GAFQ_TBOOLEAN:
       return bvalue(t1) == bvalue(t2);  /* boolean true must be 1 !! */
     case GAFQ_TLIGHTUSERDATA:
       return pvalue(t1) == pvalue(t2);
+    case GAFQ_TSTRING:
+      return gafqS_eqstr(rawtsvalue(t1), rawtsvalue(t2));
     default:
       gafq_assert(iscollectable(t1));
       return gcvalue(t1) == gcvalue(t2);
   }
 }
 
+
+/*
+** store number 'n' in 'obj', in the integer subtype when it is integral
+** and in range (-0 must stay a gafq_Number to keep its sign)
+*/
+void gafqO_setnumber (TValue *obj, gafq_Number n) {
+  if (gafqi_numle(cast_num(-GAFQI_MAXINT), n) &&
+      gafqi_numle(n, cast_num(GAFQI_MAXINT))) {
+    l_int i = cast_lint(n);
+    if (gafqi_numeq(cast_num(i), n) && (i != 0 || 1/n > 0)) {
+      setivalue(obj, i);
+      return;
+    }
+  }
+  setnvalue(obj, n);
+}
+
 // 字符串转整数
 int gafqO_str2d (const char *s, gafq_Number *result) {
   char *endptr;
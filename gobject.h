@@ -30,6 +30,15 @@
 #define GAFQ_TDEADKEY	(LAST_TAG+3)
 
 
+/*
+** Integral numbers within +-GAFQI_MAXINT may be kept in an integer
+** subtype.  It is a variant bit over GAFQ_TNUMBER that 'ttype' strips,
+** so only the numeric fast paths need to tell both forms apart.
+*/
+#define NUMVARBIT	(1 << 4)
+#define GAFQ_TNUMINT	(GAFQ_TNUMBER | NUMVARBIT)
+
+
 /*
 ** Union of all collectable objects
 */
@@ -53,6 +62,8 @@ typedef struct GCheader {
 
 
 
+#if !defined(GAFQ_NANBOXING)
+
 /*
 ** Union of all Gafq values
 */
@@ -60,6 +71,7 @@ typedef union {
   GCObject *gc;
   void *p;
   gafq_Number n;
+  l_int i;
   int b;
 } Value;
 
@@ -70,35 +82,150 @@ typedef union {
 
 #define TValuefields	Value value; int tt
 
+/* initializer for a nil TValue (or the TValuefields of a key) */
+#define NILCONSTANT	{NULL}, GAFQ_TNIL
+
+#define checktag(o,t)	(rttype(o) == (t))
+#define ttisnumber(o)	(ttype(o) == GAFQ_TNUMBER)
+#define ttisint(o)	checktag(o, GAFQ_TNUMINT)
+#define ttisflt(o)	checktag(o, GAFQ_TNUMBER)
+
+#define rttype(o)	((o)->tt)
+#define ttype(o)	(rttype(o) & ~NUMVARBIT)
+#define rawgcvalue(o)	((o)->value.gc)
+#define rawpvalue(o)	((o)->value.p)
+#define rawivalue(o)	((o)->value.i)
+#define rawfltvalue(o)	((o)->value.n)
+#define rawbvalue(o)	((o)->value.b)
+
+#define setnilvalue(obj) ((obj)->tt=GAFQ_TNIL)
+
+#define setnvalue(obj,x) \
+  { TValue *i_o=(obj); i_o->value.n=(x); i_o->tt=GAFQ_TNUMBER; }
+
+#define setivalue(obj,x) \
+  { TValue *i_o=(obj); i_o->value.i=(x); i_o->tt=GAFQ_TNUMINT; }
+
+#define setpvalue(obj,x) \
+  { TValue *i_o=(obj); i_o->value.p=(x); i_o->tt=GAFQ_TLIGHTUSERDATA; }
+
+#define setbvalue(obj,x) \
+  { TValue *i_o=(obj); i_o->value.b=(x); i_o->tt=GAFQ_TBOOLEAN; }
+
+#define setgcvalue(i_o,x,t) \
+  { i_o->value.gc=cast(GCObject *, (x)); i_o->tt=(t); }
+
+#define setttype(obj, t) (rttype(obj) = (t))
+
+#define copyvalue(o1,o2)	{ (o1)->value = (o2)->value; (o1)->tt = (o2)->tt; }
+
+#else
+
+/*
+** NaN boxing: a value is a single 64-bit word.  Every double except the
+** negative quiet NaNs stands for itself (those are all stored as another
+** negative NaN); the remaining space carries a 4-bit tag in bits 47-50
+** and a 47-bit payload, which is a pointer (user-space addresses must
+** fit), a boolean, or an integer of the integer subtype (tagged as
+** GAFQ_TNUMBER).
+*/
+#if !defined(GAFQ_NUMBER_DOUBLE) || defined(GAFQ_ANSI)
+#error "NaN boxing needs 'double' numbers and 64-bit integers"
+#endif
+
+typedef union {
+  lu_int u;
+  gafq_Number n;
+} Value;
+
+#define TValuefields	Value value
+
+#define NBTAGSHIFT	47
+#define NBPAYLOAD	((cast(lu_int, 1) << NBTAGSHIFT) - 1)
+#define NBFIRST		(cast(lu_int, 0xFFF8) << 48)  /* first boxed word */
+#define NBNAN		(NBFIRST - 1)  /* canonical negative NaN */
+#define nbtag(t)	((cast(lu_int, 0x1FFF0) | (t)) << NBTAGSHIFT)
+#define nbtagof(o)	cast_int(((o)->value.u >> NBTAGSHIFT) & 0xF)
+
+#define NILCONSTANT	{nbtag(GAFQ_TNIL)}
+
+#define checktag(o,t)	(((o)->value.u >> NBTAGSHIFT) == (0x1FFF0 | (t)))
+#define ttisflt(o)	((o)->value.u < NBFIRST)
+#define ttisint(o)	checktag(o, GAFQ_TNUMBER)
+#define ttisnumber(o)	(ttisflt(o) || ttisint(o))
+
+#define rttype(o)	(ttisflt(o) ? GAFQ_TNUMBER : \
+			 ttisint(o) ? GAFQ_TNUMINT : nbtagof(o))
+#define ttype(o)	(ttisflt(o) ? GAFQ_TNUMBER : nbtagof(o))
+#define rawgcvalue(o) \
+	cast(GCObject *, cast(size_t, (o)->value.u & NBPAYLOAD))
+#define rawpvalue(o)	cast(void *, cast(size_t, (o)->value.u & NBPAYLOAD))
+#define rawivalue(o)	(cast(l_int, (o)->value.u << (64-NBTAGSHIFT)) >> \
+			 (64-NBTAGSHIFT))
+#define rawfltvalue(o)	((o)->value.n)
+#define rawbvalue(o)	cast_int((o)->value.u & 1)
+
+#define setnilvalue(obj) ((obj)->value.u=nbtag(GAFQ_TNIL))
+
+#define setnvalue(obj,x) \
+  { TValue *i_o=(obj); i_o->value.n=(x); \
+    if (i_o->value.u >= NBFIRST) i_o->value.u=NBNAN; }
+
+#define setivalue(obj,x) \
+  { TValue *i_o=(obj); \
+    i_o->value.u=nbtag(GAFQ_TNUMBER) | (cast(lu_int, (x)) & NBPAYLOAD); }
+
+#define setpvalue(obj,x) \
+  { TValue *i_o=(obj); \
+    i_o->value.u=nbtag(GAFQ_TLIGHTUSERDATA) | cast(lu_int, cast(size_t, (x))); \
+    gafq_assert(rawpvalue(i_o) == (x)); }
+
+#define setbvalue(obj,x) \
+  { TValue *i_o=(obj); \
+    i_o->value.u=nbtag(GAFQ_TBOOLEAN) | cast(lu_int, (x) != 0); }
+
+#define setgcvalue(i_o,x,t) \
+  { i_o->value.u=nbtag(t) | cast(lu_int, cast(size_t, (x))); \
+    gafq_assert(rawgcvalue(i_o) == cast(GCObject *, (x))); }
+
+#define setttype(obj, t) \
+  ((obj)->value.u = ((obj)->value.u & NBPAYLOAD) | nbtag(t))
+
+#define copyvalue(o1,o2)	((o1)->value = (o2)->value)
+
+#endif
+
+
 typedef struct gafq_TValue {
   TValuefields;
 } TValue;
 
 
 /* Macros to test type */
-#define ttisnil(o)	(ttype(o) == GAFQ_TNIL)
-#define ttisnumber(o)	(ttype(o) == GAFQ_TNUMBER)
-#define ttisstring(o)	(ttype(o) == GAFQ_TSTRING)
-#define ttistable(o)	(ttype(o) == GAFQ_TTABLE)
-#define ttisfunction(o)	(ttype(o) == GAFQ_TFUNCTION)
-#define ttisboolean(o)	(ttype(o) == GAFQ_TBOOLEAN)
-#define ttisuserdata(o)	(ttype(o) == GAFQ_TUSERDATA)
-#define ttisthread(o)	(ttype(o) == GAFQ_TTHREAD)
-#define ttislightuserdata(o)	(ttype(o) == GAFQ_TLIGHTUSERDATA)
+#define ttisnil(o)	checktag(o, GAFQ_TNIL)
+#define ttisstring(o)	checktag(o, GAFQ_TSTRING)
+#define ttistable(o)	checktag(o, GAFQ_TTABLE)
+#define ttisfunction(o)	checktag(o, GAFQ_TFUNCTION)
+#define ttisboolean(o)	checktag(o, GAFQ_TBOOLEAN)
+#define ttisuserdata(o)	checktag(o, GAFQ_TUSERDATA)
+#define ttisthread(o)	checktag(o, GAFQ_TTHREAD)
+#define ttislightuserdata(o)	checktag(o, GAFQ_TLIGHTUSERDATA)
 
 /* Macros to access values */
-#define ttype(o)	((o)->tt)
-#define gcvalue(o)	check_exp(iscollectable(o), (o)->value.gc)
-#define pvalue(o)	check_exp(ttislightuserdata(o), (o)->value.p)
-#define nvalue(o)	check_exp(ttisnumber(o), (o)->value.n)
-#define rawtsvalue(o)	check_exp(ttisstring(o), &(o)->value.gc->ts)
+#define gcvalue(o)	check_exp(iscollectable(o), rawgcvalue(o))
+#define pvalue(o)	check_exp(ttislightuserdata(o), rawpvalue(o))
+#define nvalue(o)	check_exp(ttisnumber(o), \
+			  ttisint(o) ? cast_num(rawivalue(o)) : rawfltvalue(o))
+#define ivalue(o)	check_exp(ttisint(o), rawivalue(o))
+#define fltvalue(o)	check_exp(ttisflt(o), rawfltvalue(o))
+#define rawtsvalue(o)	check_exp(ttisstring(o), &rawgcvalue(o)->ts)
 #define tsvalue(o)	(&rawtsvalue(o)->tsv)
-#define rawuvalue(o)	check_exp(ttisuserdata(o), &(o)->value.gc->u)
+#define rawuvalue(o)	check_exp(ttisuserdata(o), &rawgcvalue(o)->u)
 #define uvalue(o)	(&rawuvalue(o)->uv)
-#define clvalue(o)	check_exp(ttisfunction(o), &(o)->value.gc->cl)
-#define hvalue(o)	check_exp(ttistable(o), &(o)->value.gc->h)
-#define bvalue(o)	check_exp(ttisboolean(o), (o)->value.b)
-#define thvalue(o)	check_exp(ttisthread(o), &(o)->value.gc->th)
+#define clvalue(o)	check_exp(ttisfunction(o), &rawgcvalue(o)->cl)
+#define hvalue(o)	check_exp(ttistable(o), &rawgcvalue(o)->h)
+#define bvalue(o)	check_exp(ttisboolean(o), rawbvalue(o))
+#define thvalue(o)	check_exp(ttisthread(o), &rawgcvalue(o)->th)
 
 #define l_isfalse(o)	(ttisnil(o) || (ttisboolean(o) && bvalue(o) == 0))
 
@@ -106,53 +233,36 @@ typedef struct gafq_TValue {
 ** for internal debug only
 */
 #define checkconsistency(obj) \
-  gafq_assert(!iscollectable(obj) || (ttype(obj) == (obj)->value.gc->gch.tt))
+  gafq_assert(!iscollectable(obj) || (ttype(obj) == rawgcvalue(obj)->gch.tt))
 
 #define checkliveness(g,obj) \
   gafq_assert(!iscollectable(obj) || \
-  ((ttype(obj) == (obj)->value.gc->gch.tt) && !isdead(g, (obj)->value.gc)))
+  ((ttype(obj) == rawgcvalue(obj)->gch.tt) && !isdead(g, rawgcvalue(obj))))
 
 
 /* Macros to set values */
-#define setnilvalue(obj) ((obj)->tt=GAFQ_TNIL)
-
-#define setnvalue(obj,x) \
-  { TValue *i_o=(obj); i_o->value.n=(x); i_o->tt=GAFQ_TNUMBER; }
-
-#define setpvalue(obj,x) \
-  { TValue *i_o=(obj); i_o->value.p=(x); i_o->tt=GAFQ_TLIGHTUSERDATA; }
-
-#define setbvalue(obj,x) \
-  { TValue *i_o=(obj); i_o->value.b=(x); i_o->tt=GAFQ_TBOOLEAN; }
-
 #define setsvalue(L,obj,x) \
-  { TValue *i_o=(obj); \
-    i_o->value.gc=cast(GCObject *, (x)); i_o->tt=GAFQ_TSTRING; \
+  { TValue *i_o=(obj); setgcvalue(i_o, x, GAFQ_TSTRING); \
     checkliveness(G(L),i_o); }
 
 #define setuvalue(L,obj,x) \
-  { TValue *i_o=(obj); \
-    i_o->value.gc=cast(GCObject *, (x)); i_o->tt=GAFQ_TUSERDATA; \
+  { TValue *i_o=(obj); setgcvalue(i_o, x, GAFQ_TUSERDATA); \
     checkliveness(G(L),i_o); }
 
 #define setthvalue(L,obj,x) \
-  { TValue *i_o=(obj); \
-    i_o->value.gc=cast(GCObject *, (x)); i_o->tt=GAFQ_TTHREAD; \
+  { TValue *i_o=(obj); setgcvalue(i_o, x, GAFQ_TTHREAD); \
     checkliveness(G(L),i_o); }
 
 #define setclvalue(L,obj,x) \
-  { TValue *i_o=(obj); \
-    i_o->value.gc=cast(GCObject *, (x)); i_o->tt=GAFQ_TFUNCTION; \
+  { TValue *i_o=(obj); setgcvalue(i_o, x, GAFQ_TFUNCTION); \
     checkliveness(G(L),i_o); }
 
 #define sethvalue(L,obj,x) \
-  { TValue *i_o=(obj); \
-    i_o->value.gc=cast(GCObject *, (x)); i_o->tt=GAFQ_TTABLE; \
+  { TValue *i_o=(obj); setgcvalue(i_o, x, GAFQ_TTABLE); \
     checkliveness(G(L),i_o); }
 
 #define setptvalue(L,obj,x) \
-  { TValue *i_o=(obj); \
-    i_o->value.gc=cast(GCObject *, (x)); i_o->tt=GAFQ_TPROTO; \
+  { TValue *i_o=(obj); setgcvalue(i_o, x, GAFQ_TPROTO); \
     checkliveness(G(L),i_o); }
 
 
@@ -160,7 +270,7 @@ typedef struct gafq_TValue {
 
 #define setobj(L,obj1,obj2) \
   { const TValue *o2=(obj2); TValue *o1=(obj1); \
-    o1->value = o2->value; o1->tt=o2->tt; \
+    copyvalue(o1, o2); \
     checkliveness(G(L),o1); }
 
 
@@ -183,12 +293,17 @@ typedef struct gafq_TValue {
 #define setobj2n	setobj
 #define setsvalue2n	setsvalue
 
-#define setttype(obj, tt) (ttype(obj) = (tt))
 
 
 #define iscollectable(o)	(ttype(o) >= GAFQ_TSTRING)
 
 
+/* can integral value 'i' be kept in the integer subtype? */
+#define fitsint(i)	(-GAFQI_MAXINT <= (i) && (i) <= GAFQI_MAXINT)
+#define fitslint(i)	(cast(lu_int, (i) + GAFQI_MAXINT) <= \
+			   cast(lu_int, 2*GAFQI_MAXINT))
+
+
 
 typedef TValue *StkId;  /* index to stack elements */
 
@@ -200,14 +315,30 @@ typedef union TString {
   L_Umaxalign dummy;  /* ensures maximum alignment for strings */
   struct {
     CommonHeader;
-    lu_byte reserved;
+    lu_byte reserved;  /* reserved-word index, or STRVIEW */
+    lu_byte hashed;  /* whether `hash' is set yet (see gstring.c) */
     unsigned int hash;
     size_t len;
   } tsv;
 } TString;
 
 
-#define getstr(ts)	cast(const char *, (ts) + 1)
+/*
+** A view is a long string whose chars are part of another string,
+** `parent', instead of following its header (see gstring.c)
+*/
+typedef struct StrView {
+  TString ts;
+  TString *parent;
+  const char *s;
+} StrView;
+
+#define STRVIEW		cast_byte(~0)
+#define isview(ts)	((ts)->tsv.reserved == STRVIEW)
+#define viewparent(ts)	(cast(StrView *, (ts))->parent)
+
+#define getstr(ts)	(isview(ts) ? cast(const StrView *, (ts))->s : \
+                                      cast(const char *, (ts) + 1))
 #define svalue(o)       getstr(rawtsvalue(o))
 
 
@@ -232,6 +363,8 @@ typedef struct Proto {
   CommonHeader;
   TValue *k;  /* constants used by the function */
   Instruction *code;
+  int *icache;  /* table slot hints, one per instruction */
+  struct JitCode *jit;  /* native code, once compiled (see 'gjit.c') */
   struct Proto **p;  /* functions defined inside the function */
   int *lineinfo;  /* map from opcodes to source lines */
   struct LocVar *locvars;  /* information about local variables */
@@ -240,11 +373,13 @@ typedef struct Proto {
   int sizeupvalues;
   int sizek;  /* size of `k' */
   int sizecode;
+  int sizeicache;
   int sizelineinfo;
   int sizep;  /* size of `p' */
   int sizelocvars;
   int linedefined;
   int lastlinedefined;
+  int jitcount;  /* calls and loop iterations, towards compilation */
   GCObject *gclist;
   lu_byte nups;  /* number of upvalues */
   lu_byte numparams;
@@ -323,7 +458,9 @@ typedef union Closure {
 typedef union TKey {
   struct {
     TValuefields;
+#if !defined(GAFQ_SWISSTABLE)
     struct Node *next;  /* for chaining */
+#endif
   } nk;
   TValue tvk;
 } TKey;
@@ -339,12 +476,21 @@ typedef struct Table {
   CommonHeader;
   lu_byte flags;  /* 1<<p means tagmethod(p) is not present */ 
   lu_byte lsizenode;  /* log2 of size of `node' array */
+  lu_byte packed;  /* array part is a gafq_Number vector (see gtable.c) */
+  lu_byte oldlsize;  /* log2 of size of `oldnode' array */
   struct Table *metatable;
   TValue *array;  /* array part */
   Node *node;
+  Node *oldnode;  /* node part still being moved to `node' (see gtable.c) */
+#if defined(GAFQ_SWISSTABLE)
+  int growth;  /* keys that can still be added before a rehash */
+#else
   Node *lastfree;  /* any free position is before this position */
+#endif
   GCObject *gclist;
   int sizearray;  /* size of `array' array */
+  int lenhint;  /* last border found, or -1 (see gafqH_getn) */
+  int oldpos;  /* nodes of `oldnode' still to be moved */
 } Table;
 
 
@@ -370,6 +516,7 @@ GAFQI_FUNC int gafqO_log2 (unsigned int x);
 GAFQI_FUNC int gafqO_int2fb (unsigned int x);
 GAFQI_FUNC int gafqO_fb2int (int x);
 GAFQI_FUNC int gafqO_rawequalObj (const TValue *t1, const TValue *t2);
+GAFQI_FUNC void gafqO_setnumber (TValue *obj, gafq_Number n);
 GAFQI_FUNC int gafqO_str2d (const char *s, gafq_Number *result);
 GAFQI_FUNC const char *gafqO_pushvfstring (gafq_State *L, const char *fmt,
                                                        va_list argp);
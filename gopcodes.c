@@ -52,6 +52,26 @@ const char *const gafqP_opnames[NUM_OPCODES+1] = {
   "CLOSE",
   "CLOSURE",
   "VARARG",
+  "SWITCH",
+  "INTRINSIC",
+  "APPEND",
+  "MOVE2",
+  "MOVECALL",
+  "GETTABLE2",
+  "GLOBALGET",
+  "ADDI",
+  "SUBI",
+  "MULI",
+  "ADDF",
+  "SUBF",
+  "MULF",
+  "DIVF",
+  "EQI",
+  "EQS",
+  "LTI",
+  "LEI",
+  "LTF",
+  "LEF",
   NULL
 };
 
@@ -98,5 +118,34 @@ const lu_byte gafqP_opmodes[NUM_OPCODES] = {
  ,opmode(0, 0, OpArgN, OpArgN, iABC)		/* OP_CLOSE */
  ,opmode(0, 1, OpArgU, OpArgN, iABx)		/* OP_CLOSURE */
  ,opmode(0, 1, OpArgU, OpArgN, iABC)		/* OP_VARARG */
+ ,opmode(0, 0, OpArgU, OpArgU, iABC)		/* OP_SWITCH */
+ ,opmode(0, 1, OpArgU, OpArgU, iABC)		/* OP_INTRINSIC */
+ ,opmode(0, 0, OpArgK, OpArgR, iABC)		/* OP_APPEND */
+ ,opmode(0, 1, OpArgR, OpArgN, iABC)		/* OP_MOVE2 */
+ ,opmode(0, 1, OpArgR, OpArgN, iABC)		/* OP_MOVECALL */
+ ,opmode(0, 1, OpArgR, OpArgK, iABC)		/* OP_GETTABLE2 */
+ ,opmode(0, 1, OpArgK, OpArgN, iABx)		/* OP_GLOBALGET */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_ADDI */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_SUBI */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_MULI */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_ADDF */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_SUBF */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_MULF */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_DIVF */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_EQI */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_EQS */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_LTI */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_LEI */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_LTF */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_LEF */
+};
+
+
+const lu_byte gafqP_baseops[NUM_OPCODES - FIRST_SUPER] = {
+  OP_MOVE, OP_MOVE, OP_GETTABLE, OP_GETGLOBAL,	/* OP_MOVE2 ... OP_GLOBALGET */
+  OP_ADD, OP_SUB, OP_MUL,			/* OP_ADDI ... OP_MULI */
+  OP_ADD, OP_SUB, OP_MUL, OP_DIV,		/* OP_ADDF ... OP_DIVF */
+  OP_EQ, OP_EQ,					/* OP_EQI, OP_EQS */
+  OP_LT, OP_LE, OP_LT, OP_LE			/* OP_LTI ... OP_LEF */
 };
 
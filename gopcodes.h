@@ -204,11 +204,41 @@ OP_SETLIST,/*	A B C	R(A)[(C-1)*FPF+i] := R(A+i), 1 <= i <= B	*/
 OP_CLOSE,/*	A 	close all variables in the stack up to (>=) R(A)*/
 OP_CLOSURE,/*	A Bx	R(A) := closure(KPROTO[Bx], R(A), ... ,R(A+n))	*/
 
-OP_VARARG/*	A B	R(A), R(A+1), ..., R(A+B-1) = vararg		*/
+OP_VARARG,/*	A B	R(A), R(A+1), ..., R(A+B-1) = vararg		*/
+
+OP_SWITCH,/*	A B C	pc += Kst(B)[R(A)] (0 if it is not in 1..C)	*/
+
+OP_INTRINSIC,/*	A B C	R(A), ... ,R(A+C-2) := R(A)(R(A+1), ... ,R(A+n))	*/
+
+OP_APPEND,/*	A B C	R(C) := #R(A) + 1; R(A)[R(C)] := RK(B)		*/
+
+/* superinstructions (see gafqK_fuse): run with the instruction that follows */
+OP_MOVE2,/*	A B	OP_MOVE; then the OP_MOVE at pc+1		*/
+OP_MOVECALL,/*	A B	OP_MOVE; then the OP_CALL at pc+1		*/
+OP_GETTABLE2,/*	A B C	OP_GETTABLE; then the OP_GETTABLE at pc+1	*/
+OP_GLOBALGET,/*	A Bx	OP_GETGLOBAL; then the OP_GETTABLE at pc+1	*/
+
+/* quickened variants (see gvm.c); the compiler never emits these */
+OP_ADDI,/*	A B C	OP_ADD over two integers			*/
+OP_SUBI,/*	A B C	OP_SUB over two integers			*/
+OP_MULI,/*	A B C	OP_MUL over two integers			*/
+OP_ADDF,/*	A B C	OP_ADD over two floats				*/
+OP_SUBF,/*	A B C	OP_SUB over two floats				*/
+OP_MULF,/*	A B C	OP_MUL over two floats				*/
+OP_DIVF,/*	A B C	OP_DIV over two floats				*/
+OP_EQI,/*	A B C	OP_EQ over two integers				*/
+OP_EQS,/*	A B C	OP_EQ over two strings				*/
+OP_LTI,/*	A B C	OP_LT over two integers				*/
+OP_LEI,/*	A B C	OP_LE over two integers				*/
+OP_LTF,/*	A B C	OP_LT over two floats				*/
+OP_LEF/*	A B C	OP_LE over two floats				*/
 } OpCode;
 
 
-#define NUM_OPCODES	(cast(int, OP_VARARG) + 1)
+#define NUM_OPCODES	(cast(int, OP_LEF) + 1)
+
+#define FIRST_SUPER	OP_MOVE2
+#define FIRST_QUICK	OP_ADDI
 
 
 
@@ -230,6 +260,26 @@ OP_VARARG/*	A B	R(A), R(A+1), ..., R(A+B-1) = vararg		*/
       (true or false).
 
   (*) All `skips' (pc++) assume that next instruction is a jump
+
+  (*) OP_SWITCH is followed by C+1 jumps: the one taken when R(A) is no
+      key of table Kst(B), then one for each case (see gafqK_switch).
+
+  (*) OP_INTRINSIC is an OP_CALL of builtin B (see Builtin in gstate.h)
+      with n = biargs(B) arguments; the VM does the work itself while
+      R(A) is the function the library registered for B.
+
+  (*) OP_APPEND only uses R(C) when R(A) is no table or has a
+      `__newindex' metamethod; otherwise it appends in O(1) (see
+      gafqH_append).
+
+  (*) Quickened instructions only exist in running code: they behave
+      exactly as the opcode they were made from, which is what dumps and
+      the checker see.
+
+  (*) A superinstruction is its first half (see baseOp) followed by the
+      next instruction, which keeps its own opcode so that jumps may still
+      land on it. Comparisons need none: they already take the OP_JMP that
+      follows them in the same dispatch.
 ===========================================================================*/
 
 
@@ -260,6 +310,21 @@ GAFQI_DATA const lu_byte gafqP_opmodes[NUM_OPCODES];
 
 GAFQI_DATA const char *const gafqP_opnames[NUM_OPCODES+1];  /* opcode names */
 
+GAFQI_DATA const lu_byte gafqP_baseops[NUM_OPCODES - FIRST_SUPER];
+
+/* the opcode a quickened opcode or the first half of a superinstruction
+   stands for */
+#define baseOp(o)	((o) < FIRST_SUPER ? (o) : \
+			 cast(OpCode, gafqP_baseops[(o) - FIRST_SUPER]))
+
+/* the opcode that must follow superinstruction `o' */
+#define pairOp(o)	((o) == OP_MOVE2 ? OP_MOVE : \
+			 (o) == OP_MOVECALL ? OP_CALL : OP_GETTABLE)
+
+/* instruction `i' as its base opcode */
+#define BASEINSTR(i)	(((i) & MASK0(SIZE_OP,POS_OP)) | \
+			 (cast(Instruction, baseOp(GET_OPCODE(i))) << POS_OP))
+
 
 /* number of list items to accumulate before a SETLIST instruction */
 #define LFIELDS_PER_FLUSH	50
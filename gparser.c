@@ -179,7 +179,7 @@ static int indexupvalue(FuncState *fs, TString *name, expdesc *v)
     {
         if (fs->upvalues[i].k == v->k && fs->upvalues[i].info == v->u.s.info)
         {
-            gafq_assert(f->upvalues[i] == name);
+            gafq_assert(gafqS_eqstr(f->upvalues[i], name));
             return i;
         }
     }
@@ -201,7 +201,7 @@ static int searchvar(FuncState *fs, TString *n)
     int i;
     for (i = fs->nactvar - 1; i >= 0; i--)
     {
-        if (n == getlocvar(fs, i).varname)
+        if (gafqS_eqstr(n, getlocvar(fs, i).varname))
             return i;
     }
     return -1; /* not found */
@@ -232,6 +232,8 @@ static int singlevaraux(FuncState *fs, TString *n, expdesc *var, int base)
             init_exp(var, VLOCAL, v);
             if (!base)
                 markupval(fs, v); /* local will be used as an upval */
+            if ((fs->f->is_vararg & VARARG_HASARG) && v == fs->f->numparams)
+                fs->argused = 1;
             return VLOCAL;
         }
         else
@@ -349,6 +351,7 @@ static void open_func(LexState *ls, FuncState *fs)
     fs->np = 0;
     fs->nlocvars = 0;
     fs->nactvar = 0;
+    fs->argused = 0;
     fs->bl = NULL;
     f->source = ls->source;
     f->maxstacksize = 2; /* registers 0/1 are always valid */
@@ -367,8 +370,11 @@ static void close_func(LexState *ls)
     Proto *f = fs->f;
     removevars(ls, 0);
     gafqK_ret(fs, 0, 0); /* final return */
+    gafqK_inline(fs);
     gafqM_reallocvector(L, f->code, f->sizecode, fs->pc, Instruction);
     f->sizecode = fs->pc;
+    gafqK_fuse(f);
+    gafqF_initcache(L, f);
     gafqM_reallocvector(L, f->lineinfo, f->sizelineinfo, fs->pc, int);
     f->sizelineinfo = fs->pc;
     gafqM_reallocvector(L, f->k, f->sizek, fs->nk, TValue);
@@ -613,6 +619,8 @@ static void body(LexState *ls, expdesc *e, int needself, int line)
     parlist(ls);
     checknext(ls, ')');
     chunk(ls);
+    if (!new_fs.argused) /* build `arg' only for functions that use it */
+        new_fs.f->is_vararg &= ~VARARG_NEEDSARG;
     new_fs.f->lastlinedefined = ls->linenumber;
     check_match(ls, TK_END, TK_FUNCTION, line);
     close_func(ls);
@@ -633,7 +641,49 @@ static int explist1(LexState *ls, expdesc *v)
     return n;
 }
 
-static void funcargs(LexState *ls, expdesc *f)
+/* library functions whose calls may be intrinsics (see OP_INTRINSIC) */
+static const struct
+{
+    const char *name;
+    Builtin b;
+} intrinsics[] = {
+    {"floor", BI_FLOOR}, {"abs", BI_ABS}, {"sqrt", BI_SQRT},
+    {"min", BI_MIN}, {"max", BI_MAX}, {"byte", BI_BYTE},
+    {"insert", BI_INSERT}};
+
+/* builtin whose name the function `e' goes by (e.g., `math.floor', `s:byte'
+   or a local `floor'), or -1; the VM checks that it really is that one */
+static int intrinsic(FuncState *fs, expdesc *e)
+{
+    TString *name = NULL;
+    size_t j;
+    switch (e->k)
+    {
+    case VLOCAL:
+        name = getlocvar(fs, e->u.s.info).varname;
+        break;
+    case VUPVAL:
+        name = fs->f->upvalues[e->u.s.info];
+        break;
+    case VGLOBAL:
+    case VK:
+        name = rawtsvalue(&fs->f->k[e->u.s.info]);
+        break;
+    case VINDEXED:
+        if (ISK(e->u.s.aux) && ttisstring(&fs->f->k[INDEXK(e->u.s.aux)]))
+            name = rawtsvalue(&fs->f->k[INDEXK(e->u.s.aux)]);
+        break;
+    default:
+        break;
+    }
+    if (name != NULL)
+        for (j = 0; j < sizeof(intrinsics) / sizeof(intrinsics[0]); j++)
+            if (strcmp(getstr(name), intrinsics[j].name) == 0)
+                return intrinsics[j].b;
+    return -1;
+}
+
+static void funcargs(LexState *ls, expdesc *f, int b)
 {
     FuncState *fs = ls->fs;
     expdesc args;
@@ -683,7 +733,10 @@ static void funcargs(LexState *ls, expdesc *f)
             gafqK_exp2nextreg(fs, &args); /* close last argument */
         nparams = fs->freereg - (base + 1);
     }
-    init_exp(f, VCALL, gafqK_codeABC(fs, OP_CALL, base, nparams + 1, 2));
+    if (b >= 0 && nparams == biargs(b))
+        init_exp(f, VCALL, gafqK_codeABC(fs, OP_INTRINSIC, base, b, 2));
+    else
+        init_exp(f, VCALL, gafqK_codeABC(fs, OP_CALL, base, nparams + 1, 2));
     gafqK_fixline(fs, line);
     fs->freereg = base + 1; /* call remove function and arguments and leaves
                                (unless changed) one result */
@@ -751,15 +804,16 @@ static void primaryexp(LexState *ls, expdesc *v)
             gafqX_next(ls);
             checkname(ls, &key);
             gafqK_self(fs, v, &key);
-            funcargs(ls, v);
+            funcargs(ls, v, intrinsic(fs, &key));
             break;
         }
         case '(':
         case TK_STRING:
         case '{':
         { /* funcargs */
+            int b = intrinsic(fs, v);
             gafqK_exp2nextreg(fs, v);
-            funcargs(ls, v);
+            funcargs(ls, v, b);
             break;
         }
         default:
@@ -1224,12 +1278,22 @@ static void forstat(LexState *ls, int line)
     leaveblock(fs); /* loop scope (`break' jumps to this point) */
 }
 
-static int test_then_block(LexState *ls)
+static int test_then_block(LexState *ls, int *reg, int *ncases, int *deflt)
 {
     /* test_then_block -> [IF | ELSEIF] cond THEN block */
+    FuncState *fs = ls->fs;
     int condexit;
+    int t = fs->pc;
     gafqX_next(ls); /* skip IF or ELSEIF */
     condexit = cond(ls);
+    if (*deflt == NO_JUMP)
+    { /* still a chain of `x == K' tests? */
+        if (condexit == t + 1 && *ncases < MAXARG_C &&
+            gafqK_iscase(fs, condexit, reg))
+            (*ncases)++;
+        else
+            *deflt = t; /* where no case goes */
+    }
     checknext(ls, TK_THEN);
     block(ls); /* `then' part */
     return condexit;
@@ -1241,22 +1305,28 @@ static void ifstat(LexState *ls, int line)
     FuncState *fs = ls->fs;
     int flist;
     int escapelist = NO_JUMP;
-    flist = test_then_block(ls); /* IF cond THEN block */
+    int first = fs->pc;
+    int reg = NO_REG, ncases = 0, deflt = NO_JUMP;
+    flist = test_then_block(ls, &reg, &ncases, &deflt); /* IF cond THEN block */
     while (ls->t.token == TK_ELSEIF)
     {
         gafqK_concat(fs, &escapelist, gafqK_jump(fs));
         gafqK_patchtohere(fs, flist);
-        flist = test_then_block(ls); /* ELSEIF cond THEN block */
+        flist = test_then_block(ls, &reg, &ncases, &deflt); /* ELSEIF cond THEN block */
     }
     if (ls->t.token == TK_ELSE)
     {
         gafqK_concat(fs, &escapelist, gafqK_jump(fs));
         gafqK_patchtohere(fs, flist);
         gafqX_next(ls); /* skip ELSE (after patch, for correct line info) */
-        block(ls);      /* `else' part */
+        if (deflt == NO_JUMP)
+            deflt = fs->pc;
+        block(ls); /* `else' part */
     }
     else
         gafqK_concat(fs, &escapelist, flist);
+    if (ncases >= GAFQI_MINSWITCH) /* dispatch on a table of the cases */
+        gafqK_concat(fs, &escapelist, gafqK_switch(fs, first, ncases, deflt, line));
     gafqK_patchtohere(fs, escapelist);
     check_match(ls, TK_END, TK_IF, line);
 }
@@ -1357,7 +1427,8 @@ static void retstat(LexState *ls)
         if (hasmultret(e.k))
         {
             gafqK_setmultret(fs, &e);
-            if (e.k == VCALL && nret == 1)
+            if (e.k == VCALL && nret == 1 &&
+                GET_OPCODE(getcode(fs, &e)) == OP_CALL)
             { /* tail call? */
                 SET_OPCODE(getcode(fs, &e), OP_TAILCALL);
                 gafq_assert(GETARG_A(getcode(fs, &e)) == fs->nactvar);
@@ -70,6 +70,7 @@ typedef struct FuncState {
   int np;  /* number of elements in `p' */
   short nlocvars;  /* number of elements in `locvars' */
   lu_byte nactvar;  /* number of active local variables */
+  lu_byte argused;  /* is the `arg' parameter ever mentioned? */
   upvaldesc upvalues[GAFQI_MAXUPVALUES];  /* upvalues */
   unsigned short actvar[GAFQI_MAXVARS];  /* declared-variable stack */
 } FuncState;
@@ -6,6 +6,7 @@
 
 
 #include <stddef.h>
+#include <string.h>
 
 #define gstate_c
 #define GAFQ_CORE
@@ -64,6 +65,34 @@ static void freestack (gafq_State *L, gafq_State *L1) {
 }
 
 
+/*
+** a source of randomness for the seed of string hashes, mixed with some
+** addresses (which change from run to run with address-space layout
+** randomization); define it as a constant to get the same hashes, and
+** the same order in table traversals, in every run
+*/
+#if !defined(gafqi_makeseed)
+#include <time.h>
+#define gafqi_makeseed()	cast(unsigned int, time(NULL))
+#endif
+
+#define addbuff(b,p,e) \
+  { size_t t = cast(size_t, e); \
+    memcpy(b + p, &t, sizeof(t)); p += sizeof(t); }
+
+static unsigned int makeseed (gafq_State *L) {
+  char buff[4 * sizeof(size_t)];
+  unsigned int h = gafqi_makeseed();
+  int p = 0;
+  addbuff(buff, p, L);  /* heap variable */
+  addbuff(buff, p, &h);  /* local variable */
+  addbuff(buff, p, gafqO_nilobject);  /* global variable */
+  addbuff(buff, p, &gafq_newstate);  /* public function */
+  gafq_assert(p == sizeof(buff));
+  return gafqS_hash(buff, p, h);
+}
+
+
 /*
 ** open parts that may cause memory-allocation errors
 */
@@ -109,6 +138,7 @@ static void close_state (gafq_State *L) {
   gafq_assert(g->rootgc == obj2gco(L));
   gafq_assert(g->strt.nuse == 0);
   gafqM_freearray(L, G(L)->strt.hash, G(L)->strt.size, TString *);
+  gafqM_freearray(L, G(L)->strt.oldhash, G(L)->strt.oldsize, TString *);
   gafqZ_freebuffer(L, &g->buff);
   freestack(L, L);
   gafq_assert(g->totalbytes == sizeof(LG));
@@ -163,6 +193,9 @@ GAFQ_API gafq_State *gafq_newstate (gafq_Alloc f, void *ud) {
   g->strt.size = 0;
   g->strt.nuse = 0;
   g->strt.hash = NULL;
+  g->strt.oldhash = NULL;
+  g->strt.oldsize = g->strt.oldpos = 0;
+  g->seed = makeseed(L);
   setnilvalue(registry(L));
   gafqZ_initbuffer(L, &g->buff);
   g->panic = NULL;
@@ -179,6 +212,7 @@ GAFQ_API gafq_State *gafq_newstate (gafq_Alloc f, void *ud) {
   g->gcstepmul = GAFQI_GCMUL;
   g->gcdept = 0;
   for (i=0; i<NUM_TAGS; i++) g->mt[i] = NULL;
+  for (i=0; i<BI_N; i++) g->builtin[i] = NULL;
   if (gafqD_rawrunprotected(L, f_gafqopen, NULL) != 0) {
     /* memory allocation error: free partial state */
     close_state(L);
@@ -39,6 +39,9 @@ typedef struct stringtable {
   GCObject **hash;
   lu_int32 nuse;  /* number of elements */
   int size;
+  GCObject **oldhash;  /* buckets before a resize, while they move */
+  int oldsize;
+  int oldpos;  /* buckets of `oldhash' not moved yet */
 } stringtable;
 
 
@@ -62,12 +65,32 @@ typedef struct CallInfo {
 #define isGafq(ci)	(ttisfunction((ci)->func) && f_isGafq(ci))
 
 
+/*
+* library functions the VM runs inline while they are the ones the
+* libraries registered (see `gafq_setbuiltin')
+* WARNING: if you change the order of this enumeration,
+* grep "ORDER BI"
+*/
+typedef enum {
+  BI_SELECT,
+  BI_FLOOR, BI_ABS, BI_SQRT,	/* intrinsics of one argument */
+  BI_MIN, BI_MAX, BI_BYTE, BI_INSERT,	/* intrinsics of two arguments */
+  BI_N		/* number of elements in the enum */
+} Builtin;
+
+#define FIRST_INTRINSIC	BI_FLOOR
+
+/* number of arguments an OP_INTRINSIC of builtin `b' passes */
+#define biargs(b)	((b) < BI_MIN ? 1 : 2)
+
+
 /*
 ** `global state', shared by all threads of this state
 ** 全局状态
 */
 typedef struct global_State {
   stringtable strt;  /* hash table for strings */
+  unsigned int seed;  /* randomized seed for hashes of strings */
   gafq_Alloc frealloc;  /* function to reallocate memory */
   void *ud;         /* auxiliary data to `frealloc' */
   lu_byte currentwhite;
@@ -92,6 +115,7 @@ typedef struct global_State {
   UpVal uvhead;  /* head of double-linked list of all open upvalues */
   struct Table *mt[NUM_TAGS];  /* metatables for basic types */
   TString *tmname[TM_N];  /* array with tag-method names */
+  gafq_CFunction builtin[BI_N];  /* C functions of inlined library functions */
 } global_State;
 
 
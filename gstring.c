@@ -17,6 +17,87 @@
 #include "gstate.h"
 #include "gstring.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+
+/*
+** A string table of GAFQI_INCRREHASH buckets or more is resized a step
+** at a time, as large tables are (see gtable.c): the new vector of
+** buckets takes the place of the old one at once, and each new string
+** moves GAFQI_REHASHSTEP lists of the old one, from the last, until
+** `oldpos' gets to 0. A string whose old bucket has not moved yet is
+** looked for and put in that bucket. So a new bucket is used only once
+** the last old one with strings for it has moved, and it is cleared
+** then rather than with the whole vector. Nothing moves while the
+** collector sweeps strings (see `gafqS_list').
+*/
+
+/* the old bucket whose move starts new bucket `k' */
+#define firstmove(tb,k) \
+	((tb)->size > (tb)->oldsize ? lmod(k, (tb)->oldsize) \
+	                            : (k) + (tb)->oldsize - (tb)->size)
+
+
+static void rehashlist (GCObject *p, GCObject **newhash, int newsize) {
+  while (p) {  /* for each node in the list */
+    GCObject *next = p->gch.next;  /* save next */
+    unsigned int h = gco2ts(p)->hash;
+    int h1 = lmod(h, newsize);  /* new position */
+    gafq_assert(cast_int(h%newsize) == lmod(h, newsize));
+    p->gch.next = newhash[h1];  /* chain it */
+    newhash[h1] = p;
+    p = next;
+  }
+}
+
+
+static void movelists (gafq_State *L, stringtable *tb, int n) {
+  for (; n > 0 && tb->oldpos > 0; n--) {
+    int i = --tb->oldpos;
+    GCObject *p = tb->oldhash[i];
+    int k;
+    tb->oldhash[i] = NULL;
+    if (tb->size > tb->oldsize) {  /* growing? */
+      for (k = i; k < tb->size; k += tb->oldsize)  /* buckets it splits in */
+        tb->hash[k] = NULL;
+    }
+    else if ((k = i - (tb->oldsize - tb->size)) >= 0)
+      tb->hash[k] = NULL;  /* first of the lists that join in bucket `k' */
+    gafq_assert(firstmove(tb, lmod(i, tb->size)) >= i);
+    rehashlist(p, tb->hash, tb->size);
+  }
+  if (tb->oldpos == 0 && tb->oldhash != NULL) {  /* all moved? */
+    gafqM_freearray(L, tb->oldhash, tb->oldsize, TString *);
+    tb->oldhash = NULL;
+    tb->oldsize = 0;
+  }
+}
+
+
+/* list `h' belongs to, with a resize under way or not */
+static GCObject **hashlist (stringtable *tb, unsigned int h) {
+  if (tb->oldpos > 0 && lmod(h, tb->oldsize) < tb->oldpos)  /* not moved? */
+    return &tb->oldhash[lmod(h, tb->oldsize)];
+  return &tb->hash[lmod(h, tb->size)];
+}
+
+
+/*
+** list `i' of the string table, for the collector: the old buckets that
+** have not moved come after the new ones, and new buckets not started
+** yet have no list (NULL)
+*/
+GCObject **gafqS_list (stringtable *tb, int i) {
+  if (i >= tb->size)
+    return &tb->oldhash[i - tb->size];
+  else if (tb->oldpos > 0 && firstmove(tb, i) < tb->oldpos)
+    return NULL;
+  else
+    return &tb->hash[i];
+}
 
 
 void gafqS_resize (gafq_State *L, int newsize) {
@@ -25,32 +106,118 @@ void gafqS_resize (gafq_State *L, int newsize) {
   int i;
   if (G(L)->gcstate == GCSsweepstring)
     return;  /* cannot resize during GC traverse */
-  newhash = gafqM_newvector(L, newsize, GCObject *);
   tb = &G(L)->strt;
-  for (i=0; i<newsize; i++) newhash[i] = NULL;
-  /* rehash */
-  for (i=0; i<tb->size; i++) {
-    GCObject *p = tb->hash[i];
-    while (p) {  /* for each node in the list */
-      GCObject *next = p->gch.next;  /* save next */
-      unsigned int h = gco2ts(p)->hash;
-      int h1 = lmod(h, newsize);  /* new position */
-      gafq_assert(cast_int(h%newsize) == lmod(h, newsize));
-      p->gch.next = newhash[h1];  /* chain it */
-      newhash[h1] = p;
-      p = next;
-    }
+  movelists(L, tb, tb->oldpos);  /* end a previous resize */
+  newhash = gafqM_newvector(L, newsize, GCObject *);
+  if (tb->size < GAFQI_INCRREHASH) {  /* rehash it all now */
+    for (i=0; i<newsize; i++) newhash[i] = NULL;
+    for (i=0; i<tb->size; i++)
+      rehashlist(tb->hash[i], newhash, newsize);
+    gafqM_freearray(L, tb->hash, tb->size, TString *);
+  }
+  else {  /* keep the old lists, to move them with the next strings */
+    tb->oldhash = tb->hash;
+    tb->oldsize = tb->oldpos = tb->size;
   }
-  gafqM_freearray(L, tb->hash, tb->size, TString *);
   tb->size = newsize;
   tb->hash = newhash;
 }
 
 
+/*
+** String hashes take every byte and a seed chosen for each state (see
+** `makeseed' in gstate.c), so that keys cannot be picked to collide.
+** MurmurHash3 (32 bits) hashes short strings; with SSE2, long ones go
+** 32 bytes at a time through four 64-bit lanes (as in XXH3), which are
+** mixed into the hash at the end.
+*/
+
+#define LONGHASH	64  /* strings hashed in lanes from this length */
+
+#define rotl(x,n)	(((x) << (n)) | ((x) >> (32 - (n))))
+
+#define scramble(k)	(rotl((k) * 0xCC9E2D51U, 15) * 0x1B873593U)
+
+/* mix 32-bit word `k' into hash `h' */
+#define mixword(h,k) \
+	{ h ^= scramble(k); h = rotl(h, 13) * 5 + 0xE6546B64U; }
+
+
+static lu_int32 hashbytes (const char *str, size_t l, lu_int32 h) {
+  lu_int32 k;
+  for (; l >= 4; l -= 4, str += 4) {
+    memcpy(&k, str, 4);
+    mixword(h, k);
+  }
+  k = 0;
+  switch (l) {  /* last bytes */
+    case 3: k ^= cast(lu_int32, cast(unsigned char, str[2])) << 16;
+    case 2: k ^= cast(lu_int32, cast(unsigned char, str[1])) << 8;
+    case 1: k ^= cast(unsigned char, str[0]);
+            h ^= scramble(k);
+  }
+  return h;
+}
+
+
+#if defined(__SSE2__)
+
+/* acc += (lo32(d^k) * hi32(d^k)) + d with its 64-bit halves swapped */
+#define accumulate(acc,d,k) \
+	{ __m128i dk_ = _mm_xor_si128(d, k); \
+	  __m128i p_ = _mm_mul_epu32(dk_, _mm_shuffle_epi32(dk_, 0x31)); \
+	  acc = _mm_add_epi64(acc, \
+	          _mm_add_epi64(p_, _mm_shuffle_epi32(d, 0x4E))); }
+
+static lu_int32 hashlong (const char *str, size_t l, lu_int32 h) {
+  lu_int32 w[8];
+  int i;
+  /* keys change with each block, so that blocks cannot be swapped */
+  __m128i k0 = _mm_set_epi32(h * 0x9E3779B1U, h ^ 0x85EBCA77U,
+                             h * 0xC2B2AE3DU, h ^ 0x27D4EB2FU);
+  __m128i k1 = _mm_xor_si128(k0, _mm_set1_epi32(0x165667B1));
+  __m128i step = _mm_set_epi32(0x9E3779B9, 0x7F4A7C15, 0x6A09E667,
+                               0x3C6EF372);
+  __m128i acc0 = k1;
+  __m128i acc1 = k0;
+  for (; l >= 32; l -= 32, str += 32) {
+    __m128i d0 = _mm_loadu_si128(cast(const __m128i *, str));
+    __m128i d1 = _mm_loadu_si128(cast(const __m128i *, str + 16));
+    accumulate(acc0, d0, k0);
+    accumulate(acc1, d1, k1);
+    k0 = _mm_add_epi32(k0, step);
+    k1 = _mm_add_epi32(k1, step);
+  }
+  _mm_storeu_si128(cast(__m128i *, w), acc0);
+  _mm_storeu_si128(cast(__m128i *, w + 4), acc1);
+  for (i = 0; i < 8; i++)
+    mixword(h, w[i]);
+  return hashbytes(str, l, h);
+}
+
+#endif
+
+
+unsigned int gafqS_hash (const char *str, size_t l, unsigned int seed) {
+  lu_int32 h = cast(lu_int32, seed) ^ cast(lu_int32, l);
+#if defined(__SSE2__)
+  if (l >= LONGHASH)
+    h = hashlong(str, l, h);
+  else
+#endif
+  h = hashbytes(str, l, h);
+  h ^= h >> 16;  /* final mix */
+  h *= 0x85EBCA6BU;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35U;
+  h ^= h >> 16;
+  return cast(unsigned int, h);
+}
+
+
 static TString *newlstr (gafq_State *L, const char *str, size_t l,
                                        unsigned int h) {
   TString *ts;
-  stringtable *tb;
   if (l+1 > (MAX_SIZET - sizeof(TString))/sizeof(char))
     gafqM_toobig(L);
   ts = cast(TString *, gafqM_malloc(L, (l+1)*sizeof(char)+sizeof(TString)));
@@ -59,40 +226,126 @@ static TString *newlstr (gafq_State *L, const char *str, size_t l,
   ts->tsv.marked = gafqC_white(G(L));
   ts->tsv.tt = GAFQ_TSTRING;
   ts->tsv.reserved = 0;
+  ts->tsv.hashed = 1;
   memcpy(ts+1, str, l*sizeof(char));
   ((char *)(ts+1))[l] = '\0';  /* ending 0 */
-  tb = &G(L)->strt;
-  h = lmod(h, tb->size);
-  ts->tsv.next = tb->hash[h];  /* chain new entry */
-  tb->hash[h] = obj2gco(ts);
-  tb->nuse++;
-  if (tb->nuse > cast(lu_int32, tb->size) && tb->size <= MAX_INT/2)
-    gafqS_resize(L, tb->size*2);  /* too crowded */
   return ts;
 }
 
+
+/*
+** Long strings are neither looked up nor entered in the string table:
+** they go in the `rootgc' list as other objects do, with the seed in
+** `hash' until `gafqS_hashlong' needs the real hash.
+*/
+static TString *newlong (gafq_State *L, const char *str, size_t l) {
+  TString *ts = newlstr(L, str, l, G(L)->seed);
+  ts->tsv.hashed = 0;
+  gafqC_link(L, obj2gco(ts), GAFQ_TSTRING);
+  return ts;
+}
+
+
+unsigned int gafqS_hashlong (TString *ts) {
+  gafq_assert(gafqS_islong(ts));
+  if (!ts->tsv.hashed) {
+    ts->tsv.hash = gafqS_hash(getstr(ts), ts->tsv.len, ts->tsv.hash);
+    ts->tsv.hashed = 1;
+  }
+  return ts->tsv.hash;
+}
+
+
+int gafqS_eqlong (const TString *a, const TString *b) {
+  size_t l = a->tsv.len;
+  return (l == b->tsv.len &&
+          (!a->tsv.hashed || !b->tsv.hashed || a->tsv.hash == b->tsv.hash) &&
+          memcmp(getstr(a), getstr(b), l) == 0);
+}
+
+
 //创建一个新的字符串
 TString *gafqS_newlstr (gafq_State *L, const char *str, size_t l) {
+  global_State *g = G(L);
+  stringtable *tb = &g->strt;
+  GCObject **list;
   GCObject *o;
-  unsigned int h = cast(unsigned int, l);  /* seed */
-  size_t step = (l>>5)+1;  /* if string is too long, don't hash all its chars */
-  size_t l1;
-  for (l1=l; l1>=step; l1-=step)  /* compute hash */
-    h = h ^ ((h<<5)+(h>>2)+cast(unsigned char, str[l1-1]));
-  for (o = G(L)->strt.hash[lmod(h, G(L)->strt.size)];
-       o != NULL;
-       o = o->gch.next) {
-    TString *ts = rawgco2ts(o);
+  TString *ts;
+  unsigned int h;
+  if (l > GAFQI_MAXSHORTLEN)
+    return newlong(L, str, l);
+  h = gafqS_hash(str, l, g->seed);
+  list = hashlist(tb, h);
+  for (o = *list; o != NULL; o = o->gch.next) {
+    ts = rawgco2ts(o);
     if (ts->tsv.len == l && (memcmp(str, getstr(ts), l) == 0)) {
       /* string may be dead */
-      if (isdead(G(L), o)) changewhite(o);
+      if (isdead(g, o)) changewhite(o);
       return ts;
     }
   }
-  return newlstr(L, str, l, h);  /* not found */
+  ts = newlstr(L, str, l, h);  /* not found */
+  o = obj2gco(ts);
+  o->gch.next = *list;  /* chain new entry */
+  *list = o;
+  tb->nuse++;
+  if (tb->oldpos > 0) {  /* resizing? */
+    if (g->gcstate != GCSsweepstring)
+      movelists(L, tb, GAFQI_REHASHSTEP);
+  }
+  else if (tb->nuse > cast(lu_int32, tb->size) && tb->size <= MAX_INT/2)
+    gafqS_resize(L, tb->size*2);  /* too crowded */
+  return ts;
+}
+
+
+
+/*
+** A view shares the chars of a long substring with its subject
+** instead of copying them, and keeps that string (its `parent') alive
+** through the collector. Short substrings are still interned, and a
+** view is only made of a string at most GAFQI_VIEWRATIO times as long.
+** The chars of a view are not followed by a '\0'; `gafqS_unview'
+** gives those who need one (table keys, the C API) a copy of exactly
+** them, which then becomes the parent of the view.
+*/
+TString *gafqS_newview (gafq_State *L, TString *ts, size_t i, size_t l) {
+  const char *s = getstr(ts) + i;
+  StrView *v;
+  gafq_assert(i + l <= ts->tsv.len);
+  if (isview(ts))
+    ts = viewparent(ts);  /* views never have views as parents */
+  if (l <= GAFQI_MAXSHORTLEN || ts->tsv.len / GAFQI_VIEWRATIO > l)
+    return gafqS_newlstr(L, s, l);
+  v = gafqM_new(L, StrView);
+  v->ts.tsv.reserved = STRVIEW;
+  v->ts.tsv.hashed = 0;
+  v->ts.tsv.hash = G(L)->seed;
+  v->ts.tsv.len = l;
+  v->parent = ts;
+  v->s = s;
+  gafqC_link(L, obj2gco(&v->ts), GAFQ_TSTRING);
+  return &v->ts;
 }
 
 
+TString *gafqS_unview (gafq_State *L, TString *ts) {
+  StrView *v = cast(StrView *, ts);
+  TString *c;
+  if (!isview(ts)) return ts;
+  if (v->parent->tsv.len == ts->tsv.len)
+    return v->parent;  /* view of all of it */
+  c = newlong(L, v->s, ts->tsv.len);
+  c->tsv.hashed = ts->tsv.hashed;
+  c->tsv.hash = ts->tsv.hash;
+  /* a view already marked no longer marks its parent in this cycle */
+  if (G(L)->gcstate == GCSpropagate && !iswhite(obj2gco(ts)))
+    reset2bits(c->tsv.marked, WHITE0BIT, WHITE1BIT);
+  v->parent = c;
+  v->s = getstr(c);
+  return c;
+}
+
 Udata *gafqS_newudata (gafq_State *L, size_t s, Table *e) {
   Udata *u;
   if (s > MAX_SIZET - sizeof(Udata))
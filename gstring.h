@@ -23,9 +23,27 @@
 
 #define gafqS_fix(s)	l_setbit((s)->tsv.marked, FIXEDBIT)
 
+/* strings longer than GAFQI_MAXSHORTLEN are not interned */
+#define gafqS_islong(s)	((s)->tsv.len > GAFQI_MAXSHORTLEN)
+
+/* long strings are hashed the first time they index a table */
+#define gafqS_hashof(s)	((s)->tsv.hashed ? (s)->tsv.hash : gafqS_hashlong(s))
+
+/* only long strings can be equal without being the same object */
+#define gafqS_eqstr(a,b) \
+	((a) == (b) || (gafqS_islong(a) && gafqS_eqlong(a, b)))
+
+GAFQI_FUNC unsigned int gafqS_hash (const char *str, size_t l,
+                                    unsigned int seed);
+GAFQI_FUNC unsigned int gafqS_hashlong (TString *ts);
+GAFQI_FUNC int gafqS_eqlong (const TString *a, const TString *b);
+GAFQI_FUNC GCObject **gafqS_list (stringtable *tb, int i);
 GAFQI_FUNC void gafqS_resize (gafq_State *L, int newsize);
 GAFQI_FUNC Udata *gafqS_newudata (gafq_State *L, size_t s, Table *e);
 GAFQI_FUNC TString *gafqS_newlstr (gafq_State *L, const char *str, size_t l);
+GAFQI_FUNC TString *gafqS_newview (gafq_State *L, TString *ts, size_t i,
+                                   size_t l);
+GAFQI_FUNC TString *gafqS_unview (gafq_State *L, TString *ts);
 
 
 #endif
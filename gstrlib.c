@@ -42,14 +42,17 @@ static ptrdiff_t posrelat (ptrdiff_t pos, size_t len) {
 //这个截取字符串
 static int str_sub (gafq_State *L) {
   size_t l;
+  ptrdiff_t start, end;
   // 取出字符串， l是字符串长度
-  const char *s = gafqL_checkgstring(L, 1, &l);
-  ptrdiff_t start = posrelat(gafqL_checkinteger(L, 2), l);
-  ptrdiff_t end = posrelat(gafqL_optinteger(L, 3, -1), l);
+  if (gafq_type(L, 1) == GAFQ_TSTRING)  /* (a view stays a view) */
+    l = gafq_objlen(L, 1);
+  else gafqL_checkgstring(L, 1, &l);
+  start = posrelat(gafqL_checkinteger(L, 2), l);
+  end = posrelat(gafqL_optinteger(L, 3, -1), l);
   if (start < 1) start = 1;
   if (end > (ptrdiff_t)l) end = (ptrdiff_t)l;
   if (start <= end)
-    gafq_pushgstring(L, s+start-1, end-start+1);
+    gafq_pushsubstring(L, 1, start-1, end-start+1);
   else gafq_pushliteral(L, "");
   return 1;
 }
@@ -173,6 +176,7 @@ typedef struct MatchState {
   const char *src_init;  /* init of source string */
   const char *src_end;  /* end (`\0') of source string */
   gafq_State *L;
+  int src;  /* index of source string */
   int level;  /* total number of captures (finished or unfinished) */
   struct {
     const char *init;
@@ -468,8 +472,8 @@ static const char *gmemfind (const char *s1, size_t l1,
 static void push_onecapture (MatchState *ms, int i, const char *s,
                                                     const char *e) {
   if (i >= ms->level) {
-    if (i == 0)  /* ms->level == 0, too */
-      gafq_pushgstring(ms->L, s, e - s);  /* add whole match */
+    if (i == 0)  /* ms->level == 0, too; add whole match */
+      gafq_pushsubstring(ms->L, ms->src, s - ms->src_init, e - s);
     else
       gafqL_error(ms->L, "invalid capture index");
   }
@@ -479,7 +483,8 @@ static void push_onecapture (MatchState *ms, int i, const char *s,
     if (l == CAP_POSITION)
       gafq_pushinteger(ms->L, ms->capture[i].init - ms->src_init + 1);
     else
-      gafq_pushgstring(ms->L, ms->capture[i].init, l);
+      gafq_pushsubstring(ms->L, ms->src, ms->capture[i].init - ms->src_init,
+                         l);
   }
 }
 
@@ -516,6 +521,7 @@ static int str_find_aux (gafq_State *L, int find) {
     int anchor = (*p == '^') ? (p++, 1) : 0;
     const char *s1=s+init;
     ms.L = L;
+    ms.src = 1;
     ms.src_init = s;
     ms.src_end = s+l1;
     do {
@@ -554,6 +560,7 @@ static int gmatch_aux (gafq_State *L) {
   const char *p = gafq_tostring(L, gafq_upvalueindex(2));
   const char *src;
   ms.L = L;
+  ms.src = gafq_upvalueindex(1);
   ms.src_init = s;
   ms.src_end = s+ls;
   for (src = s + (size_t)gafq_tointeger(L, gafq_upvalueindex(3));
@@ -658,6 +665,7 @@ static int str_gsub (gafq_State *L) {
                       "string/function/table expected");
   gafqL_buffinit(L, &b);
   ms.L = L;
+  ms.src = 1;
   ms.src_init = src;
   ms.src_end = src+srcl;
   while (n < max_s) {
@@ -863,6 +871,7 @@ static void createmetatable (gafq_State *L) {
 */
 GAFQLIB_API int gafqopen_string (gafq_State *L) {
   gafqL_register(L, GAFQ_STRLIBNAME, strlib);
+  gafq_setbuiltin(L, "string.byte", str_byte);  /* see OP_INTRINSIC */
 #if defined(GAFQ_COMPAT_GFIND)
   gafq_getfield(L, -1, "gmatch");
   gafq_setfield(L, -2, "gfind");
@@ -16,6 +16,12 @@
 ** in its main position (i.e. the `original' position that its hash gives
 ** to it), then the colliding element is in its own main position.
 ** Hence even when the load factor reaches 100%, performance remains good.
+** With GAFQ_SWISSTABLE the hash part uses open addressing instead (see
+** `Hash part' below).
+** An array part that gets only numbers at a resize is kept `packed' as a
+** vector of gafq_Numbers (see gtable.h) until anything else is stored in
+** it; stores that go through a slot (gafqH_set, gafqH_setnum) unpack it
+** first, so packed tables want gafqH_setobj and gafqH_setint instead.
 */
 
 #include <math.h>
@@ -32,8 +38,13 @@
 #include "gmem.h"
 #include "gobject.h"
 #include "gstate.h"
+#include "gstring.h"
 #include "gtable.h"
 
+#if defined(GAFQ_SWISSTABLE) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 
 /*
 ** max size of array part is 2^MAXBITS
@@ -47,9 +58,67 @@
 #define MAXASIZE	(1 << MAXBITS)
 
 
+/*
+** number of ints inside a gafq_Number
+*/
+#define numints		cast_int(sizeof(gafq_Number)/sizeof(int))
+
+
+#if defined(GAFQ_PACKEDARRAYS)
+/* all bits set: a NaN that `packnum' turns around (see gtable.h) */
+const unsigned char gafqH_hole[sizeof(gafq_Number)] = {
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+#endif
+
+
+/* smallest array part worth packing */
+#define MINPACKED	8
+
+/* is entry `i' (from 0) of the array part nil? */
+#define isnilentry(t,i) \
+	(ispacked(t) ? ishole(packedarray(t)[i]) : ttisnil(&(t)->array[i]))
+
+
+/*
+** returns the index for `key' if `key' is an appropriate key to live in
+** the array part of the table, -1 otherwise.
+*/
+static int arrayindex (const TValue *key) {
+  if (ttisint(key)) {
+    l_int i = ivalue(key);
+    if (cast_lint(cast_int(i)) == i)
+      return cast_int(i);
+  }
+  else if (ttisnumber(key)) {
+    gafq_Number n = nvalue(key);
+    int k;
+    gafq_number2int(k, n);
+    if (gafqi_numeq(cast_num(k), n))
+      return k;
+  }
+  return -1;  /* `key' did not match some condition */
+}
+
+
+/*
+** {=============================================================
+** Hash part
+** ==============================================================
+*/
+
+
+static void rehash (gafq_State *L, Table *t, const TValue *ek,
+                    const TValue *ev);
+static TValue *setslot (gafq_State *L, Table *t, const TValue *key,
+                        const TValue *v);
+
+
+#if !defined(GAFQ_SWISSTABLE)
+
 #define hashpow2(t,n)      (gnode(t, lmod((n), sizenode(t))))
   
-#define hashstr(t,str)  hashpow2(t, (str)->tsv.hash)
+#define hashstr(t,str)  hashpow2(t, gafqS_hashof(str))
 #define hashboolean(t,p)        hashpow2(t, p)
 
 
@@ -63,18 +132,11 @@
 #define hashpointer(t,p)	hashmod(t, IntPoint(p))
 
 
-/*
-** number of ints inside a gafq_Number
-*/
-#define numints		cast_int(sizeof(gafq_Number)/sizeof(int))
-
-
-
 #define dummynode		(&dummynode_)
 
 static const Node dummynode_ = {
-  {{NULL}, GAFQ_TNIL},  /* value */
-  {{{NULL}, GAFQ_TNIL, NULL}}  /* key */
+  {NILCONSTANT},  /* value */
+  {{NILCONSTANT, NULL}}  /* key */
 };
 
 
@@ -114,20 +176,471 @@ static Node *mainposition (const Table *t, const TValue *key) {
 
 
 /*
-** returns the index for `key' if `key' is an appropriate key to live in
-** the array part of the table, -1 otherwise.
+** the nodes holding string `key', number `nk' and any `key'; NULL if
+** they are not in the hash part
 */
-static int arrayindex (const TValue *key) {
-  if (ttisnumber(key)) {
-    gafq_Number n = nvalue(key);
-    int k;
-    gafq_number2int(k, n);
-    if (gafqi_numeq(cast_num(k), n))
-      return k;
+static Node *findstr (const Table *t, TString *key) {
+  Node *n = hashstr(t, key);
+  do {  /* check whether `key' is somewhere in the chain */
+    if (ttisstring(gkey(n)) && gafqS_eqstr(key, rawtsvalue(gkey(n))))
+      return n;  /* that's it */
+    else n = gnext(n);
+  } while (n);
+  return NULL;
+}
+
+
+static Node *findnum (const Table *t, gafq_Number nk) {
+  Node *n = hashnum(t, nk);
+  do {  /* check whether `key' is somewhere in the chain */
+    if (ttisnumber(gkey(n)) && gafqi_numeq(nvalue(gkey(n)), nk))
+      return n;  /* that's it */
+    else n = gnext(n);
+  } while (n);
+  return NULL;
+}
+
+
+static Node *findkey (const Table *t, const TValue *key) {
+  Node *n = mainposition(t, key);
+  do {  /* check whether `key' is somewhere in the chain */
+    if (gafqO_rawequalObj(key2tval(n), key))
+      return n;  /* that's it */
+    else n = gnext(n);
+  } while (n);
+  return NULL;
+}
+
+
+/* as `findkey', for a key that `next' got and may be dead already */
+static Node *findtraversed (const Table *t, const TValue *key) {
+  Node *n = mainposition(t, key);
+  do {  /* check whether `key' is somewhere in the chain */
+    if (gafqO_rawequalObj(key2tval(n), key) ||
+          (ttype(gkey(n)) == GAFQ_TDEADKEY && iscollectable(key) &&
+           gcvalue(gkey(n)) == gcvalue(key)))
+      return n;
+    else n = gnext(n);
+  } while (n);
+  return NULL;
+}
+
+
+static void setnodevector (gafq_State *L, Table *t, int size) {
+  int lsize;
+  if (size == 0) {  /* no elements to hash part? */
+    t->node = cast(Node *, dummynode);  /* use common `dummynode' */
+    lsize = 0;
   }
-  return -1;  /* `key' did not match some condition */
+  else {
+    int i;
+    lsize = ceillog2(size);
+    if (lsize > MAXBITS)
+      gafqG_runerror(L, "table overflow");
+    size = twoto(lsize);
+    t->node = gafqM_newvector(L, size, Node);
+    for (i=0; i<size; i++) {
+      Node *n = gnode(t, i);
+      gnext(n) = NULL;
+      setnilvalue(gkey(n));
+      setnilvalue(gval(n));
+    }
+  }
+  t->lsizenode = cast_byte(lsize);
+  t->lastfree = gnode(t, size);  /* all positions are free */
+}
+
+
+/* keys that a node part of size `n' can hold */
+#define nodecap(n)	(n)
+
+
+static Node *getfreepos (Table *t) {
+  while (t->lastfree-- > t->node) {
+    if (ttisnil(gkey(t->lastfree)))
+      return t->lastfree;
+  }
+  return NULL;  /* could not find a free place */
+}
+
+
+
+/*
+** inserts a new key into a hash table; first, check whether key's main 
+** position is free. If not, check whether colliding node is in its main 
+** position or not: if it is not, move colliding node to an empty place and 
+** put new key in its main position; otherwise (colliding node is in its main 
+** position), new key goes to an empty position. 
+*/
+static TValue *newkey (gafq_State *L, Table *t, const TValue *key,
+                       const TValue *v) {
+  Node *mp = mainposition(t, key);
+  if (!ttisnil(gval(mp)) || mp == dummynode) {
+    Node *othern;
+    Node *n = getfreepos(t);  /* get a free place */
+    if (n == NULL) {  /* cannot find a free place? */
+      rehash(L, t, key, v);  /* grow table */
+      return setslot(L, t, key, v);  /* re-insert key into grown table */
+    }
+    gafq_assert(n != dummynode);
+    othern = mainposition(t, key2tval(mp));
+    if (othern != mp) {  /* is colliding node out of its main position? */
+      /* yes; move colliding node into free position */
+      while (gnext(othern) != mp) othern = gnext(othern);  /* find previous */
+      gnext(othern) = n;  /* redo the chain with `n' in place of `mp' */
+      *n = *mp;  /* copy colliding node into free pos. (mp->next also goes) */
+      gnext(mp) = NULL;  /* now `mp' is free */
+      setnilvalue(gval(mp));
+    }
+    else {  /* colliding node is in its own main position */
+      /* new node will go into free position */
+      gnext(n) = gnext(mp);  /* chain new position */
+      gnext(mp) = n;
+      mp = n;
+    }
+  }
+  copyvalue(gkey(mp), key);
+  gafqC_barriert(L, t, key);
+  gafq_assert(ttisnil(gval(mp)));
+  return gval(mp);
 }
 
+#else
+
+/*
+** Open addressing (GAFQ_SWISSTABLE). Each node has a control byte, kept
+** after the node part: CEMPTY for a free node, else 7 bits of the hash
+** of its key. The nodes for a key are looked for a group of GROUPSIZE
+** control bytes at a time (compared all at once with SSE2), from the
+** position its hash gives and then further and further away, until a
+** group with a free node. The first GROUPSIZE control bytes are copied
+** after the last one, so that a group never wraps around. Keys are not
+** removed before a rehash (a nil value leaves its key in its node), so
+** there are no tombstones. A node part of up to GROUPSIZE nodes is one
+** group, and may be full; larger ones are rehashed before they are 7/8
+** full, so every probe ends.
+*/
+
+#define CEMPTY		0x80
+
+#define h1(h)		((h) >> 7)  /* where a probe starts */
+#define h2(h)		cast_byte((h) & 0x7F)  /* the control byte */
+
+/* keys that a node part of size `n' can hold */
+#define nodecap(n)	((n) <= GROUPSIZE ? (n) : (n) - (n)/8)
+
+
+typedef unsigned int Mask;  /* a bit for each node in a group */
+
+#if defined(__SSE2__)
+
+#define loadgroup(c)	_mm_loadu_si128(cast(const __m128i *, c))
+#define match(c,b) cast(Mask, _mm_movemask_epi8( \
+	_mm_cmpeq_epi8(loadgroup(c), _mm_set1_epi8(cast(char, b)))))
+#define matchempty(c)	cast(Mask, _mm_movemask_epi8(loadgroup(c)))
+
+#else
+
+static Mask match (const lu_byte *c, lu_byte b) {
+  Mask m = 0;
+  int i;
+  for (i = 0; i < GROUPSIZE; i++)
+    if (c[i] == b) m |= cast(Mask, 1) << i;
+  return m;
+}
+
+#define matchempty(c)	match(c, CEMPTY)
+
+#endif
+
+
+#if defined(__GNUC__)
+#define firstbit(m)	__builtin_ctz(m)
+#else
+static int firstbit (Mask m) {
+  int i = 0;
+  while (!(m & 1)) { m >>= 1; i++; }
+  return i;
+}
+#endif
+
+
+/*
+** set `n' to each node of `t' whose control byte is that of hash `h',
+** till `e' holds or, with `n' set to NULL, a group has a free node
+*/
+#define probe(t,h,n,e) { \
+  const lu_byte *c_ = gctrl(t); \
+  unsigned int m_ = sizenode(t) - 1, p_ = h1(h) & m_, s_ = 0; \
+  for (;;) { \
+    Mask b_ = match(c_ + p_, h2(h)); \
+    while (b_ != 0 && (n = gnode(t, (p_ + firstbit(b_)) & m_), !(e))) \
+      b_ &= b_ - 1; \
+    if (b_ != 0) break; \
+    if (matchempty(c_ + p_) || m_ < GROUPSIZE) { n = NULL; break; } \
+    p_ = (p_ + (s_ += GROUPSIZE)) & m_; \
+  } }
+
+
+#define dummynode		(&dummynode_.n)
+
+static const struct {
+  Node n;
+  lu_byte ctrl[1 + GROUPSIZE];
+} dummynode_ = {
+  {{NILCONSTANT}, {{NILCONSTANT}}},
+  {CEMPTY, CEMPTY, CEMPTY, CEMPTY, CEMPTY, CEMPTY, CEMPTY, CEMPTY, CEMPTY,
+   CEMPTY, CEMPTY, CEMPTY, CEMPTY, CEMPTY, CEMPTY, CEMPTY, CEMPTY}
+};
+
+
+/*
+** the hashes of numbers and pointers are mixed, as their low bits hardly
+** change; those of strings are good enough as they are
+*/
+static unsigned int mixhash (unsigned int h) {
+  h ^= h >> 16;
+  h *= 0x85EBCA6BU;
+  h ^= h >> 13;
+  return h;
+}
+
+
+static unsigned int hashnum (gafq_Number n) {
+  unsigned int a[numints];
+  int i;
+  if (gafqi_numeq(n, 0))  /* avoid problems with -0 */
+    return 0;
+  memcpy(a, &n, sizeof(a));
+  for (i = 1; i < numints; i++) a[0] += a[i];
+  return mixhash(a[0]);
+}
+
+
+static unsigned int hashkey (const TValue *key) {
+  switch (ttype(key)) {
+    case GAFQ_TNUMBER:
+      return hashnum(nvalue(key));
+    case GAFQ_TSTRING:
+      return gafqS_hashof(rawtsvalue(key));
+    case GAFQ_TBOOLEAN:
+      return mixhash(bvalue(key));
+    case GAFQ_TLIGHTUSERDATA:
+      return mixhash(IntPoint(pvalue(key)));
+    default:
+      return mixhash(IntPoint(gcvalue(key)));
+  }
+}
+
+
+#if defined(GAFQ_DEBUG)
+static Node *mainposition (const Table *t, const TValue *key) {
+  return gnode(t, h1(hashkey(key)) & (sizenode(t) - 1));
+}
+#endif
+
+
+static Node *findstr (const Table *t, TString *key) {
+  unsigned int h = gafqS_hashof(key);
+  Node *n;
+  probe(t, h, n, ttisstring(gkey(n)) &&
+                 gafqS_eqstr(key, rawtsvalue(gkey(n))));
+  return n;
+}
+
+
+static Node *findnum (const Table *t, gafq_Number nk) {
+  unsigned int h = hashnum(nk);
+  Node *n;
+  probe(t, h, n, ttisnumber(gkey(n)) && gafqi_numeq(nvalue(gkey(n)), nk));
+  return n;
+}
+
+
+static Node *findkey (const Table *t, const TValue *key) {
+  unsigned int h = hashkey(key);
+  Node *n;
+  probe(t, h, n, gafqO_rawequalObj(key2tval(n), key));
+  return n;
+}
+
+
+static Node *findtraversed (const Table *t, const TValue *key) {
+  unsigned int h = hashkey(key);
+  Node *n;
+  probe(t, h, n, gafqO_rawequalObj(key2tval(n), key) ||
+                 (ttype(gkey(n)) == GAFQ_TDEADKEY && iscollectable(key) &&
+                  gcvalue(gkey(n)) == gcvalue(key)));
+  return n;
+}
+
+
+/* control byte of node `i' := `c', with its copy after the last one */
+static void setctrl (Table *t, int i, lu_byte c) {
+  lu_byte *ctrl = gctrl(t);
+  int size = sizenode(t);
+  ctrl[i] = c;
+  for (; i < GROUPSIZE; i += size)
+    ctrl[size + i] = c;
+}
+
+
+static void setnodevector (gafq_State *L, Table *t, int size) {
+  int lsize = 0;
+  if (size == 0) {  /* no elements to hash part? */
+    t->node = cast(Node *, dummynode);  /* use common `dummynode' */
+    t->growth = 0;
+  }
+  else {
+    int i;
+    while (nodecap(twoto(lsize)) < size) {
+      if (++lsize > MAXBITS)
+        gafqG_runerror(L, "table overflow");
+    }
+    size = twoto(lsize);
+    t->node = cast(Node *, gafqM_malloc(L, nodesize(size)));
+    for (i=0; i<size; i++) {
+      Node *n = gnode(t, i);
+      setnilvalue(gkey(n));
+      setnilvalue(gval(n));
+    }
+    memset(gnode(t, size), CEMPTY, size + GROUPSIZE);
+    t->growth = nodecap(size);
+  }
+  t->lsizenode = cast_byte(lsize);
+}
+
+
+/*
+** inserts a new key into a hash table, in the first free node of its
+** probe sequence
+*/
+static TValue *newkey (gafq_State *L, Table *t, const TValue *key,
+                       const TValue *v) {
+  unsigned int h = hashkey(key);
+  unsigned int mask = sizenode(t) - 1;
+  unsigned int pos = h1(h) & mask;
+  unsigned int step = 0;
+  Mask m;
+  Node *n;
+  if (t->growth == 0) {  /* no room left? */
+    rehash(L, t, key, v);  /* grow table */
+    return setslot(L, t, key, v);  /* re-insert key into grown table */
+  }
+  while ((m = matchempty(gctrl(t) + pos)) == 0)
+    pos = (pos + (step += GROUPSIZE)) & mask;
+  pos = (pos + firstbit(m)) & mask;
+  setctrl(t, pos, h2(h));
+  t->growth--;
+  n = gnode(t, pos);
+  copyvalue(gkey(n), key);
+  gafqC_barriert(L, t, key);
+  gafq_assert(ttisnil(gval(n)));
+  return gval(n);
+}
+
+#endif
+
+
+/*
+** A large node part that gets full grows a step at a time: a node part
+** twice as large takes its place at once, and the old one is kept in
+** `oldnode' until all its entries have been moved to the new one, a few
+** with each new key. Meanwhile keys are looked for in both. Lookups and
+** stores to existing keys move nothing, so that traversals (which go
+** through the old part after the new one) still see every key once.
+*/
+
+
+/* nodes looked at to size a new node part */
+#define SAMPLE		64
+
+
+/* `v' made to look like the old node part of `t', for the find functions */
+static const Table *oldpart (const Table *t, Table *v) {
+  v->node = t->oldnode;
+  v->lsizenode = t->oldlsize;
+  return v;
+}
+
+
+/*
+** node `n' of the old node part, found for a key, as a lookup result. A
+** nil value may be in a node `movenodes' has passed already, so that a
+** store there would be lost: such a key is new (and goes to the new part)
+*/
+static Node *oldslot (Node *n) {
+  return (n != NULL && !ttisnil(gval(n))) ? n : NULL;
+}
+
+
+/*
+** move the entries of (up to) `n' nodes of the old node part of `t' to
+** the new one, and free the old part once it is empty
+*/
+static void movenodes (gafq_State *L, Table *t, int n) {
+  while (n-- > 0 && t->oldpos > 0) {
+    Node *old = &t->oldnode[--t->oldpos];
+    if (!ttisnil(gval(old))) {
+      /* (newkey may rehash, which takes all the other nodes too) */
+      TValue k, v;
+      setobj(L, &k, key2tval(old));
+      setobj(L, &v, gval(old));
+      setnilvalue(gval(old));
+      setobjt2t(L, newkey(L, t, &k, &v), &v);
+    }
+  }
+  if (t->oldpos == 0 && t->oldnode != NULL) {
+    gafqM_freemem(L, t->oldnode, nodesize(twoto(t->oldlsize)));
+    t->oldnode = NULL;
+  }
+}
+
+
+/*
+** start replacing the full node part of `t' a step at a time, if it is
+** large and new key `ek' cannot be one to make the array part grow. The
+** new part is twice as large, unless a sample of the nodes shows that
+** most of them hold nil values
+*/
+static int growstep (gafq_State *L, Table *t, const TValue *ek) {
+  Node *old = t->node;
+  int lsize = t->lsizenode;
+  int size = sizenode(t);
+  int k = arrayindex(ek);
+  int step = (size > SAMPLE) ? size / SAMPLE : 1;
+  int i, used = 0;
+  if (size < GAFQI_INCRREHASH ||
+      (0 < k && k / 2 <= t->sizearray + size))
+    return 0;
+  for (i = 0; i < size; i += step)
+    if (!ttisnil(gval(gnode(t, i)))) used++;
+  setnodevector(L, t, nodecap(size) + (used > size / step / 2));
+  t->oldnode = old;
+  t->oldlsize = cast_byte(lsize);
+  t->oldpos = twoto(lsize);
+  return 1;
+}
+
+
+/* inserts a new key, moving some old nodes first */
+static TValue *addkey (gafq_State *L, Table *t, const TValue *key,
+                       const TValue *v) {
+  TValue k;
+  if (ttisstring(key) && isview(rawtsvalue(key))) {
+    /* a key must not keep the subject of a view alive */
+    setsvalue(L, &k, gafqS_unview(L, rawtsvalue(key)));
+    key = &k;
+  }
+  if (t->oldnode != NULL)
+    movenodes(L, t, GAFQI_REHASHSTEP);
+  return newkey(L, t, key, v);
+}
+
+/*
+** }=============================================================
+*/
+
 
 /*
 ** returns the index of a `key' for table traversals. First goes all
@@ -141,18 +654,19 @@ static int findindex (gafq_State *L, Table *t, StkId key) {
   if (0 < i && i <= t->sizearray)  /* is `key' inside array part? */
     return i-1;  /* yes; that's the index (corrected to C) */
   else {
-    Node *n = mainposition(t, key);
-    do {  /* check whether `key' is somewhere in the chain */
-      /* key may be dead already, but it is ok to use it in `next' */
-      if (gafqO_rawequalObj(key2tval(n), key) ||
-            (ttype(gkey(n)) == GAFQ_TDEADKEY && iscollectable(key) &&
-             gcvalue(gkey(n)) == gcvalue(key))) {
-        i = cast_int(n - gnode(t, 0));  /* key index in hash table */
-        /* hash elements are numbered after array ones */
-        return i + t->sizearray;
-      }
-      else n = gnext(n);
-    } while (n);
+    /* key may be dead already, but it is ok to use it in `next' */
+    Node *n = findtraversed(t, key);
+    if (n != NULL) {
+      i = cast_int(n - gnode(t, 0));  /* key index in hash table */
+      /* hash elements are numbered after array ones */
+      return i + t->sizearray;
+    }
+    if (t->oldnode != NULL) {  /* then come those of the old node part */
+      Table v;
+      n = findtraversed(oldpart(t, &v), key);
+      if (n != NULL)
+        return cast_int(n - t->oldnode) + t->sizearray + sizenode(t);
+    }
     gafqG_runerror(L, "invalid key to " GAFQ_QL("next"));  /* key not found */
     return 0;  /* to avoid warnings */
   }
@@ -162,9 +676,12 @@ static int findindex (gafq_State *L, Table *t, StkId key) {
 int gafqH_next (gafq_State *L, Table *t, StkId key) {
   int i = findindex(L, t, key);  /* find original element */
   for (i++; i < t->sizearray; i++) {  /* try first array part */
-    if (!ttisnil(&t->array[i])) {  /* a non-nil value? */
-      setnvalue(key, cast_num(i+1));
-      setobj2s(L, key+1, &t->array[i]);
+    if (!isnilentry(t, i)) {  /* a non-nil value? */
+      setivalue(key, cast_lint(i+1));
+      if (ispacked(t))
+        unpacknum(t, key+1, packedarray(t)[i])
+      else
+        setobj2s(L, key+1, &t->array[i]);
       return 1;
     }
   }
@@ -175,6 +692,16 @@ int gafqH_next (gafq_State *L, Table *t, StkId key) {
       return 1;
     }
   }
+  if (t->oldnode != NULL) {  /* then the old node part */
+    for (i -= sizenode(t); i < twoto(t->oldlsize); i++) {
+      Node *n = &t->oldnode[i];
+      if (!ttisnil(gval(n))) {
+        setobj2s(L, key, key2tval(n));
+        setobj2s(L, key+1, gval(n));
+        return 1;
+      }
+    }
+  }
   return 0;  /* no more elements */
 }
 
@@ -234,7 +761,7 @@ static int numusearray (const Table *t, int *nums) {
     }
     /* count elements in range (2^(lg-1), 2^lg] */
     for (; i <= lim; i++) {
-      if (!ttisnil(&t->array[i-1]))
+      if (!isnilentry(t, i-1))
         lc++;
     }
     nums[lg] += lc;
@@ -244,17 +771,24 @@ static int numusearray (const Table *t, int *nums) {
 }
 
 
-static int numusehash (const Table *t, int *nums, int *pnasize) {
+static int numusenodes (const Node *node, int size, int *nums, int *ause) {
   int totaluse = 0;  /* total number of elements */
-  int ause = 0;  /* summation of `nums' */
-  int i = sizenode(t);
-  while (i--) {
-    Node *n = &t->node[i];
+  while (size--) {
+    const Node *n = &node[size];
     if (!ttisnil(gval(n))) {
-      ause += countint(key2tval(n), nums);
+      *ause += countint(key2tval(n), nums);
       totaluse++;
     }
   }
+  return totaluse;
+}
+
+
+static int numusehash (const Table *t, int *nums, int *pnasize) {
+  int ause = 0;  /* summation of `nums' */
+  int totaluse = numusenodes(t->node, sizenode(t), nums, &ause);
+  if (t->oldnode != NULL)
+    totaluse += numusenodes(t->oldnode, twoto(t->oldlsize), nums, &ause);
   *pnasize += ause;
   return totaluse;
 }
@@ -262,79 +796,186 @@ static int numusehash (const Table *t, int *nums, int *pnasize) {
 
 static void setarrayvector (gafq_State *L, Table *t, int size) {
   int i;
-  gafqM_reallocvector(L, t->array, t->sizearray, size, TValue);
-  for (i=t->sizearray; i<size; i++)
-     setnilvalue(&t->array[i]);
+  if (ispacked(t)) {
+    t->array = cast(TValue *, gafqM_realloc_(L, t->array,
+                              packedsize(t->sizearray), packedsize(size)));
+    for (i=t->sizearray; i<size; i++)
+      sethole(packedarray(t)[i]);
+  }
+  else {
+    gafqM_reallocvector(L, t->array, t->sizearray, size, TValue);
+    for (i=t->sizearray; i<size; i++)
+       setnilvalue(&t->array[i]);
+  }
   t->sizearray = size;
 }
 
 
-static void setnodevector (gafq_State *L, Table *t, int size) {
-  int lsize;
-  if (size == 0) {  /* no elements to hash part? */
-    t->node = cast(Node *, dummynode);  /* use common `dummynode' */
-    lsize = 0;
+#if defined(GAFQ_PACKEDARRAYS)
+
+/*
+** how many numbers would the array part of `t' have at size `nasize'?
+** -1 if it would have anything else, counting value `ev' for key `ek'
+** (NULL when the value is not known yet, as for gafqH_set)
+*/
+static int packablenodes (const Node *node, int size, int nasize) {
+  int k;
+  int nums = 0;
+  while (size--) {
+    const Node *n = &node[size];
+    if (!ttisnil(gval(n)) && 0 < (k = arrayindex(key2tval(n))) &&
+        k <= nasize) {
+      if (!ttisnumber(gval(n))) return -1;
+      nums++;
+    }
   }
-  else {
-    int i;
-    lsize = ceillog2(size);
-    if (lsize > MAXBITS)
-      gafqG_runerror(L, "table overflow");
-    size = twoto(lsize);
-    t->node = gafqM_newvector(L, size, Node);
-    for (i=0; i<size; i++) {
-      Node *n = gnode(t, i);
-      gnext(n) = NULL;
-      setnilvalue(gkey(n));
-      setnilvalue(gval(n));
+  return nums;
+}
+
+
+static int packable (const Table *t, int nasize, const TValue *ek,
+                     const TValue *ev) {
+  int i, k;
+  int nums = (ispacked(t) != 0);
+  if (!ispacked(t)) {
+    for (i = 0; i < t->sizearray && i < nasize; i++) {
+      if (ttisnumber(&t->array[i])) nums++;
+      else if (!ttisnil(&t->array[i])) return -1;
+    }
+  }
+  if ((k = packablenodes(t->node, sizenode(t), nasize)) < 0) return -1;
+  nums += k;
+  if (t->oldnode != NULL) {
+    k = packablenodes(t->oldnode, twoto(t->oldlsize), nasize);
+    if (k < 0) return -1;
+    nums += k;
+  }
+  if (ek && 0 < (k = arrayindex(ek)) && k <= nasize) {
+    if (ev == NULL || !ttisnumber(ev)) return -1;
+    nums++;
+  }
+  return nums;
+}
+
+
+static void pack (gafq_State *L, Table *t) {
+  int i;
+  int n = t->sizearray;
+  gafq_Number *a = cast(gafq_Number *, gafqM_malloc(L, packedsize(n)));
+  t->packed = PACKEDINT;
+  for (i = 0; i < n; i++) {
+    if (ttisnil(&t->array[i])) sethole(a[i]);
+    else packnum(t, a[i], &t->array[i]);
+  }
+  gafqM_freearray(L, t->array, n, TValue);
+  t->array = cast(TValue *, a);
+}
+
+#else
+#define packable(t,nasize,ek,ev)	(-1)
+#define pack(L,t)	((void)0)
+#endif
+
+
+/*
+** back to TValues, once the array part of `t' is to get something else
+** than a number
+*/
+static void unpack (gafq_State *L, Table *t) {
+  int i;
+  int n = t->sizearray;
+  TValue *v = gafqM_newvector(L, n, TValue);
+  gafq_assert(ispacked(t));
+  for (i = 0; i < n; i++) {
+    if (ishole(packedarray(t)[i])) setnilvalue(&v[i]);
+    else unpacknum(t, &v[i], packedarray(t)[i]);
+  }
+  gafqM_freemem(L, t->array, packedsize(n));
+  t->array = v;
+  t->packed = 0;
+}
+
+
+static void reinsert (gafq_State *L, Table *t, Node *node, int size) {
+  while (size--) {
+    Node *old = &node[size];
+    if (!ttisnil(gval(old))) {
+      TValue *slot = setslot(L, t, key2tval(old), gval(old));
+      if (slot != NULL)
+        setobjt2t(L, slot, gval(old));
     }
   }
-  t->lsizenode = cast_byte(lsize);
-  t->lastfree = gnode(t, size);  /* all positions are free */
 }
 
 
-static void resize (gafq_State *L, Table *t, int nasize, int nhsize) {
+/*
+** resize `t', which is about to get value `ev' (if known) for key `ek'
+** (if any); its array part ends up packed if it can be
+*/
+static void resize (gafq_State *L, Table *t, int nasize, int nhsize,
+                    const TValue *ek, const TValue *ev) {
   int i;
   int oldasize = t->sizearray;
   int oldhsize = t->lsizenode;
   Node *nold = t->node;  /* save old hash ... */
+  Node *nmoving = t->oldnode;  /* ... and the one still being moved */
+  int movingsize = (nmoving != NULL) ? twoto(t->oldlsize) : 0;
+  int pk = (nasize >= MINPACKED && packable(t, nasize, ek, ev) > 0);
+  if (ispacked(t) && !pk)
+    unpack(L, t);
   if (nasize > oldasize)  /* array part must grow? */
     setarrayvector(L, t, nasize);
   /* create new hash part with appropriate size */
   setnodevector(L, t, nhsize);  
+  t->oldnode = NULL;  /* (entries of both parts go to the new one) */
+  t->oldpos = 0;
   if (nasize < oldasize) {  /* array part must shrink? */
     t->sizearray = nasize;
     /* re-insert elements from vanishing slice */
     for (i=nasize; i<oldasize; i++) {
-      if (!ttisnil(&t->array[i]))
+      if (ispacked(t)) {
+        if (!ishole(packedarray(t)[i]))
+          unpacknum(t, gafqH_setnum(L, t, i+1), packedarray(t)[i]);
+      }
+      else if (!ttisnil(&t->array[i]))
         setobjt2t(L, gafqH_setnum(L, t, i+1), &t->array[i]);
     }
     /* shrink array */
-    gafqM_reallocvector(L, t->array, oldasize, nasize, TValue);
+    if (ispacked(t))
+      t->array = cast(TValue *, gafqM_realloc_(L, t->array,
+                                packedsize(oldasize), packedsize(nasize)));
+    else
+      gafqM_reallocvector(L, t->array, oldasize, nasize, TValue);
   }
   /* re-insert elements from hash part */
-  for (i = twoto(oldhsize) - 1; i >= 0; i--) {
-    Node *old = nold+i;
-    if (!ttisnil(gval(old)))
-      setobjt2t(L, gafqH_set(L, t, key2tval(old)), gval(old));
-  }
+  reinsert(L, t, nold, twoto(oldhsize));
   if (nold != dummynode)
-    gafqM_freearray(L, nold, twoto(oldhsize), Node);  /* free old array */
+    gafqM_freemem(L, nold, nodesize(twoto(oldhsize)));  /* free old array */
+  if (nmoving != NULL) {
+    reinsert(L, t, nmoving, movingsize);
+    gafqM_freemem(L, nmoving, nodesize(movingsize));
+  }
+  if (pk && !ispacked(t))
+    pack(L, t);
 }
 
 
 void gafqH_resizearray (gafq_State *L, Table *t, int nasize) {
-  int nsize = (t->node == dummynode) ? 0 : sizenode(t);
-  resize(L, t, nasize, nsize);
+  int nsize = (t->node == dummynode) ? 0 : nodecap(sizenode(t));
+  if (t->oldnode != NULL)
+    nsize += nodecap(twoto(t->oldlsize));
+  resize(L, t, nasize, nsize, NULL, NULL);
 }
 
 
-static void rehash (gafq_State *L, Table *t, const TValue *ek) {
+static void rehash (gafq_State *L, Table *t, const TValue *ek,
+                    const TValue *ev) {
   int nasize, na;
   int nums[MAXBITS+1];  /* nums[i] = number of keys between 2^(i-1) and 2^i */
   int i;
   int totaluse;
+  if (t->oldnode == NULL && growstep(L, t, ek))
+    return;
   for (i=0; i<=MAXBITS; i++) nums[i] = 0;  /* reset counts */
   nasize = numusearray(t, nums);  /* count keys in array part */
   totaluse = nasize;  /* all those keys are integer keys */
@@ -345,7 +986,7 @@ static void rehash (gafq_State *L, Table *t, const TValue *ek) {
   /* compute new size for array part */
   na = computesizes(nums, &nasize);
   /* resize the table to new computed sizes */
-  resize(L, t, nasize, totaluse - na);
+  resize(L, t, nasize, totaluse - na, ek, ev);
 }
 
 
@@ -363,8 +1004,13 @@ Table *gafqH_new (gafq_State *L, int narray, int nhash) {
   /* temporary values (kept only if some malloc fails) */
   t->array = NULL;
   t->sizearray = 0;
+  t->lenhint = -1;  /* no border found yet */
+  t->packed = 0;
   t->lsizenode = 0;
   t->node = cast(Node *, dummynode);
+  t->oldnode = NULL;
+  t->oldlsize = 0;
+  t->oldpos = 0;
   setarrayvector(L, t, narray);
   setnodevector(L, t, nhash);
   return t;
@@ -373,93 +1019,75 @@ Table *gafqH_new (gafq_State *L, int narray, int nhash) {
 
 void gafqH_free (gafq_State *L, Table *t) {
   if (t->node != dummynode)
-    gafqM_freearray(L, t->node, sizenode(t), Node);
-  gafqM_freearray(L, t->array, t->sizearray, TValue);
+    gafqM_freemem(L, t->node, nodesize(sizenode(t)));
+  if (t->oldnode != NULL)
+    gafqM_freemem(L, t->oldnode, nodesize(twoto(t->oldlsize)));
+  gafqM_freemem(L, t->array, arraysize(t));
   gafqM_free(L, t);
 }
 
 
-static Node *getfreepos (Table *t) {
-  while (t->lastfree-- > t->node) {
-    if (ttisnil(gkey(t->lastfree)))
-      return t->lastfree;
+/*
+** search function for integers
+*/
+const TValue *gafqH_getnum (Table *t, int key) {
+  /* (1 <= key && key <= t->sizearray) */
+  if (cast(unsigned int, key-1) < cast(unsigned int, t->sizearray)) {
+    gafq_assert(!ispacked(t));  /* (see gtable.h) */
+    return &t->array[key-1];
+  }
+  else {
+    Node *n = findnum(t, cast_num(key));
+    if (n == NULL && t->oldnode != NULL) {
+      Table v;
+      n = oldslot(findnum(oldpart(t, &v), cast_num(key)));
+    }
+    return (n != NULL) ? gval(n) : gafqO_nilobject;
   }
-  return NULL;  /* could not find a free place */
 }
 
 
-
 /*
-** inserts a new key into a hash table; first, check whether key's main 
-** position is free. If not, check whether colliding node is in its main 
-** position or not: if it is not, move colliding node to an empty place and 
-** put new key in its main position; otherwise (colliding node is in its main 
-** position), new key goes to an empty position. 
+** t[key], built in `v' when it is in a packed array part
 */
-static TValue *newkey (gafq_State *L, Table *t, const TValue *key) {
-  Node *mp = mainposition(t, key);
-  if (!ttisnil(gval(mp)) || mp == dummynode) {
-    Node *othern;
-    Node *n = getfreepos(t);  /* get a free place */
-    if (n == NULL) {  /* cannot find a free place? */
-      rehash(L, t, key);  /* grow table */
-      return gafqH_set(L, t, key);  /* re-insert key into grown table */
-    }
-    gafq_assert(n != dummynode);
-    othern = mainposition(t, key2tval(mp));
-    if (othern != mp) {  /* is colliding node out of its main position? */
-      /* yes; move colliding node into free position */
-      while (gnext(othern) != mp) othern = gnext(othern);  /* find previous */
-      gnext(othern) = n;  /* redo the chain with `n' in place of `mp' */
-      *n = *mp;  /* copy colliding node into free pos. (mp->next also goes) */
-      gnext(mp) = NULL;  /* now `mp' is free */
-      setnilvalue(gval(mp));
-    }
-    else {  /* colliding node is in its own main position */
-      /* new node will go into free position */
-      gnext(n) = gnext(mp);  /* chain new position */
-      gnext(mp) = n;
-      mp = n;
-    }
+const TValue *gafqH_getnumv (Table *t, int key, TValue *v) {
+  if (ispacked(t) &&
+      cast(unsigned int, key-1) < cast(unsigned int, t->sizearray)) {
+    gafq_Number x = packedarray(t)[key-1];
+    if (ishole(x)) return gafqO_nilobject;
+    unpacknum(t, v, x);
+    return v;
   }
-  gkey(mp)->value = key->value; gkey(mp)->tt = key->tt;
-  gafqC_barriert(L, t, key);
-  gafq_assert(ttisnil(gval(mp)));
-  return gval(mp);
+  return gafqH_getnum(t, key);
 }
 
 
 /*
-** search function for integers
+** search function for strings
 */
-const TValue *gafqH_getnum (Table *t, int key) {
-  /* (1 <= key && key <= t->sizearray) */
-  if (cast(unsigned int, key-1) < cast(unsigned int, t->sizearray))
-    return &t->array[key-1];
-  else {
-    gafq_Number nk = cast_num(key);
-    Node *n = hashnum(t, nk);
-    do {  /* check whether `key' is somewhere in the chain */
-      if (ttisnumber(gkey(n)) && gafqi_numeq(nvalue(gkey(n)), nk))
-        return gval(n);  /* that's it */
-      else n = gnext(n);
-    } while (n);
-    return gafqO_nilobject;
+const TValue *gafqH_getstr (Table *t, TString *key) {
+  Node *n = findstr(t, key);
+  if (n == NULL && t->oldnode != NULL) {
+    Table v;
+    n = oldslot(findstr(oldpart(t, &v), key));
   }
+  return (n != NULL) ? gval(n) : gafqO_nilobject;
 }
 
 
 /*
-** search function for strings
+** search function for strings that keeps an inline-cache hint: a valid
+** hint is used directly, otherwise the node found is recorded in it
 */
-const TValue *gafqH_getstr (Table *t, TString *key) {
-  Node *n = hashstr(t, key);
-  do {  /* check whether `key' is somewhere in the chain */
-    if (ttisstring(gkey(n)) && rawtsvalue(gkey(n)) == key)
-      return gval(n);  /* that's it */
-    else n = gnext(n);
-  } while (n);
-  return gafqO_nilobject;
+const TValue *gafqH_getstrhint (Table *t, TString *key, int *hint) {
+  Node *n;
+  if (gafqH_hintok(t, *hint, key))
+    return gval(gnode(t, *hint));
+  n = findstr(t, key);
+  if (n == NULL)  /* (entries of an old node part get no hint) */
+    return gafqH_getstr(t, key);
+  *hint = cast_int(n - t->node);
+  return gval(n);
 }
 
 
@@ -472,48 +1100,152 @@ const TValue *gafqH_get (Table *t, const TValue *key) {
     case GAFQ_TSTRING: return gafqH_getstr(t, rawtsvalue(key));
     case GAFQ_TNUMBER: {
       int k;
-      gafq_Number n = nvalue(key);
+      gafq_Number n;
+      if (ttisint(key) && cast_lint(cast_int(ivalue(key))) == ivalue(key))
+        return gafqH_getnum(t, cast_int(ivalue(key)));  /* no conversion */
+      n = nvalue(key);
       gafq_number2int(k, n);
       if (gafqi_numeq(cast_num(k), nvalue(key))) /* index is int? */
         return gafqH_getnum(t, k);  /* use specialized version */
       /* else go through */
     }
     default: {
-      Node *n = mainposition(t, key);
-      do {  /* check whether `key' is somewhere in the chain */
-        if (gafqO_rawequalObj(key2tval(n), key))
-          return gval(n);  /* that's it */
-        else n = gnext(n);
-      } while (n);
-      return gafqO_nilobject;
+      Node *n = findkey(t, key);
+      if (n == NULL && t->oldnode != NULL) {
+        Table v;
+        n = oldslot(findkey(oldpart(t, &v), key));
+      }
+      return (n != NULL) ? gval(n) : gafqO_nilobject;
     }
   }
 }
 
 
-TValue *gafqH_set (gafq_State *L, Table *t, const TValue *key) {
-  const TValue *p = gafqH_get(t, key);
-  t->flags = 0;
+/* t[key], as gafqH_getnumv */
+const TValue *gafqH_getv (Table *t, const TValue *key, TValue *v) {
+  if (ispacked(t)) {
+    int k = arrayindex(key);
+    if (cast(unsigned int, k-1) < cast(unsigned int, t->sizearray))
+      return gafqH_getnumv(t, k, v);
+  }
+  return gafqH_get(t, key);
+}
+
+
+/* store `v' in entry `i' of the packed array part of `t', if it can */
+static int packstore (Table *t, int i, const TValue *v) {
+  if (ttisnumber(v))
+    packnum(t, packedarray(t)[i], v)
+  else if (ttisnil(v))
+    sethole(packedarray(t)[i]);
+  else
+    return 0;
+  return 1;
+}
+
+
+/*
+** the slot for `key', or NULL once `v' (NULL if not known yet) has been
+** stored in a packed array part, as it is a number or nil; anything else
+** going to a packed array part unpacks it
+*/
+static TValue *setslot (gafq_State *L, Table *t, const TValue *key,
+                        const TValue *v) {
+  const TValue *p;
+  if (ispacked(t)) {
+    int k = arrayindex(key);
+    if (cast(unsigned int, k-1) < cast(unsigned int, t->sizearray)) {
+      if (v != NULL && packstore(t, k-1, v))
+        return NULL;
+      unpack(L, t);
+    }
+  }
+  p = gafqH_get(t, key);
   if (p != gafqO_nilobject)
     return cast(TValue *, p);
   else {
     if (ttisnil(key)) gafqG_runerror(L, "table index is nil");
     else if (ttisnumber(key) && gafqi_numisnan(nvalue(key)))
       gafqG_runerror(L, "table index is NaN");
-    return newkey(L, t, key);
+    return addkey(L, t, key, v);
   }
 }
 
 
+TValue *gafqH_set (gafq_State *L, Table *t, const TValue *key) {
+  t->flags = 0;
+  return setslot(L, t, key, NULL);
+}
+
+
 TValue *gafqH_setnum (gafq_State *L, Table *t, int key) {
-  const TValue *p = gafqH_getnum(t, key);
+  const TValue *p;
+  if (ispacked(t) &&
+      cast(unsigned int, key-1) < cast(unsigned int, t->sizearray))
+    unpack(L, t);
+  p = gafqH_getnum(t, key);
   if (p != gafqO_nilobject)
     return cast(TValue *, p);
   else {
     TValue k;
-    setnvalue(&k, cast_num(key));
-    return newkey(L, t, &k);
+    setivalue(&k, cast_lint(key));
+    return addkey(L, t, &k, NULL);
+  }
+}
+
+
+/*
+** t[key] = v; unlike a store into the slot from gafqH_set, it keeps a
+** packed array part packed when `v' is a number or nil
+*/
+void gafqH_setobj (gafq_State *L, Table *t, const TValue *key,
+                   const TValue *v) {
+  TValue *slot;
+  t->flags = 0;
+  slot = setslot(L, t, key, v);
+  if (slot != NULL) {
+    setobj2t(L, slot, v);
+    gafqC_barriert(L, t, v);
+  }
+}
+
+
+/* t[key] = v, as gafqH_setobj */
+void gafqH_setint (gafq_State *L, Table *t, int key, const TValue *v) {
+  TValue k;
+  if (cast(unsigned int, key-1) < cast(unsigned int, t->sizearray)) {
+    if (!ispacked(t)) {
+      setobj2t(L, &t->array[key-1], v);
+      gafqC_barriert(L, t, v);
+      return;
+    }
+    else if (packstore(t, key-1, v))
+      return;
+  }
+  setivalue(&k, cast_lint(key));
+  gafqH_setobj(L, t, &k, v);
+}
+
+
+/*
+** t[last-n+1 .. last] = v[0 .. n-1], for OP_SETLIST; the array part of a
+** constructor that starts with numbers is packed from its first batch
+*/
+void gafqH_setlist (gafq_State *L, Table *t, int last, const TValue *v,
+                    int n) {
+  if (last > t->sizearray)  /* needs more space? */
+    gafqH_resizearray(L, t, last);  /* pre-alloc it at once */
+#if defined(GAFQ_PACKEDARRAYS)
+  if (!ispacked(t) && last == n && t->sizearray >= MINPACKED &&
+      t->oldnode == NULL) {
+    int i = 0;
+    while (i < n && ttisnumber(v + i)) i++;
+    if (i == n && packable(t, t->sizearray, NULL, NULL) >= 0)
+      pack(L, t);
   }
+#endif
+  for (; n > 0; n--)
+    gafqH_setint(L, t, last--, v + n - 1);
 }
 
 
@@ -524,47 +1256,55 @@ TValue *gafqH_setstr (gafq_State *L, Table *t, TString *key) {
   else {
     TValue k;
     setsvalue(L, &k, key);
-    return newkey(L, t, &k);
+    return addkey(L, t, &k, NULL);
   }
 }
 
 
+/* is t[n] nil? */
+static int isnilnum (Table *t, int n) {
+  TValue v;
+  return ttisnil(gafqH_getnumv(t, n, &v));
+}
+
+
 static int unbound_search (Table *t, unsigned int j) {
   unsigned int i = j;  /* i is zero or a present index */
   j++;
   /* find `i' and `j' such that i is present and j is not */
-  while (!ttisnil(gafqH_getnum(t, j))) {
+  while (!isnilnum(t, j)) {
     i = j;
     j *= 2;
     if (j > cast(unsigned int, MAX_INT)) {  /* overflow? */
       /* table was built with bad purposes: resort to linear search */
       i = 1;
-      while (!ttisnil(gafqH_getnum(t, i))) i++;
+      while (!isnilnum(t, i)) i++;
       return i - 1;
     }
   }
   /* now do a binary search between them */
   while (j - i > 1) {
     unsigned int m = (i+j)/2;
-    if (ttisnil(gafqH_getnum(t, m))) j = m;
+    if (isnilnum(t, m)) j = m;
     else i = m;
   }
   return i;
 }
 
 
-/*
-** Try to find a boundary in table `t'. A `boundary' is an integer index
-** such that t[i] is non-nil and t[i+1] is nil (and 0 if t[1] is nil).
-*/
-int gafqH_getn (Table *t) {
+static int isborder (Table *t, int n) {
+  return (n == 0 || !isnilnum(t, n)) && isnilnum(t, n + 1);
+}
+
+
+static int findborder (Table *t) {
   unsigned int j = t->sizearray;
-  if (j > 0 && ttisnil(&t->array[j - 1])) {
+  if (j > 0 && isnilentry(t, j - 1)) {
     /* there is a boundary in the array part: (binary) search for it */
     unsigned int i = 0;
     while (j - i > 1) {
       unsigned int m = (i+j)/2;
-      if (ttisnil(&t->array[m - 1])) j = m;
+      if (isnilentry(t, m - 1)) j = m;
       else i = m;
     }
     return i;
@@ -576,6 +1316,45 @@ int gafqH_getn (Table *t) {
 }
 
 
+/*
+** Try to find a boundary in table `t'. A `boundary' is an integer index
+** such that t[i] is non-nil and t[i+1] is nil (and 0 if t[1] is nil).
+** Stores go through slots, so the table cannot see when they add or
+** remove its last element; instead, the last boundary found is kept in
+** `lenhint' and checked here. As it moves by at most one between calls
+** when elements are pushed or popped, `#t' is usually found with two or
+** three lookups and without any search. The first border of a table is
+** always searched for, so that `#{...}' finds the one it always found.
+*/
+int gafqH_getn (Table *t) {
+  int n = t->lenhint;
+  if (n < 0)  /* no border found yet? */
+    n = findborder(t);
+  else {
+    if (n > 0 && isnilnum(t, n))  /* last element removed? */
+      n--;
+    else if (n < MAX_INT && !isnilnum(t, n + 1))  /* added? */
+      n++;
+    if (!isborder(t, n))
+      n = findborder(t);
+  }
+  return t->lenhint = n;
+}
+
+
+/*
+** t[#t+1] = v. A full array part doubles instead of waiting for a rehash
+** to move the keys appended to the hash part.
+*/
+void gafqH_append (gafq_State *L, Table *t, const TValue *v) {
+  int n = gafqH_getn(t);
+  if (n == t->sizearray && n < MAXASIZE / 2)
+    gafqH_resizearray(L, t, (n < 4) ? 4 : 2 * n);
+  t->lenhint = n + 1;
+  gafqH_setint(L, t, n + 1, v);
+}
+
+
 
 #if defined(GAFQ_DEBUG)
 
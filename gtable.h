@@ -8,27 +8,109 @@
 #define gtable_h
 
 #include "gobject.h"
+#include "gstring.h"
 
 
 #define gnode(t,i)	(&(t)->node[i])
 #define gkey(n)		(&(n)->i_key.nk)
 #define gval(n)		(&(n)->i_val)
+#define key2tval(n)	(&(n)->i_key.tvk)
+
+/* the key of a node, from the address of its value */
+#define keyfromval(v) \
+	(gkey(cast(Node *, cast(char *, (v)) - offsetof(Node, i_val))))
+
+/*
+** With GAFQ_SWISSTABLE the node part is followed by a control byte for
+** each node and GROUPSIZE more bytes (see gtable.c); `nodesize' is the
+** size of the whole block for `n' nodes
+*/
+#if defined(GAFQ_SWISSTABLE)
+#define GROUPSIZE	16
+#define gctrl(t)	cast(lu_byte *, gnode(t, sizenode(t)))
+#define nodesize(n)	(cast(size_t, n) * (sizeof(Node) + 1) + GROUPSIZE)
+#else
 #define gnext(n)	((n)->i_key.nk.next)
+#define nodesize(n)	(cast(size_t, n) * sizeof(Node))
+#endif
 
-#define key2tval(n)	(&(n)->i_key.tvk)
+/*
+** check whether node 'h' of table 't' holds string key 'k' (as long
+** strings are not interned, maybe as another TString); a stale hint
+** (left over from before a rehash or from another table) simply fails
+*/
+#define gafqH_hintok(t,h,k) \
+	(cast(unsigned int, h) < cast(unsigned int, sizenode(t)) && \
+	 ttisstring(gkey(gnode(t,h))) && \
+	 gafqS_eqstr(k, rawtsvalue(gkey(gnode(t,h)))))
+
+
+/*
+** Packed array parts (GAFQ_PACKEDARRAYS): `sizearray' gafq_Numbers, with
+** no TValue to point to; so gafqH_getv and gafqH_getnumv build the values
+** they read there in a TValue of the caller, while gafqH_get and
+** gafqH_getnum give slots and must not be used for keys in them. Nil
+** entries are `holes', a NaN that stored numbers are never left as.
+** While only integers are stored the numbers come back as integers, and
+** as floats after that, so that their type stays the same.
+*/
+#define PACKEDINT	1
+#define PACKEDFLT	2
+
+#if defined(GAFQ_PACKEDARRAYS)
+#define ispacked(t)	((t)->packed)
+#define ishole(x) \
+	((x) != (x) && memcmp(&(x), gafqH_hole, sizeof(gafq_Number)) == 0)
+#define sethole(x)	memcpy(&(x), gafqH_hole, sizeof(gafq_Number))
+
+GAFQI_DATA const unsigned char gafqH_hole[sizeof(gafq_Number)];
+#else
+#define ispacked(t)	0
+#define ishole(x)	0
+#define sethole(x)	((void)0)
+#endif
+
+#define packedarray(t)	cast(gafq_Number *, (t)->array)
+#define packedsize(n)	(cast(size_t, n) * sizeof(gafq_Number))
+#define arraysize(t) \
+	(ispacked(t) ? packedsize((t)->sizearray) : \
+	               cast(size_t, (t)->sizearray) * sizeof(TValue))
+
+/* store number `o' in entry `x' of the packed array part of `t' */
+#define packnum(t,x,o) \
+	{ gafq_Number *p_ = &(x); \
+	  if (ttisint(o)) *p_ = cast_num(ivalue(o)); \
+	  else { \
+	    *p_ = fltvalue(o); (t)->packed = PACKEDFLT; \
+	    if (ishole(*p_)) *p_ = -*p_; } }
+
+/* TValue `o' := entry `x' of the packed array part of `t' */
+#define unpacknum(t,o,x) \
+	{ if ((t)->packed == PACKEDINT) setivalue(o, cast_lint(x)) \
+	  else setnvalue(o, x); }
 
 
 GAFQI_FUNC const TValue *gafqH_getnum (Table *t, int key);
+GAFQI_FUNC const TValue *gafqH_getnumv (Table *t, int key, TValue *v);
 GAFQI_FUNC TValue *gafqH_setnum (gafq_State *L, Table *t, int key);
 GAFQI_FUNC const TValue *gafqH_getstr (Table *t, TString *key);
+GAFQI_FUNC const TValue *gafqH_getstrhint (Table *t, TString *key, int *hint);
 GAFQI_FUNC TValue *gafqH_setstr (gafq_State *L, Table *t, TString *key);
 GAFQI_FUNC const TValue *gafqH_get (Table *t, const TValue *key);
+GAFQI_FUNC const TValue *gafqH_getv (Table *t, const TValue *key, TValue *v);
 GAFQI_FUNC TValue *gafqH_set (gafq_State *L, Table *t, const TValue *key);
+GAFQI_FUNC void gafqH_setobj (gafq_State *L, Table *t, const TValue *key,
+                              const TValue *v);
+GAFQI_FUNC void gafqH_setint (gafq_State *L, Table *t, int key,
+                              const TValue *v);
+GAFQI_FUNC void gafqH_setlist (gafq_State *L, Table *t, int last,
+                               const TValue *v, int n);
 GAFQI_FUNC Table *gafqH_new (gafq_State *L, int narray, int lnhash);
 GAFQI_FUNC void gafqH_resizearray (gafq_State *L, Table *t, int nasize);
 GAFQI_FUNC void gafqH_free (gafq_State *L, Table *t);
 GAFQI_FUNC int gafqH_next (gafq_State *L, Table *t, StkId key);
 GAFQI_FUNC int gafqH_getn (Table *t);
+GAFQI_FUNC void gafqH_append (gafq_State *L, Table *t, const TValue *v);
 
 
 #if defined(GAFQ_DEBUG)
@@ -253,11 +253,70 @@ static void auxsort (gafq_State *L, int l, int u) {
   }  /* repeat the routine for the larger one */
 }
 
+/*
+** auxsort over the numbers of a packed array (see gafq_tonumarray) with
+** `<' as the order: the same steps and checks, on a C array instead of
+** the stack, so both leave the same order, NaNs included (as checked by
+** test/sortnum.gafq). With `<' on numbers the scans always stop at
+** a[u-1] == P and at a[l], so the checks never fire and no index leaves
+** [l, u].
+*/
+#define A(i)	(a[(i)-1])
+#define swap(i,j)	{ gafq_Number t_ = A(i); A(i) = A(j); A(j) = t_; }
+
+static void numsort (gafq_State *L, gafq_Number *a, int l, int u) {
+  while (l < u) {  /* for tail recursion */
+    int i, j;
+    gafq_Number P;
+    /* sort elements a[l], a[(l+u)/2] and a[u] */
+    if (A(u) < A(l))
+      swap(l, u);
+    if (u-l == 1) break;  /* only 2 elements */
+    i = (l+u)/2;
+    if (A(i) < A(l))
+      swap(i, l)
+    else if (A(u) < A(i))
+      swap(i, u);
+    if (u-l == 2) break;  /* only 3 elements */
+    P = A(i);  /* Pivot */
+    swap(i, u-1);
+    /* a[l] <= P == a[u-1] <= a[u], only need to sort from l+1 to u-2 */
+    i = l; j = u-1;
+    for (;;) {  /* invariant: a[l..i] <= P <= a[j..u] */
+      while (A(++i) < P) {
+        if (i>u) gafqL_error(L, "invalid order function for sorting");
+      }
+      while (P < A(--j)) {
+        if (j<l) gafqL_error(L, "invalid order function for sorting");
+      }
+      if (j<i) break;
+      swap(i, j);
+    }
+    swap(u-1, i);  /* swap pivot (a[u-1]) with a[i] */
+    /* a[l..i-1] <= a[i] == P <= a[i+1..u] */
+    /* adjust so that smaller half is in [j..i] and larger one in [l..u] */
+    if (i-l < u-i) {
+      j=l; i=i-1; l=i+2;
+    }
+    else {
+      j=i+1; i=u; u=j-2;
+    }
+    numsort(L, a, j, i);  /* call recursively the smaller one */
+  }  /* repeat the routine for the larger one */
+}
+
 static int sort (gafq_State *L) {
   int n = aux_getn(L, 1);
   gafqL_checkstack(L, 40, "");  /* assume array is smaller than 2^40 */
   if (!gafq_isnoneornil(L, 2))  /* is there a 2nd argument? */
     gafqL_checktype(L, 2, GAFQ_TFUNCTION);
+  else {
+    gafq_Number *a = gafq_tonumarray(L, 1, n);
+    if (a != NULL) {  /* only numbers, in a packed array */
+      numsort(L, a, 1, n);
+      return 0;
+    }
+  }
   gafq_settop(L, 2);  /* make sure there is two arguments */
   auxsort(L, 1, n);
   return 0;
@@ -282,6 +341,7 @@ static const gafqL_Reg tab_funcs[] = {
 
 GAFQLIB_API int gafqopen_table (gafq_State *L) {
   gafqL_register(L, GAFQ_TABLIBNAME, tab_funcs);
+  gafq_setbuiltin(L, "table.insert", tinsert);  /* see OP_INTRINSIC */
   return 1;
 }
 
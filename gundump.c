@@ -17,6 +17,7 @@
 #include "gmem.h"
 #include "gobject.h"
 #include "gstring.h"
+#include "gtable.h"
 #include "gundump.h"
 #include "gzio.h"
 
@@ -73,6 +74,14 @@ static gafq_Number LoadNumber(LoadState* S)
  return x;
 }
 
+static l_int LoadInteger(LoadState* S)
+{
+ l_int x;
+ LoadVar(S,x);
+ IF (!fitsint(x), "bad constant");
+ return x;
+}
+
 static TString* LoadString(LoadState* S)
 {
  size_t size;
@@ -97,36 +106,58 @@ static void LoadCode(LoadState* S, Proto* f)
 
 static Proto* LoadFunction(LoadState* S, TString* p);
 
-static void LoadConstants(LoadState* S, Proto* f)
+static void LoadConstant(LoadState* S, TValue* o, int t)
 {
- int i,n;
- n=LoadInt(S);
- f->k=gafqM_newvector(S->L,n,TValue);
- f->sizek=n;
- for (i=0; i<n; i++) setnilvalue(&f->k[i]);
- for (i=0; i<n; i++)
+ switch (t)
  {
-  TValue* o=&f->k[i];
-  int t=LoadChar(S);
-  switch (t)
-  {
-   case GAFQ_TNIL:
-   	setnilvalue(o);
+  case GAFQ_TNIL:
+	setnilvalue(o);
 	break;
-   case GAFQ_TBOOLEAN:
-   	setbvalue(o,LoadChar(S)!=0);
+  case GAFQ_TBOOLEAN:
+	setbvalue(o,LoadChar(S)!=0);
 	break;
-   case GAFQ_TNUMBER:
+  case GAFQ_TNUMBER:
 	setnvalue(o,LoadNumber(S));
 	break;
-   case GAFQ_TSTRING:
+  case GAFQ_TNUMINT:
+	setivalue(o,LoadInteger(S));
+	break;
+  case GAFQ_TSTRING:
 	setsvalue2n(S->L,o,LoadString(S));
 	break;
-   default:
-	error(S,"bad constant");
+  case GAFQ_TTABLE:			/* cases of a SWITCH */
+  {
+	int j,n=LoadInt(S);
+	Table* h;
+	IF (n<0, "bad constant");
+	h=gafqH_new(S->L,0,n);
+	sethvalue(S->L,o,h);
+	for (j=1; j<=n; j++)
+	{
+	 TValue k;
+	 t=LoadChar(S);
+	 if (t==GAFQ_TNIL) continue;
+	 IF (t!=GAFQ_TSTRING && t!=GAFQ_TNUMBER && t!=GAFQ_TNUMINT, "bad constant");
+	 LoadConstant(S,&k,t);
+	 IF (ttisnumber(&k) && gafqi_numisnan(nvalue(&k)), "bad constant");
+	 setivalue(gafqH_set(S->L,h,&k),j);
+	}
 	break;
   }
+  default:
+	error(S,"bad constant");
+	break;
  }
+}
+
+static void LoadConstants(LoadState* S, Proto* f)
+{
+ int i,n;
+ n=LoadInt(S);
+ f->k=gafqM_newvector(S->L,n,TValue);
+ f->sizek=n;
+ for (i=0; i<n; i++) setnilvalue(&f->k[i]);
+ for (i=0; i<n; i++) LoadConstant(S,&f->k[i],LoadChar(S));
  n=LoadInt(S);
  f->p=gafqM_newvector(S->L,n,Proto*);
  f->sizep=n;
@@ -172,6 +203,7 @@ static Proto* LoadFunction(LoadState* S, TString* p)
  f->is_vararg=LoadByte(S);
  f->maxstacksize=LoadByte(S);
  LoadCode(S,f);
+ gafqF_initcache(S->L,f);
  LoadConstants(S,f);
  LoadDebug(S,f);
  IF (!gafqG_checkcode(f), "bad code");
@@ -223,5 +255,6 @@ void gafqU_header (char* h)
  *h++=(char)sizeof(size_t);
  *h++=(char)sizeof(Instruction);
  *h++=(char)sizeof(gafq_Number);
+ *h++=(char)sizeof(l_int);
  *h++=(char)(((gafq_Number)0.5)==0);		/* is gafq_Number integral? */
 }
@@ -22,6 +22,9 @@ GAFQI_FUNC int gafqU_dump (gafq_State* L, const Proto* f, gafq_Writer w, void* d
 #ifdef gafqc_c
 /* print one chunk; from print.c */
 GAFQI_FUNC void gafqU_print (const Proto* f, int full);
+
+/* optimize one chunk and check the result; from optimize.c */
+GAFQI_FUNC int gafqU_optimize (gafq_State* L, Proto* f);
 #endif
 
 /* for header of binary files -- this is Gafq 5.1 */
@@ -31,6 +34,6 @@ GAFQI_FUNC void gafqU_print (const Proto* f, int full);
 #define GAFQC_FORMAT		0
 
 /* size of header of binary files */
-#define GAFQC_HEADERSIZE		12
+#define GAFQC_HEADERSIZE		(sizeof(GAFQ_SIGNATURE)-1+9)
 
 #endif
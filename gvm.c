@@ -5,6 +5,8 @@
 */
 
 
+#include <ctype.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -18,6 +20,7 @@
 #include "gdo.h"
 #include "gfunc.h"
 #include "ggc.h"
+#include "gjit.h"
 #include "gobject.h"
 #include "gopcodes.h"
 #include "gstate.h"
@@ -31,11 +34,32 @@
 /* limit for table tag-method chains (to avoid loops) */
 #define MAXTAGLOOP	100
 
+/* limit for numerals read from substring views */
+#define MAXNUMERAL	200
+
+
+/*
+** the chars of a view (see gstring.c) are not followed by a `\0', so a
+** numeral in one is read from a copy, without the spaces around it
+*/
+static int str2d (const TString *ts, gafq_Number *result) {
+  const char *s = getstr(ts);
+  size_t l = ts->tsv.len;
+  char buff[MAXNUMERAL + 1];
+  if (!isview(ts)) return gafqO_str2d(s, result);
+  while (l > 0 && isspace(cast(unsigned char, *s))) s++, l--;
+  while (l > 0 && isspace(cast(unsigned char, s[l - 1]))) l--;
+  if (l > MAXNUMERAL) return 0;  /* too long for a numeral */
+  memcpy(buff, s, l);
+  buff[l] = '\0';
+  return gafqO_str2d(buff, result);
+}
+
 
 const TValue *gafqV_tonumber (const TValue *obj, TValue *n) {
   gafq_Number num;
   if (ttisnumber(obj)) return obj;
-  if (ttisstring(obj) && gafqO_str2d(svalue(obj), &num)) {
+  if (ttisstring(obj) && str2d(rawtsvalue(obj), &num)) {
     setnvalue(n, num);
     return n;
   }
@@ -111,7 +135,8 @@ void gafqV_gettable (gafq_State *L, const TValue *t, TValue *key, StkId val) {
     const TValue *tm;
     if (ttistable(t)) {  /* `t' is a table? */
       Table *h = hvalue(t);
-      const TValue *res = gafqH_get(h, key); /* do a primitive get */
+      TValue v;
+      const TValue *res = gafqH_getv(h, key, &v); /* do a primitive get */
       if (!ttisnil(res) ||  /* result is no nil? */
           (tm = fasttm(L, h->metatable, TM_INDEX)) == NULL) { /* or no TM? */
         setobj2s(L, val, res);
@@ -138,14 +163,15 @@ void gafqV_settable (gafq_State *L, const TValue *t, TValue *key, StkId val) {
     const TValue *tm;
     if (ttistable(t)) {  /* `t' is a table? */
       Table *h = hvalue(t);
-      TValue *oldval = gafqH_set(L, h, key); /* do a primitive set */
-      if (!ttisnil(oldval) ||  /* result is no nil? */
-          (tm = fasttm(L, h->metatable, TM_NEWINDEX)) == NULL) { /* or no TM? */
-        setobj2t(L, oldval, val);
-        h->flags = 0;
-        gafqC_barriert(L, h, val);
+      TValue v;
+      const TValue *oldval = NULL;
+      if ((tm = fasttm(L, h->metatable, TM_NEWINDEX)) == NULL ||  /* no TM? */
+          !ttisnil(oldval = gafqH_getv(h, key, &v))) {  /* or no nil? */
+        gafqH_setobj(L, h, key, val);
         return;
       }
+      if (oldval == gafqO_nilobject)
+        gafqH_set(L, h, key);  /* new key: checked and added before the TM */
       /* else will try the tag method */
     }
     else if (ttisnil(tm = gafqT_gettmbyobj(L, t, TM_NEWINDEX)))
@@ -161,6 +187,58 @@ void gafqV_settable (gafq_State *L, const TValue *t, TValue *key, StkId val) {
   gafqG_runerror(L, "loop in settable");
 }
 
+
+/*
+** Inline caches.  An instruction indexing with a constant string key owns
+** a slot hint in 'icache' naming the node where the key was last found.
+** A hint is only trusted after checking the key stored in that node, so
+** it needs no invalidation when a table is rehashed or resized and may be
+** shared by every table the instruction sees (e.g. objects of one class).
+** Global accesses cache slots of the closure's environment the same way,
+** so a table installed by setfenv is checked like any other.
+*/
+void gafqV_gettablecached (gafq_State *L, const TValue *t, TValue *key,
+                           StkId val, int *ic) {
+  int loop;
+  for (loop = 0; loop < MAXTAGLOOP; loop++) {
+    const TValue *tm;
+    if (ttistable(t)) {  /* `t' is a table? */
+      Table *h = hvalue(t);
+      const TValue *res = gafqH_getstrhint(h, rawtsvalue(key), ic);
+      if (!ttisnil(res) ||  /* result is no nil? */
+          (tm = fasttm(L, h->metatable, TM_INDEX)) == NULL) { /* or no TM? */
+        setobj2s(L, val, res);
+        return;
+      }
+      /* else will try the tag method */
+    }
+    else if (ttisnil(tm = gafqT_gettmbyobj(L, t, TM_INDEX)))
+      gafqG_typeerror(L, t, "index");
+    if (ttisfunction(tm)) {
+      callTMres(L, val, tm, t, key);
+      return;
+    }
+    t = tm;  /* else repeat with `tm' */
+  }
+  gafqG_runerror(L, "loop in gettable");
+}
+
+
+void gafqV_settablecached (gafq_State *L, const TValue *t, TValue *key,
+                           StkId val, int *ic) {
+  if (ttistable(t)) {
+    Table *h = hvalue(t);
+    TValue *oldval = cast(TValue *, gafqH_getstrhint(h, rawtsvalue(key), ic));
+    if (!ttisnil(oldval)) {  /* existing field? assign in place */
+      setobj2t(L, oldval, val);
+      h->flags = 0;
+      gafqC_barriert(L, h, val);
+      return;
+    }
+  }
+  gafqV_settable(L, t, key, val);  /* new key, metamethods, errors */
+}
+
 //在gafqV_execute的加减运算,如果不是数字类型,会走到这里
 static int call_binTM (gafq_State *L, const TValue *p1, const TValue *p2,
                        StkId res, TMS event) {
@@ -200,10 +278,10 @@ static int call_orderTM (gafq_State *L, const TValue *p1, const TValue *p2,
 }
 
 
-static int l_strcmp (const TString *ls, const TString *rs) {
-  const char *l = getstr(ls);
+static int l_strcmp (gafq_State *L, TString *ls, TString *rs) {
+  const char *l = getstr(gafqS_unview(L, ls));  /* strcoll needs the `\0' */
   size_t ll = ls->tsv.len;
-  const char *r = getstr(rs);
+  const char *r = getstr(gafqS_unview(L, rs));
   size_t lr = rs->tsv.len;
   for (;;) {
     int temp = strcoll(l, r);
@@ -229,21 +307,21 @@ int gafqV_lessthan (gafq_State *L, const TValue *l, const TValue *r) {
   else if (ttisnumber(l))
     return gafqi_numlt(nvalue(l), nvalue(r));
   else if (ttisstring(l))
-    return l_strcmp(rawtsvalue(l), rawtsvalue(r)) < 0;
+    return l_strcmp(L, rawtsvalue(l), rawtsvalue(r)) < 0;
   else if ((res = call_orderTM(L, l, r, TM_LT)) != -1)
     return res;
   return gafqG_ordererror(L, l, r);
 }
 
 
-static int lessequal (gafq_State *L, const TValue *l, const TValue *r) {
+int gafqV_lessequal (gafq_State *L, const TValue *l, const TValue *r) {
   int res;
   if (ttype(l) != ttype(r))
     return gafqG_ordererror(L, l, r);
   else if (ttisnumber(l))
     return gafqi_numle(nvalue(l), nvalue(r));
   else if (ttisstring(l))
-    return l_strcmp(rawtsvalue(l), rawtsvalue(r)) <= 0;
+    return l_strcmp(L, rawtsvalue(l), rawtsvalue(r)) <= 0;
   else if ((res = call_orderTM(L, l, r, TM_LE)) != -1)  /* first try `le' */
     return res;
   else if ((res = call_orderTM(L, r, l, TM_LT)) != -1)  /* else try `lt' */
@@ -260,6 +338,7 @@ int gafqV_equalval (gafq_State *L, const TValue *t1, const TValue *t2) {
     case GAFQ_TNUMBER: return gafqi_numeq(nvalue(t1), nvalue(t2));
     case GAFQ_TBOOLEAN: return bvalue(t1) == bvalue(t2);  /* true must be 1 !! */
     case GAFQ_TLIGHTUSERDATA: return pvalue(t1) == pvalue(t2);
+    case GAFQ_TSTRING: return gafqS_eqstr(rawtsvalue(t1), rawtsvalue(t2));
     case GAFQ_TUSERDATA: {
       if (uvalue(t1) == uvalue(t2)) return 1;
       tm = get_compTM(L, uvalue(t1)->metatable, uvalue(t2)->metatable,
@@ -314,10 +393,128 @@ void gafqV_concat (gafq_State *L, int total, int last) {
 }
 
 
-static void Arith (gafq_State *L, StkId ra, const TValue *rb,
-                   const TValue *rc, TMS op) {
+/*
+** MOD of integers must give `a - floor(a/b)*b' (see `gafqi_nummod'),
+** which a gafq_Number computes exactly only while both operands fit in
+** 32 bits; larger ones take the gafq_Number path
+*/
+#define MODLIMIT	cast_lint(0x7fffffffL)
+#define modint(a)	(-MODLIMIT-1 <= (a) && (a) <= MODLIMIT)
+
+static l_int intmod_ (l_int a, l_int b) {
+  l_int r = (b == -1) ? 0 : cast_int(a) % cast_int(b);
+  if (r != 0 && (r ^ b) < 0)  /* result must have the sign of 'b' */
+    r += b;
+  return r;
+}
+
+/* integer operations; false when the result would leave the subtype */
+#define intadd(a,b,r)	((r) = (a) + (b), fitslint(r))
+#define intsub(a,b,r)	((r) = (a) - (b), fitslint(r))
+/*
+** products of operands below MULLIMIT are always in range; otherwise
+** 'a*b' cannot overflow once its approximation is in range (and 0*-1
+** is -0, which only a gafq_Number holds)
+*/
+#define MULLIMIT  (GAFQI_MAXINT >> (GAFQI_MAXINT > 0x7fffffffL ? 27 : 16))
+#define smallint(a)	(cast(lu_int, (a) + MULLIMIT) <= cast(lu_int, 2*MULLIMIT))
+#define intmul(a,b,r) \
+	(((smallint(a) && smallint(b)) || \
+	  fitsint(gafqi_nummul(cast_num(a), cast_num(b)))) && \
+	 ((r) = (a) * (b), fitslint(r)) && ((r) != 0 || ((a) >= 0 && (b) >= 0)))
+#define intmod(a,b,r) \
+	((b) != 0 && modint(a) && modint(b) && ((r) = intmod_(a, b), 1))
+
+
+/*
+** prepare a numeric for loop to run over the integer subtype, which needs
+** an integer initial value and step; the limit is rounded towards the
+** initial value (no iteration changes) and clamped in the direction of
+** the loop.  Returns 0 if the loop must run over gafq_Number instead.
+*/
+static int forprepint (StkId ra) {
+  l_int init, step, limit;
+  if (!ttisint(ra) || !ttisint(ra+2)) return 0;
+  init = ivalue(ra);
+  step = ivalue(ra+2);
+  if (ttisint(ra+1))
+    limit = ivalue(ra+1);
+  else {
+    gafq_Number l = nvalue(ra+1);
+    if (0 < step ? l >= cast_num(GAFQI_MAXINT) : l <= cast_num(-GAFQI_MAXINT))
+      limit = (0 < step) ? GAFQI_MAXINT : -GAFQI_MAXINT;
+    else if (fitsint(l))  /* (false for NaN) */
+      limit = cast_lint((0 < step) ? floor(l) : ceil(l));
+    else
+      return 0;  /* loop does not run; no point in converting it */
+  }
+  if (!fitsint(init - step)) return 0;
+  setivalue(ra, init - step);
+  setivalue(ra+1, limit);
+  return 1;
+}
+
+
+/*
+** check and prepare the control values of a numeric for loop (OP_FORPREP)
+*/
+void gafqV_forprep (gafq_State *L, StkId ra) {
+  const TValue *init = ra;
+  const TValue *plimit = ra+1;
+  const TValue *pstep = ra+2;
+  if (!tonumber(init, ra))
+    gafqG_runerror(L, GAFQ_QL("for") " initial value must be a number");
+  else if (!tonumber(plimit, ra+1))
+    gafqG_runerror(L, GAFQ_QL("for") " limit must be a number");
+  else if (!tonumber(pstep, ra+2))
+    gafqG_runerror(L, GAFQ_QL("for") " step must be a number");
+  if (!forprepint(ra))
+    setnvalue(ra, gafqi_numsub(nvalue(ra), nvalue(pstep)));
+}
+
+
+void gafqV_objlen (gafq_State *L, StkId ra, const TValue *rb) {
+  switch (ttype(rb)) {
+    case GAFQ_TTABLE: {
+      setivalue(ra, cast_lint(gafqH_getn(hvalue(rb))));
+      break;
+    }
+    case GAFQ_TSTRING: {
+      setivalue(ra, cast_lint(tsvalue(rb)->len));
+      break;
+    }
+    default: {  /* try metamethod */
+      if (!call_binTM(L, rb, gafqO_nilobject, ra, TM_LEN))
+        gafqG_typeerror(L, rb, "get length of");
+    }
+  }
+}
+
+
+/*
+** complete semantics of the arithmetic opcodes, for operands that missed
+** the fast paths of the interpreter (and for compiled code, see 'gjit.c')
+*/
+void gafqV_arith (gafq_State *L, StkId ra, const TValue *rb,
+                  const TValue *rc, TMS op) {
   TValue tempb, tempc;
   const TValue *b, *c;
+  if (ttisint(rb) && ttisint(rc)) {
+    l_int ib = ivalue(rb), ic = ivalue(rc), ir = 0;
+    int ok;
+    switch (op) {
+      case TM_ADD: ok = intadd(ib, ic, ir); break;
+      case TM_SUB: ok = intsub(ib, ic, ir); break;
+      case TM_MUL: ok = intmul(ib, ic, ir); break;
+      case TM_MOD: ok = intmod(ib, ic, ir); break;
+      case TM_UNM: ok = (ib != 0); ir = -ib; break;  /* -0 is not an integer */
+      default: ok = 0; break;
+    }
+    if (ok) {
+      setivalue(ra, ir);
+      return;
+    }
+  }
   if ((b = gafqV_tonumber(rb, &tempb)) != NULL &&
       (c = gafqV_tonumber(rc, &tempc)) != NULL) {
     gafq_Number nb = nvalue(b), nc = nvalue(c);
@@ -342,7 +539,7 @@ static void Arith (gafq_State *L, StkId ra, const TValue *rb,
 ** some macros for common tasks in `gafqV_execute'
 */
 
-#define runtime_check(L, c)	{ if (!(c)) break; }
+#define runtime_check(L, c)	{ if (!(c)) vmbreak; }
 
 #define RA(i)	(base+GETARG_A(i))
 /* to be used after possible stack reallocation */
@@ -354,11 +551,41 @@ static void Arith (gafq_State *L, StkId ra, const TValue *rb,
 	ISK(GETARG_C(i)) ? k+INDEXK(GETARG_C(i)) : base+GETARG_C(i))
 #define KBx(i)	check_exp(getBMode(GET_OPCODE(i)) == OpArgK, k+GETARG_Bx(i))
 
+/* inline cache of the current instruction */
+#define IC()	(cl->p->icache + pcRel(pc, cl->p))
+#define iskstr(r)	(ISK(r) && ttisstring(k+INDEXK(r)))
+#define hintslot(h,ic)	gval(gnode(h, *(ic)))
+#define cachehit(h,key,ic) \
+	(gafqH_hintok(h, *(ic), rawtsvalue(key)) && !ttisnil(hintslot(h,ic)))
 
-#define dojump(L,pc,i)	{(pc) += (i); gafqi_threadyield(L);}
+/* is integer 'key' inside the array part of table 't'? */
+#define inarray(t,key) \
+	(ttisint(key) && \
+	 cast(lu_int, ivalue(key)-1) < cast(lu_int, hvalue(t)->sizearray))
+#define arrayslot(t,key)	(&hvalue(t)->array[ivalue(key)-1])
+#define packedslot(t,key)	(packedarray(hvalue(t))[ivalue(key)-1])
 
 
-#define Protect(x)	{ L->savedpc = pc; {x;}; base = L->base; }
+#define dojump(L,pc,i)	{(pc) += (i); gafqi_threadyield(L); updatemode(L);}
+
+
+#define Protect(x)	{ L->savedpc = pc; {x;}; base = L->base; updatemode(L); }
+
+
+/*
+** with GAFQ_USE_JIT, loop iterations count towards compiling a function
+** like calls do; once the count is reached, `gafqJ_execute' (at
+** `reentry') compiles the function and continues the loop there
+** (not while hooks are on: `traceexec' relies on `savedpc')
+*/
+#if defined(GAFQ_USE_JIT)
+#define jitloop(L)	{ if (!hookcheck(L) && \
+			      cl->p->jitcount < GAFQI_JITCALLS && \
+			      ++cl->p->jitcount == GAFQI_JITCALLS) { \
+			    L->savedpc = pc; goto reentry; } }
+#else
+#define jitloop(L)	{}
+#endif
 
 // 这个好像是执行器中解析运算符的
 #define arith_op(op,tm) { \
@@ -369,228 +596,656 @@ static void Arith (gafq_State *L, StkId ra, const TValue *rb,
           setnvalue(ra, op(nb, nc)); \
         } \
         else \
-          Protect(Arith(L, ra, rb, rc, tm)); \
+          Protect(gafqV_arith(L, ra, rb, rc, tm)); \
+      }
+
+
+/*
+** Operations with both operands in the integer subtype stay there as
+** long as the exact result does ('iop' fails otherwise, and the result
+** is then computed over gafq_Number as before).
+*/
+#define arith_iop(op,iop,tm) { \
+        TValue *rb = RKB(i); \
+        TValue *rc = RKC(i); \
+        l_int ir; \
+        if (ttisint(rb) && ttisint(rc) && iop(ivalue(rb), ivalue(rc), ir)) { \
+          setivalue(ra, ir); \
+        } \
+        else if (ttisflt(rb) && ttisflt(rc)) { \
+          setnvalue(ra, op(fltvalue(rb), fltvalue(rc))); \
+        } \
+        else if (ttisnumber(rb) && ttisnumber(rc)) { \
+          gafq_Number nb = nvalue(rb), nc = nvalue(rc); \
+          setnvalue(ra, op(nb, nc)); \
+        } \
+        else \
+          Protect(gafqV_arith(L, ra, rb, rc, tm)); \
       }
 
 
+/*
+** Quickening: ADD, SUB, MUL, DIV, EQ, LT and LE rewrite themselves (in
+** the `code' shared by all closures of the prototype) into a variant for
+** the operand types they just met, which needs a single type guard. A
+** variant that meets other types writes the generic opcode back and runs
+** the generic code; after MAXQUICKEN such misses, counted in the unused
+** inline cache of the instruction, it stays generic.
+*/
+#define MAXQUICKEN	8
+
+#define setop(o)	SET_OPCODE(*cast(Instruction *, pc - 1), o)
+#define quicken(o)	{ if (*IC() < MAXQUICKEN) setop(o); }
+#define unquicken(o)	{ setop(o); (*IC())++; }
+
+/* variant for two integers or two floats */
+#define quickpair(qi,qf) { \
+        const TValue *qb = RKB(i); \
+        const TValue *qc = RKC(i); \
+        if (ttisint(qb) && ttisint(qc)) quicken(qi) \
+        else if (ttisflt(qb) && ttisflt(qc)) quicken(qf) \
+      }
+
+#define arith_qint(iop,tm,gop) { \
+        TValue *rb = RKB(i); \
+        TValue *rc = RKC(i); \
+        l_int ir; \
+        if (ttisint(rb) && ttisint(rc)) { \
+          if (iop(ivalue(rb), ivalue(rc), ir)) { \
+            setivalue(ra, ir); \
+          } \
+          else \
+            Protect(gafqV_arith(L, ra, rb, rc, tm)); \
+        } \
+        else { \
+          unquicken(gop); \
+          Protect(gafqV_arith(L, ra, rb, rc, tm)); \
+        } \
+      }
+
+#define arith_qflt(op,tm,gop) { \
+        TValue *rb = RKB(i); \
+        TValue *rc = RKC(i); \
+        if (ttisflt(rb) && ttisflt(rc)) { \
+          setnvalue(ra, op(fltvalue(rb), fltvalue(rc))); \
+        } \
+        else { \
+          unquicken(gop); \
+          Protect(gafqV_arith(L, ra, rb, rc, tm)); \
+        } \
+      }
+
+/* `res' compares `rb' and `rc' when both pass `is'; `cmp' otherwise */
+#define compare_q(is,res,cmp,gop) { \
+        TValue *rb = RKB(i); \
+        TValue *rc = RKC(i); \
+        if (is(rb) && is(rc)) { \
+          if ((res) == GETARG_A(i)) \
+            dojump(L, pc, GETARG_sBx(*pc)); \
+        } \
+        else { \
+          unquicken(gop); \
+          Protect( \
+            if (cmp(L, rb, rc) == GETARG_A(i)) \
+              dojump(L, pc, GETARG_sBx(*pc)); \
+          ) \
+        } \
+        pc++; \
+      }
+
+
+#define getglobal() { \
+        TValue *rb = KBx(i); \
+        int *ic = IC(); \
+        gafq_assert(ttisstring(rb)); \
+        if (cachehit(cl->env, rb, ic)) { \
+          setobj2s(L, ra, hintslot(cl->env, ic)); \
+        } \
+        else { \
+          TValue g; \
+          sethvalue(L, &g, cl->env); \
+          Protect(gafqV_gettablecached(L, &g, rb, ra, ic)); \
+        } \
+      }
+
+#define gettable() { \
+        StkId rb = RB(i); \
+        TValue *rc = RKC(i); \
+        if (iskstr(GETARG_C(i))) { \
+          int *ic = IC(); \
+          if (ttistable(rb) && cachehit(hvalue(rb), rc, ic)) { \
+            setobj2s(L, ra, hintslot(hvalue(rb), ic)); \
+          } \
+          else \
+            Protect(gafqV_gettablecached(L, rb, rc, ra, ic)); \
+        } \
+        else if (ttistable(rb) && inarray(rb, rc) && \
+                 !ispacked(hvalue(rb)) && !ttisnil(arrayslot(rb, rc))) { \
+          setobj2s(L, ra, arrayslot(rb, rc)); \
+        } \
+        else if (ttistable(rb) && inarray(rb, rc) && \
+                 ispacked(hvalue(rb)) && !ishole(packedslot(rb, rc))) { \
+          unpacknum(hvalue(rb), ra, packedslot(rb, rc)); \
+        } \
+        else \
+          Protect(gafqV_gettable(L, rb, rc, ra)); \
+      }
+
+
+/*
+** Superinstructions (see `gafqK_fuse'): after its first half, fetch the
+** instruction that follows and run it in the same dispatch, unless hooks
+** have to see it on its own.
+*/
+#define fusenext()	{ if (hookcheck(L)) vmbreak; i = *pc++; ra = RA(i); }
+
+
+/* is `o' the C function the libraries gave for builtin `b'? */
+#define isbuiltin(L,o,b)	(ttisfunction(o) && clvalue(o)->c.isC && \
+	clvalue(o)->c.f == G(L)->builtin[b])
+
+
+/*
+** `select(x, ...)': the OP_VARARG at `ra' is about to copy the `n'
+** varargs at `va' as arguments for `call', a call to `select' at `ra-2'.
+** Put the results of that call in place straight from `va' instead and
+** return 1; return 0 if `select' has to run after all (e.g., to raise
+** an error).
+*/
+static int selectva (gafq_State *L, StkId ra, Instruction call, StkId va,
+                     int n) {
+  StkId res = ra - 2;
+  const TValue *x = ra - 1;
+  int wanted = GETARG_C(call) - 1;
+  int nres, j = 0;
+  if (ttisstring(x) && *svalue(x) == '#') {
+    setivalue(res, cast_lint(n));
+    nres = j = 1;  /* the count is the only result */
+  }
+  else if (ttisint(x)) {
+    l_int k = ivalue(x);
+    if (k < 0) k += n + 1;
+    else if (k > n + 1) k = n + 1;
+    if (k < 1) return 0;  /* index out of range */
+    va += k - 1;
+    nres = n - cast_int(k - 1);
+  }
+  else return 0;
+  if (wanted == GAFQ_MULTRET) wanted = nres;
+  for (; j < wanted; j++) {
+    if (j < nres) {
+      setobjs2s(L, res + j, va + j);
+    }
+    else {
+      setnilvalue(res + j);
+    }
+  }
+  L->top = (GETARG_C(call) == 0) ? res + nres : L->ci->top;
+  return 1;
+}
+
+
+/*
+** OP_INTRINSIC: if the function at `ra' is builtin `b' and its arguments
+** are the plain numbers (string and integer, table and value) it expects,
+** leave its results at `ra', adjusted to `nresults', and return 1; return
+** 0 when it must be called after all (also to raise its errors or run
+** call hooks).
+*/
+int gafqV_intrinsic (gafq_State *L, StkId ra, int b, int nresults) {
+  const TValue *x = ra + 1;
+  const TValue *y = ra + 2;
+  int nres = 1;
+  if (!isbuiltin(L, ra, b) || (L->hookmask & (GAFQ_MASKCALL | GAFQ_MASKRET)))
+    return 0;
+  if (b == BI_INSERT) {  /* raw, as `table.insert' */
+    if (!ttistable(x)) return 0;
+    gafqH_append(L, hvalue(x), y);
+    nres = 0;
+  }
+  else if (b == BI_BYTE) {
+    l_int pos;
+    size_t l;
+    if (!ttisstring(x) || !ttisint(y)) return 0;
+    l = tsvalue(x)->len;
+    pos = ivalue(y);
+    if (pos < 0) pos += cast_lint(l) + 1;
+    if (pos < 1 || cast(size_t, pos) > l) return 0;  /* no result */
+    setivalue(ra, cast_byte(getstr(rawtsvalue(x))[pos - 1]));
+  }
+  else {
+    gafq_Number n;
+    if (!ttisnumber(x) || (biargs(b) > 1 && !ttisnumber(y))) return 0;
+    n = nvalue(x);
+    switch (b) {
+      case BI_FLOOR: n = floor(n); break;
+      case BI_ABS: n = fabs(n); break;
+      case BI_SQRT: n = sqrt(n); break;
+      case BI_MIN: if (nvalue(y) < n) n = nvalue(y); break;
+      case BI_MAX: if (nvalue(y) > n) n = nvalue(y); break;
+      default: gafq_assert(0);
+    }
+    setnvalue(ra, n);
+  }
+  if (nresults == GAFQ_MULTRET) L->top = ra + nres;
+  else {
+    int j;
+    for (j = nres; j < nresults; j++) setnilvalue(ra + j);
+  }
+  return 1;
+}
+
+
+
+/*
+** the interpreter loop comes in two variants: a fast one that never looks
+** at hooks and an instrumented one that runs `traceexec' before each
+** instruction. The variant is chosen again whenever control comes back
+** from code that may have called `gafq_sethook' (calls, metamethods, the
+** GC) and on every jump, so that an asynchronous `gafq_sethook' (e.g.,
+** from a signal handler) is noticed at the latest on the next loop
+** iteration. The instrumented variant falls back to the fast one by
+** itself as soon as the hooks are gone.
+*/
+#define hookcheck(L)	((L)->hookmask & (GAFQ_MASKLINE | GAFQ_MASKCOUNT))
+
+#define dohook(L)	{ \
+  if (--L->hookcount == 0 || L->hookmask & GAFQ_MASKLINE) { \
+    traceexec(L, pc); \
+    if (L->status == GAFQ_YIELD) {  /* did hook yield? */ \
+      L->savedpc = pc - 1; \
+      return; \
+    } \
+    base = L->base; \
+    ra = RA(i); \
+  } \
+}
+
+
+/*
+** instruction dispatch: with GAFQ_USE_JUMPTABLE every opcode body ends
+** by fetching and jumping straight to the next one (direct threading),
+** so each opcode gets its own indirect branch; the instrumented variant
+** is a second table whose entries all lead to the hook code. Otherwise
+** all opcodes go back through a single `switch'.
+*/
+#if defined(GAFQ_USE_JUMPTABLE)
+
+#define updatemode(L)	(disp = hookcheck(L) ? hooktab : disptab)
+
+#define vmfetch()	{ i = *pc++; ra = RA(i); }
+#define vmdispatch(o)	goto *disp[o];
+#define vmcase(l)	L_##l:
+#define vmbreak		{ vmfetch(); vmdispatch(GET_OPCODE(i)); }
+
+#else
+
+#define updatemode(L)	(hooked = hookcheck(L))
+
+#define vmfetch()	{ \
+  i = *pc++; \
+  ra = RA(i); \
+  if (hooked) { \
+    if (hookcheck(L)) dohook(L) \
+    else hooked = 0; \
+  } \
+}
+#define vmdispatch(o)	switch (o)
+#define vmcase(l)	case l:
+#define vmbreak		continue
+
+#endif
+
+
 // 这里像是要执行gafq的内容
 void gafqV_execute (gafq_State *L, int nexeccalls) {
   LClosure *cl;
   StkId base;
   TValue *k;
   const Instruction *pc;
+  Instruction i;
+  StkId ra;
+#if defined(GAFQ_USE_JUMPTABLE)
+#define HOOK8	&&L_HOOK, &&L_HOOK, &&L_HOOK, &&L_HOOK, \
+		&&L_HOOK, &&L_HOOK, &&L_HOOK, &&L_HOOK
+  /* labels of opcode bodies (ORDER OP) */
+  static const void *const disptab[1<<SIZE_OP] = {
+    &&L_OP_MOVE, &&L_OP_LOADK, &&L_OP_LOADBOOL, &&L_OP_LOADNIL,
+    &&L_OP_GETUPVAL, &&L_OP_GETGLOBAL, &&L_OP_GETTABLE, &&L_OP_SETGLOBAL,
+    &&L_OP_SETUPVAL, &&L_OP_SETTABLE, &&L_OP_NEWTABLE, &&L_OP_SELF,
+    &&L_OP_ADD, &&L_OP_SUB, &&L_OP_MUL, &&L_OP_DIV, &&L_OP_MOD, &&L_OP_POW,
+    &&L_OP_UNM, &&L_OP_NOT, &&L_OP_LEN, &&L_OP_CONCAT, &&L_OP_JMP,
+    &&L_OP_EQ, &&L_OP_LT, &&L_OP_LE, &&L_OP_TEST, &&L_OP_TESTSET,
+    &&L_OP_CALL, &&L_OP_TAILCALL, &&L_OP_RETURN, &&L_OP_FORLOOP,
+    &&L_OP_FORPREP, &&L_OP_TFORLOOP, &&L_OP_SETLIST, &&L_OP_CLOSE,
+    &&L_OP_CLOSURE, &&L_OP_VARARG, &&L_OP_SWITCH, &&L_OP_INTRINSIC,
+    &&L_OP_APPEND,
+    &&L_OP_MOVE2, &&L_OP_MOVECALL, &&L_OP_GETTABLE2, &&L_OP_GLOBALGET,
+    &&L_OP_ADDI, &&L_OP_SUBI, &&L_OP_MULI, &&L_OP_ADDF, &&L_OP_SUBF,
+    &&L_OP_MULF, &&L_OP_DIVF, &&L_OP_EQI, &&L_OP_EQS, &&L_OP_LTI,
+    &&L_OP_LEI, &&L_OP_LTF, &&L_OP_LEF
+  };
+  /* instrumented variant: every opcode goes through the hook first */
+  static const void *const hooktab[1<<SIZE_OP] = {
+    HOOK8, HOOK8, HOOK8, HOOK8, HOOK8, HOOK8, HOOK8, HOOK8
+  };
+  const void *const *disp;
+#undef HOOK8
+#else
+  int hooked;
+#endif
  reentry:  /* entry point */
   gafq_assert(isGafq(L->ci));
+#if defined(GAFQ_USE_JIT)
+  if ((nexeccalls = gafqJ_execute(L, nexeccalls)) < 0)
+    return;  /* compiled code returned from the last frame or yielded */
+#endif
   pc = L->savedpc;
   cl = &clvalue(L->ci->func)->l;
   base = L->base;
   k = cl->p->k;
+  updatemode(L);
   /* main loop of interpreter */
   for (;;) {
-    const Instruction i = *pc++;
-    StkId ra;
-    if ((L->hookmask & (GAFQ_MASKLINE | GAFQ_MASKCOUNT)) &&
-        (--L->hookcount == 0 || L->hookmask & GAFQ_MASKLINE)) {
-      traceexec(L, pc);
-      if (L->status == GAFQ_YIELD) {  /* did hook yield? */
-        L->savedpc = pc - 1;
-        return;
+    vmfetch();
+    vmdispatch(GET_OPCODE(i)) {
+#if defined(GAFQ_USE_JUMPTABLE)
+      L_HOOK: {  /* instrumented variant */
+        if (hookcheck(L))
+          dohook(L)
+        else
+          disp = disptab;  /* hooks are gone; back to the fast variant */
+        goto *disptab[GET_OPCODE(i)];
       }
-      base = L->base;
-    }
-    /* warning!! several calls may realloc the stack and invalidate `ra' */
-    ra = RA(i);
-    gafq_assert(base == L->base && L->base == L->ci->base);
-    gafq_assert(base <= L->top && L->top <= L->stack + L->stacksize);
-    gafq_assert(L->top == L->ci->top || gafqG_checkopenop(i));
-    switch (GET_OPCODE(i)) {
+#endif
       // 看着是把rbi的值赋给ra
-      case OP_MOVE: {
+      vmcase(OP_MOVE) {
         setobjs2s(L, ra, RB(i));
-        continue;
+        vmbreak;
       }
-      case OP_LOADK: {
+      vmcase(OP_LOADK) {
         setobj2s(L, ra, KBx(i));
-        continue;
+        vmbreak;
       }
-      case OP_LOADBOOL: {
+      vmcase(OP_LOADBOOL) {
         setbvalue(ra, GETARG_B(i));
         if (GETARG_C(i)) pc++;  /* skip next instruction (if C) */
-        continue;
+        vmbreak;
       }
-      case OP_LOADNIL: {
+      vmcase(OP_LOADNIL) {
         TValue *rb = RB(i);
         do {
           setnilvalue(rb--);
         } while (rb >= ra);
-        continue;
+        vmbreak;
       }
-      case OP_GETUPVAL: {
+      vmcase(OP_GETUPVAL) {
         int b = GETARG_B(i);
         setobj2s(L, ra, cl->upvals[b]->v);
-        continue;
+        vmbreak;
       }
-      case OP_GETGLOBAL: {
-        TValue g;
-        TValue *rb = KBx(i);
-        sethvalue(L, &g, cl->env);
-        gafq_assert(ttisstring(rb));
-        Protect(gafqV_gettable(L, &g, rb, ra));
-        continue;
+      vmcase(OP_GETGLOBAL) {
+        getglobal();
+        vmbreak;
       }
-      case OP_GETTABLE: {
-        Protect(gafqV_gettable(L, RB(i), RKC(i), ra));
-        continue;
+      vmcase(OP_GETTABLE) {
+        gettable();
+        vmbreak;
       }
-      case OP_SETGLOBAL: {
-        TValue g;
-        sethvalue(L, &g, cl->env);
-        gafq_assert(ttisstring(KBx(i)));
-        Protect(gafqV_settable(L, &g, KBx(i), ra));
-        continue;
+      vmcase(OP_SETGLOBAL) {
+        TValue *rb = KBx(i);
+        Table *h = cl->env;
+        int *ic = IC();
+        gafq_assert(ttisstring(rb));
+        if (cachehit(h, rb, ic)) {
+          setobj2t(L, hintslot(h, ic), ra);
+          h->flags = 0;
+          gafqC_barriert(L, h, ra);
+        }
+        else {
+          TValue g;
+          sethvalue(L, &g, h);
+          Protect(gafqV_settablecached(L, &g, rb, ra, ic));
+        }
+        vmbreak;
       }
-      case OP_SETUPVAL: {
+      vmcase(OP_SETUPVAL) {
         UpVal *uv = cl->upvals[GETARG_B(i)];
         setobj(L, uv->v, ra);
         gafqC_barrier(L, uv, ra);
-        continue;
+        vmbreak;
       }
-      case OP_SETTABLE: {
-        Protect(gafqV_settable(L, ra, RKB(i), RKC(i)));
-        continue;
+      vmcase(OP_SETTABLE) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (iskstr(GETARG_B(i))) {
+          int *ic = IC();
+          if (ttistable(ra) && cachehit(hvalue(ra), rb, ic)) {
+            Table *h = hvalue(ra);
+            setobj2t(L, hintslot(h, ic), rc);
+            h->flags = 0;
+            gafqC_barriert(L, h, rc);
+          }
+          else
+            Protect(gafqV_settablecached(L, ra, rb, rc, ic));
+        }
+        else if (ttistable(ra) && inarray(ra, rb) && !ispacked(hvalue(ra)) &&
+                 (!ttisnil(arrayslot(ra, rb)) || hvalue(ra)->metatable == NULL)) {
+          Table *h = hvalue(ra);
+          setobj2t(L, arrayslot(ra, rb), rc);
+          h->flags = 0;
+          gafqC_barriert(L, h, rc);
+        }
+        else if (ttistable(ra) && inarray(ra, rb) && ispacked(hvalue(ra)) &&
+                 ttisnumber(rc) &&
+                 (!ishole(packedslot(ra, rb)) || hvalue(ra)->metatable == NULL)) {
+          packnum(hvalue(ra), packedslot(ra, rb), rc);
+          hvalue(ra)->flags = 0;
+        }
+        else
+          Protect(gafqV_settable(L, ra, rb, rc));
+        vmbreak;
       }
-      case OP_NEWTABLE: {
+      vmcase(OP_NEWTABLE) {
         int b = GETARG_B(i);
         int c = GETARG_C(i);
         sethvalue(L, ra, gafqH_new(L, gafqO_fb2int(b), gafqO_fb2int(c)));
         Protect(gafqC_checkGC(L));
-        continue;
+        vmbreak;
       }
-      case OP_SELF: {
+      vmcase(OP_SELF) {
         StkId rb = RB(i);
+        TValue *rc = RKC(i);
         setobjs2s(L, ra+1, rb);
-        Protect(gafqV_gettable(L, rb, RKC(i), ra));
-        continue;
+        if (iskstr(GETARG_C(i))) {
+          int *ic = IC();
+          if (ttistable(rb) && cachehit(hvalue(rb), rc, ic)) {
+            setobj2s(L, ra, hintslot(hvalue(rb), ic));
+          }
+          else
+            Protect(gafqV_gettablecached(L, rb, rc, ra, ic));
+        }
+        else
+          Protect(gafqV_gettable(L, rb, rc, ra));
+        vmbreak;
       }
       //加法
-      case OP_ADD: {
-        arith_op(gafqi_numadd, TM_ADD);
-        continue;
+      vmcase(OP_ADD) {
+        quickpair(OP_ADDI, OP_ADDF);
+        arith_iop(gafqi_numadd, intadd, TM_ADD);
+        vmbreak;
       }
-      case OP_SUB: {
-        arith_op(gafqi_numsub, TM_SUB);
-        continue;
+      vmcase(OP_SUB) {
+        quickpair(OP_SUBI, OP_SUBF);
+        arith_iop(gafqi_numsub, intsub, TM_SUB);
+        vmbreak;
       }
-      case OP_MUL: {
-        arith_op(gafqi_nummul, TM_MUL);
-        continue;
+      vmcase(OP_MUL) {
+        quickpair(OP_MULI, OP_MULF);
+        arith_iop(gafqi_nummul, intmul, TM_MUL);
+        vmbreak;
       }
-      case OP_DIV: {
+      vmcase(OP_DIV) {
+        if (ttisflt(RKB(i)) && ttisflt(RKC(i))) quicken(OP_DIVF);
         arith_op(gafqi_numdiv, TM_DIV);
-        continue;
+        vmbreak;
       }
-      case OP_MOD: {
-        arith_op(gafqi_nummod, TM_MOD);
-        continue;
+      vmcase(OP_MOD) {
+        arith_iop(gafqi_nummod, intmod, TM_MOD);
+        vmbreak;
       }
-      case OP_POW: {
+      vmcase(OP_POW) {
         arith_op(gafqi_numpow, TM_POW);
-        continue;
+        vmbreak;
       }
-      case OP_UNM: {
+      vmcase(OP_UNM) {
         TValue *rb = RB(i);
-        if (ttisnumber(rb)) {
+        if (ttisint(rb) && ivalue(rb) != 0) {  /* -0 is not an integer */
+          setivalue(ra, -ivalue(rb));
+        }
+        else if (ttisnumber(rb)) {
           gafq_Number nb = nvalue(rb);
           setnvalue(ra, gafqi_numunm(nb));
         }
         else {
-          Protect(Arith(L, ra, rb, rb, TM_UNM));
+          Protect(gafqV_arith(L, ra, rb, rb, TM_UNM));
         }
-        continue;
+        vmbreak;
       }
-      case OP_NOT: {
+      vmcase(OP_NOT) {
         int res = l_isfalse(RB(i));  /* next assignment may change this value */
         setbvalue(ra, res);
-        continue;
+        vmbreak;
       }
-      case OP_LEN: {
+      vmcase(OP_LEN) {
         const TValue *rb = RB(i);
         switch (ttype(rb)) {
           case GAFQ_TTABLE: {
-            setnvalue(ra, cast_num(gafqH_getn(hvalue(rb))));
+            setivalue(ra, cast_lint(gafqH_getn(hvalue(rb))));
             break;
           }
           case GAFQ_TSTRING: {
-            setnvalue(ra, cast_num(tsvalue(rb)->len));
+            setivalue(ra, cast_lint(tsvalue(rb)->len));
             break;
           }
           default: {  /* try metamethod */
-            Protect(
-              if (!call_binTM(L, rb, gafqO_nilobject, ra, TM_LEN))
-                gafqG_typeerror(L, rb, "get length of");
-            )
+            Protect(gafqV_objlen(L, ra, rb));
           }
         }
-        continue;
+        vmbreak;
       }
-      case OP_CONCAT: {
+      vmcase(OP_CONCAT) {
         int b = GETARG_B(i);
         int c = GETARG_C(i);
         Protect(gafqV_concat(L, c-b+1, c); gafqC_checkGC(L));
         setobjs2s(L, RA(i), base+b);
-        continue;
+        vmbreak;
       }
-      case OP_JMP: {
+      vmcase(OP_JMP) {
         dojump(L, pc, GETARG_sBx(i));
-        continue;
+        if (GETARG_sBx(i) < 0) jitloop(L);
+        vmbreak;
       }
       // 计算相等
-      case OP_EQ: {
+      vmcase(OP_EQ) {
         TValue *rb = RKB(i);
         TValue *rc = RKC(i);
+        if (ttisint(rb) && ttisint(rc)) quicken(OP_EQI)
+        else if (ttisstring(rb) && ttisstring(rc)) quicken(OP_EQS)
         Protect(
           if (equalobj(L, rb, rc) == GETARG_A(i))
             dojump(L, pc, GETARG_sBx(*pc));
         )
         pc++;
-        continue;
+        vmbreak;
       }
-      case OP_LT: {
-        Protect(
-          if (gafqV_lessthan(L, RKB(i), RKC(i)) == GETARG_A(i))
+      vmcase(OP_LT) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        quickpair(OP_LTI, OP_LTF);
+        if (ttisint(rb) && ttisint(rc)) {
+          if ((ivalue(rb) < ivalue(rc)) == GETARG_A(i))
+            dojump(L, pc, GETARG_sBx(*pc));
+        }
+        else Protect(
+          if (gafqV_lessthan(L, rb, rc) == GETARG_A(i))
             dojump(L, pc, GETARG_sBx(*pc));
         )
         pc++;
-        continue;
+        vmbreak;
       }
-      case OP_LE: {
-        Protect(
-          if (lessequal(L, RKB(i), RKC(i)) == GETARG_A(i))
+      vmcase(OP_LE) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        quickpair(OP_LEI, OP_LEF);
+        if (ttisint(rb) && ttisint(rc)) {
+          if ((ivalue(rb) <= ivalue(rc)) == GETARG_A(i))
+            dojump(L, pc, GETARG_sBx(*pc));
+        }
+        else Protect(
+          if (gafqV_lessequal(L, rb, rc) == GETARG_A(i))
             dojump(L, pc, GETARG_sBx(*pc));
         )
         pc++;
-        continue;
+        vmbreak;
       }
-      case OP_TEST: {
+      vmcase(OP_TEST) {
         if (l_isfalse(ra) != GETARG_C(i))
           dojump(L, pc, GETARG_sBx(*pc));
         pc++;
-        continue;
+        vmbreak;
       }
-      case OP_TESTSET: {
+      vmcase(OP_TESTSET) {
         TValue *rb = RB(i);
         if (l_isfalse(rb) != GETARG_C(i)) {
           setobjs2s(L, ra, rb);
           dojump(L, pc, GETARG_sBx(*pc));
         }
         pc++;
-        continue;
+        vmbreak;
       }
-      case OP_CALL: {
+      vmcase(OP_CALL) call: {
         int b = GETARG_B(i);
         int nresults = GETARG_C(i) - 1;
         if (b != 0) L->top = ra+b;  /* else previous instruction set top */
         L->savedpc = pc;
+        if (ttisfunction(ra) && !clvalue(ra)->c.isC) {
+          Proto *p = clvalue(ra)->l.p;
+          /* no `arg' table to build, room for the frame and no call hook?
+             then do what `precall' would, without the checks it needs */
+          if (!(p->is_vararg & VARARG_NEEDSARG) && L->ci != L->end_ci &&
+              L->stack_last - L->top > p->numparams + p->maxstacksize &&
+              !(L->hookmask & GAFQ_MASKCALL)) {
+            CallInfo *ci;
+            StkId st, nbase = ra + 1;
+            if (p->is_vararg) {  /* varargs stay; frame goes above them */
+              int nargs = cast_int(L->top - ra) - 1;
+              int j;
+              for (; nargs < p->numparams; nargs++)
+                setnilvalue(L->top++);
+              nbase = L->top;
+              for (j = 0; j < p->numparams; j++) {  /* move fixed params */
+                setobjs2s(L, L->top++, ra + 1 + j);
+                setnilvalue(ra + 1 + j);
+              }
+            }
+            else if (L->top > nbase + p->numparams)
+              L->top = nbase + p->numparams;
+            L->ci->savedpc = pc;
+            ci = ++L->ci;
+            ci->func = ra;
+            L->base = ci->base = nbase;
+            ci->top = L->base + p->maxstacksize;
+            ci->tailcalls = 0;
+            ci->nresults = nresults;
+            L->savedpc = p->code;
+            for (st = L->top; st < ci->top; st++)
+              setnilvalue(st);
+            L->top = ci->top;
+            nexeccalls++;
+            goto reentry;
+          }
+        }
         switch (gafqD_precall(L, ra, nresults)) {
           case PCRGAFQ: {
             nexeccalls++;
@@ -600,14 +1255,15 @@ void gafqV_execute (gafq_State *L, int nexeccalls) {
             /* it was a C function (`precall' called it); adjust results */
             if (nresults >= 0) L->top = L->ci->top;
             base = L->base;
-            continue;
+            updatemode(L);
+            vmbreak;
           }
           default: {
             return;  /* yield */
           }
         }
       }
-      case OP_TAILCALL: {
+      vmcase(OP_TAILCALL) {
         int b = GETARG_B(i);
         if (b != 0) L->top = ra+b;  /* else previous instruction set top */
         L->savedpc = pc;
@@ -632,56 +1288,77 @@ void gafqV_execute (gafq_State *L, int nexeccalls) {
           }
           case PCRC: {  /* it was a C function (`precall' called it) */
             base = L->base;
-            continue;
+            updatemode(L);
+            vmbreak;
           }
           default: {
             return;  /* yield */
           }
         }
       }
-      case OP_RETURN: {
+      vmcase(OP_RETURN) {
         int b = GETARG_B(i);
         if (b != 0) L->top = ra+b-1;
         if (L->openupval) gafqF_close(L, base);
         L->savedpc = pc;
-        b = gafqD_poscall(L, ra);
+        if (L->hookmask & GAFQ_MASKRET)
+          b = gafqD_poscall(L, ra);
+        else {  /* no hook to call: `poscall' inline */
+          CallInfo *ci = L->ci--;
+          StkId res = ci->func;
+          int wanted = ci->nresults;
+          L->base = (ci - 1)->base;
+          L->savedpc = (ci - 1)->savedpc;
+          for (b = wanted; b != 0 && ra < L->top; b--)
+            setobjs2s(L, res++, ra++);
+          while (b-- > 0)
+            setnilvalue(res++);
+          L->top = res;
+          b = (wanted != GAFQ_MULTRET);
+        }
         if (--nexeccalls == 0)  /* was previous function running `here'? */
           return;  /* no: return */
         else {  /* yes: continue its execution */
           if (b) L->top = L->ci->top;
           gafq_assert(isGafq(L->ci));
-          gafq_assert(GET_OPCODE(*((L->ci)->savedpc - 1)) == OP_CALL);
+          gafq_assert(GET_OPCODE(*((L->ci)->savedpc - 1)) == OP_CALL ||
+                      GET_OPCODE(*((L->ci)->savedpc - 1)) == OP_INTRINSIC);
           goto reentry;
         }
       }
-      case OP_FORLOOP: {
-        gafq_Number step = nvalue(ra+2);
-        gafq_Number idx = gafqi_numadd(nvalue(ra), step); /* increment index */
-        gafq_Number limit = nvalue(ra+1);
-        if (gafqi_numlt(0, step) ? gafqi_numle(idx, limit)
-                                : gafqi_numle(limit, idx)) {
-          dojump(L, pc, GETARG_sBx(i));  /* jump back */
-          setnvalue(ra, idx);  /* update internal index... */
-          setnvalue(ra+3, idx);  /* ...and external index */
+      vmcase(OP_FORLOOP) {
+        if (ttisint(ra)) {  /* integer loop (see OP_FORPREP) */
+          l_int step = ivalue(ra+2);
+          l_int idx = ivalue(ra) + step;  /* cannot overflow */
+          l_int limit = ivalue(ra+1);
+          if (0 < step ? idx <= limit : limit <= idx) {
+            dojump(L, pc, GETARG_sBx(i));  /* jump back */
+            setivalue(ra, idx);  /* update internal index... */
+            setivalue(ra+3, idx);  /* ...and external index */
+            jitloop(L);
+          }
         }
-        continue;
+        else {
+          gafq_Number step = nvalue(ra+2);
+          gafq_Number idx = gafqi_numadd(nvalue(ra), step); /* increment index */
+          gafq_Number limit = nvalue(ra+1);
+          if (gafqi_numlt(0, step) ? gafqi_numle(idx, limit)
+                                  : gafqi_numle(limit, idx)) {
+            dojump(L, pc, GETARG_sBx(i));  /* jump back */
+            setnvalue(ra, idx);  /* update internal index... */
+            setnvalue(ra+3, idx);  /* ...and external index */
+            jitloop(L);
+          }
+        }
+        vmbreak;
       }
-      case OP_FORPREP: {
-        const TValue *init = ra;
-        const TValue *plimit = ra+1;
-        const TValue *pstep = ra+2;
+      vmcase(OP_FORPREP) {
         L->savedpc = pc;  /* next steps may throw errors */
-        if (!tonumber(init, ra))
-          gafqG_runerror(L, GAFQ_QL("for") " initial value must be a number");
-        else if (!tonumber(plimit, ra+1))
-          gafqG_runerror(L, GAFQ_QL("for") " limit must be a number");
-        else if (!tonumber(pstep, ra+2))
-          gafqG_runerror(L, GAFQ_QL("for") " step must be a number");
-        setnvalue(ra, gafqi_numsub(nvalue(ra), nvalue(pstep)));
+        gafqV_forprep(L, ra);
         dojump(L, pc, GETARG_sBx(i));
-        continue;
+        vmbreak;
       }
-      case OP_TFORLOOP: {
+      vmcase(OP_TFORLOOP) {
         StkId cb = ra + 3;  /* call base */
         setobjs2s(L, cb+2, ra+2);
         setobjs2s(L, cb+1, ra+1);
@@ -695,35 +1372,27 @@ void gafqV_execute (gafq_State *L, int nexeccalls) {
           dojump(L, pc, GETARG_sBx(*pc));  /* jump back */
         }
         pc++;
-        continue;
+        vmbreak;
       }
-      case OP_SETLIST: {
+      vmcase(OP_SETLIST) {
         int n = GETARG_B(i);
         int c = GETARG_C(i);
         int last;
-        Table *h;
         if (n == 0) {
           n = cast_int(L->top - ra) - 1;
           L->top = L->ci->top;
         }
         if (c == 0) c = cast_int(*pc++);
         runtime_check(L, ttistable(ra));
-        h = hvalue(ra);
         last = ((c-1)*LFIELDS_PER_FLUSH) + n;
-        if (last > h->sizearray)  /* needs more space? */
-          gafqH_resizearray(L, h, last);  /* pre-alloc it at once */
-        for (; n > 0; n--) {
-          TValue *val = ra+n;
-          setobj2t(L, gafqH_setnum(L, h, last--), val);
-          gafqC_barriert(L, h, val);
-        }
-        continue;
+        gafqH_setlist(L, hvalue(ra), last, ra+1, n);
+        vmbreak;
       }
-      case OP_CLOSE: {
+      vmcase(OP_CLOSE) {
         gafqF_close(L, ra);
-        continue;
+        vmbreak;
       }
-      case OP_CLOSURE: {
+      vmcase(OP_CLOSURE) {
         Proto *p;
         Closure *ncl;
         int nup, j;
@@ -741,9 +1410,9 @@ void gafqV_execute (gafq_State *L, int nexeccalls) {
         }
         setclvalue(L, ra, ncl);
         Protect(gafqC_checkGC(L));
-        continue;
+        vmbreak;
       }
-      case OP_VARARG: {
+      vmcase(OP_VARARG) {
         int b = GETARG_B(i) - 1;
         int j;
         CallInfo *ci = L->ci;
@@ -751,6 +1420,13 @@ void gafqV_execute (gafq_State *L, int nexeccalls) {
         if (b == GAFQ_MULTRET) {
           Protect(gafqD_checkstack(L, n));
           ra = RA(i);  /* previous call may change the stack */
+          if (GET_OPCODE(*pc) == OP_CALL && GETARG_B(*pc) == 0 &&
+              GETARG_A(*pc) + 2 == GETARG_A(i) && !L->hookmask &&
+              isbuiltin(L, ra - 2, BI_SELECT) &&
+              selectva(L, ra, *pc, ci->base - n, n)) {
+            pc++;  /* skip the call: it is done */
+            vmbreak;
+          }
           b = n;
           L->top = ra + n;
         }
@@ -762,7 +1438,115 @@ void gafqV_execute (gafq_State *L, int nexeccalls) {
             setnilvalue(ra + j);
           }
         }
-        continue;
+        vmbreak;
+      }
+      vmcase(OP_SWITCH) {
+        TValue v;
+        const TValue *n = gafqH_getv(hvalue(k + GETARG_B(i)), ra, &v);
+        if (ttisint(n) && 0 < ivalue(n) && ivalue(n) <= GETARG_C(i))
+          pc += ivalue(n);  /* to the jump of that case */
+        vmbreak;
+      }
+      vmcase(OP_INTRINSIC) {
+        int b = GETARG_B(i);
+        int done;
+        Protect(done = gafqV_intrinsic(L, ra, b, GETARG_C(i) - 1));
+        if (done) vmbreak;
+        i = CREATE_ABC(OP_CALL, GETARG_A(i), biargs(b) + 1, GETARG_C(i));
+        goto call;
+      }
+      vmcase(OP_APPEND) {
+        TValue *rb = RKB(i);
+        if (ttistable(ra) &&
+            fasttm(L, hvalue(ra)->metatable, TM_NEWINDEX) == NULL) {
+          Protect(gafqH_append(L, hvalue(ra), rb));
+        }
+        else {  /* as `LEN C A; ADD C C 1; SETTABLE A C B' */
+          TValue one;
+          setivalue(&one, 1);
+          Protect(gafqV_objlen(L, RC(i), RA(i)));
+          Protect(gafqV_arith(L, RC(i), RC(i), &one, TM_ADD));
+          Protect(gafqV_settable(L, RA(i), RC(i), RKB(i)));
+        }
+        vmbreak;
+      }
+      vmcase(OP_MOVE2) {
+        setobjs2s(L, ra, RB(i));
+        fusenext();
+        setobjs2s(L, ra, RB(i));
+        vmbreak;
+      }
+      vmcase(OP_MOVECALL) {
+        setobjs2s(L, ra, RB(i));
+        fusenext();
+        goto call;
+      }
+      vmcase(OP_GETTABLE2) {
+        gettable();
+        fusenext();
+        gettable();
+        vmbreak;
+      }
+      vmcase(OP_GLOBALGET) {
+        getglobal();
+        fusenext();
+        gettable();
+        vmbreak;
+      }
+      vmcase(OP_ADDI) {
+        arith_qint(intadd, TM_ADD, OP_ADD);
+        vmbreak;
+      }
+      vmcase(OP_SUBI) {
+        arith_qint(intsub, TM_SUB, OP_SUB);
+        vmbreak;
+      }
+      vmcase(OP_MULI) {
+        arith_qint(intmul, TM_MUL, OP_MUL);
+        vmbreak;
+      }
+      vmcase(OP_ADDF) {
+        arith_qflt(gafqi_numadd, TM_ADD, OP_ADD);
+        vmbreak;
+      }
+      vmcase(OP_SUBF) {
+        arith_qflt(gafqi_numsub, TM_SUB, OP_SUB);
+        vmbreak;
+      }
+      vmcase(OP_MULF) {
+        arith_qflt(gafqi_nummul, TM_MUL, OP_MUL);
+        vmbreak;
+      }
+      vmcase(OP_DIVF) {
+        arith_qflt(gafqi_numdiv, TM_DIV, OP_DIV);
+        vmbreak;
+      }
+      vmcase(OP_EQI) {
+        compare_q(ttisint, ivalue(rb) == ivalue(rc), equalobj, OP_EQ);
+        vmbreak;
+      }
+      vmcase(OP_EQS) {
+        compare_q(ttisstring, gafqS_eqstr(rawtsvalue(rb), rawtsvalue(rc)),
+                  equalobj, OP_EQ);
+        vmbreak;
+      }
+      vmcase(OP_LTI) {
+        compare_q(ttisint, ivalue(rb) < ivalue(rc), gafqV_lessthan, OP_LT);
+        vmbreak;
+      }
+      vmcase(OP_LEI) {
+        compare_q(ttisint, ivalue(rb) <= ivalue(rc), gafqV_lessequal, OP_LE);
+        vmbreak;
+      }
+      vmcase(OP_LTF) {
+        compare_q(ttisflt, gafqi_numlt(fltvalue(rb), fltvalue(rc)),
+                  gafqV_lessthan, OP_LT);
+        vmbreak;
+      }
+      vmcase(OP_LEF) {
+        compare_q(ttisflt, gafqi_numle(fltvalue(rb), fltvalue(rc)),
+                  gafqV_lessequal, OP_LE);
+        vmbreak;
       }
     }
   }
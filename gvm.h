@@ -23,6 +23,7 @@
 
 
 GAFQI_FUNC int gafqV_lessthan (gafq_State *L, const TValue *l, const TValue *r);
+GAFQI_FUNC int gafqV_lessequal (gafq_State *L, const TValue *l, const TValue *r);
 GAFQI_FUNC int gafqV_equalval (gafq_State *L, const TValue *t1, const TValue *t2);
 GAFQI_FUNC const TValue *gafqV_tonumber (const TValue *obj, TValue *n);
 GAFQI_FUNC int gafqV_tostring (gafq_State *L, StkId obj);
@@ -30,6 +31,15 @@ GAFQI_FUNC void gafqV_gettable (gafq_State *L, const TValue *t, TValue *key,
                                             StkId val);
 GAFQI_FUNC void gafqV_settable (gafq_State *L, const TValue *t, TValue *key,
                                             StkId val);
+GAFQI_FUNC void gafqV_gettablecached (gafq_State *L, const TValue *t,
+                                      TValue *key, StkId val, int *ic);
+GAFQI_FUNC void gafqV_settablecached (gafq_State *L, const TValue *t,
+                                      TValue *key, StkId val, int *ic);
+GAFQI_FUNC void gafqV_arith (gafq_State *L, StkId ra, const TValue *rb,
+                             const TValue *rc, TMS op);
+GAFQI_FUNC void gafqV_objlen (gafq_State *L, StkId ra, const TValue *rb);
+GAFQI_FUNC void gafqV_forprep (gafq_State *L, StkId ra);
+GAFQI_FUNC int gafqV_intrinsic (gafq_State *L, StkId ra, int b, int nresults);
 GAFQI_FUNC void gafqV_execute (gafq_State *L, int nexeccalls);
 GAFQI_FUNC void gafqV_concat (gafq_State *L, int total, int last);
 
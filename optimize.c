@@ -0,0 +1,419 @@
+/*
+** $Id: optimize.c $
+** optimize bytecodes
+** See Copyright Notice in gafq.h
+*/
+
+#include <string.h>
+
+#define gafqc_c
+#define GAFQ_CORE
+
+#include "gcode.h"
+#include "gdebug.h"
+#include "gmem.h"
+#include "gobject.h"
+#include "gopcodes.h"
+#include "gundump.h"
+
+#define OptimizeFunction	gafqU_optimize
+
+#define MAXROUNDS	8		/* rounds of passes over one function */
+
+/* what we know about each word of code */
+#define TARGET	1			/* some jump lands here */
+#define DATA	2			/* SETLIST count or CLOSURE upvalue */
+#define PINNED	4			/* the instruction before may skip it */
+#define LIVE	8			/* reachable */
+#define DEAD	16			/* to be removed */
+
+/* number of words after instruction at pc that are no instructions */
+static int Data(const Proto* f, int pc)
+{
+ Instruction i=f->code[pc];
+ switch (GET_OPCODE(i))
+ {
+  case OP_SETLIST: return GETARG_C(i)==0;
+  case OP_CLOSURE: return f->p[GETARG_Bx(i)]->nups;
+  default: return 0;
+ }
+}
+
+/* where instruction i at pc jumps to, or -1 */
+static int Target(Instruction i, int pc)
+{
+ switch (GET_OPCODE(i))
+ {
+  case OP_JMP:
+  case OP_FORLOOP:
+  case OP_FORPREP:
+   return pc+1+GETARG_sBx(i);
+  default:
+   return -1;
+ }
+}
+
+/* does instruction i (maybe) skip the next one? */
+static int Skips(Instruction i)
+{
+ OpCode o=GET_OPCODE(i);
+ return testTMode(o) || (o==OP_LOADBOOL && GETARG_C(i)!=0);
+}
+
+/* the only register instruction i sets, or -1 */
+static int Writes(Instruction i)
+{
+ switch (GET_OPCODE(i))
+ {
+  case OP_LOADBOOL:
+   if (GETARG_C(i)!=0) return -1;
+   /* else go through */
+  case OP_MOVE: case OP_LOADK: case OP_GETUPVAL: case OP_GETGLOBAL:
+  case OP_GETTABLE: case OP_NEWTABLE: case OP_ADD: case OP_SUB:
+  case OP_MUL: case OP_DIV: case OP_MOD: case OP_POW: case OP_UNM:
+  case OP_NOT: case OP_LEN: case OP_CONCAT:
+   return GETARG_A(i);
+  default:
+   return -1;
+ }
+}
+
+#define RK(x,r)		(!ISK(x) && (x)==(r))
+#define IN(r,a,b)	((a)<=(r) && (r)<=(b))
+
+/* may instruction i read register r? */
+static int Reads(Instruction i, int r)
+{
+ int a=GETARG_A(i);
+ int b=GETARG_B(i);
+ int c=GETARG_C(i);
+ switch (GET_OPCODE(i))
+ {
+  case OP_LOADK: case OP_LOADBOOL: case OP_LOADNIL: case OP_GETUPVAL:
+  case OP_GETGLOBAL: case OP_NEWTABLE: case OP_JMP: case OP_CLOSE:
+  case OP_VARARG:
+   return 0;
+  case OP_MOVE: case OP_UNM: case OP_NOT: case OP_LEN: case OP_TESTSET:
+   return b==r;
+  case OP_SETGLOBAL: case OP_SETUPVAL: case OP_TEST:
+   return a==r;
+  case OP_GETTABLE: case OP_SELF:
+   return b==r || RK(c,r);
+  case OP_SETTABLE:
+   return a==r || RK(b,r) || RK(c,r);
+  case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOD:
+  case OP_POW: case OP_EQ: case OP_LT: case OP_LE:
+   return RK(b,r) || RK(c,r);
+  case OP_CONCAT:
+   return IN(r,b,c);
+  case OP_CALL: case OP_TAILCALL:
+   return b==0 ? r>=a : IN(r,a,a+b-1);
+  case OP_RETURN:
+   return b==0 ? r>=a : IN(r,a,a+b-2);
+  case OP_SETLIST:
+   return b==0 ? r>=a : IN(r,a,a+b);
+  default:
+   return 1;
+ }
+}
+
+static void Scan(const Proto* f, lu_byte* flag)
+{
+ int pc,j,n=f->sizecode;
+ for (pc=0; pc<n; pc++) flag[pc]&=DEAD;
+ for (pc=0; pc<n; pc++)
+ {
+  Instruction i=f->code[pc];
+  int t=Target(i,pc);
+  if (t>=0) flag[t]|=TARGET;
+  if (Skips(i) && pc+1<n) flag[pc+1]|=PINNED;
+  if (GET_OPCODE(i)==OP_SWITCH)		/* its jumps must stay in place */
+   for (j=1; j<=GETARG_C(i)+1; j++) flag[pc+j]|=TARGET|PINNED;
+  for (j=Data(f,pc); j>0; j--) flag[++pc]|=DATA;
+ }
+}
+
+/* superinstructions go back to plain pairs while we work */
+static void Unfuse(Proto* f)
+{
+ int pc;
+ for (pc=0; pc<f->sizecode; pc++)
+ {
+  OpCode o=GET_OPCODE(f->code[pc]);
+  if (o>=FIRST_SUPER && o<FIRST_QUICK) f->code[pc]=BASEINSTR(f->code[pc]);
+  pc+=Data(f,pc);
+ }
+}
+
+/* jump threading: a jump to a jump goes to where the latter goes */
+static int Thread(Proto* f, lu_byte* flag)
+{
+ int pc,n=f->sizecode,changed=0;
+ for (pc=0; pc<n; pc++)
+ {
+  Instruction i=f->code[pc];
+  int t,k;
+  if (flag[pc]&DATA || GET_OPCODE(i)!=OP_JMP) continue;
+  t=Target(i,pc);
+  for (k=0; k<n && GET_OPCODE(f->code[t])==OP_JMP && t!=pc; k++)
+   t=Target(f->code[t],t);
+  if (t!=Target(i,pc))
+  {
+   SETARG_sBx(f->code[pc],t-pc-1);
+   changed++;
+  }
+  if (t==pc+1 && !(flag[pc]&PINNED))	/* jump to next instruction */
+  {
+   flag[pc]|=DEAD;
+   changed++;
+  }
+ }
+ return changed;
+}
+
+/* dead code: what no path from the entry reaches */
+static int Reach(const Proto* f, lu_byte* flag, int* stack)
+{
+ int pc,j,n=f->sizecode,sp=0,changed=0;
+ stack[sp++]=0;
+ while (sp>0)
+ {
+  Instruction i;
+  pc=stack[--sp];
+  if (pc>=n || flag[pc]&LIVE) continue;
+  flag[pc]|=LIVE;
+  i=f->code[pc];
+  for (j=Data(f,pc); j>0; j--) flag[pc+j]|=LIVE;
+  switch (GET_OPCODE(i))
+  {
+   case OP_RETURN:
+    break;
+   case OP_JMP:
+   case OP_FORPREP:
+    stack[sp++]=Target(i,pc);
+    break;
+   case OP_FORLOOP:
+    stack[sp++]=Target(i,pc);
+    stack[sp++]=pc+1;
+    break;
+   case OP_SWITCH:
+    for (j=1; j<=GETARG_C(i)+1; j++)
+    {
+     flag[pc+j]|=LIVE;
+     stack[sp++]=Target(f->code[pc+j],pc+j);
+    }
+    break;
+   case OP_LOADBOOL:
+    if (GETARG_C(i)!=0)
+    {
+     flag[pc+1]|=LIVE;			/* must stay to be skipped */
+     stack[sp++]=pc+2;
+     break;
+    }
+    /* else go through */
+   default:
+    if (testTMode(GET_OPCODE(i))) stack[sp++]=pc+2;
+    stack[sp++]=pc+1+Data(f,pc);
+    break;
+  }
+ }
+ for (pc=0; pc<n-1; pc++)		/* final return always stays */
+  if (!(flag[pc]&(LIVE|DEAD)))
+  {
+   flag[pc]|=DEAD;
+   changed++;
+  }
+ return changed;
+}
+
+/* redundant moves: MOVE A A, and MOVE B A right after MOVE A B */
+static int Moves(const Proto* f, lu_byte* flag)
+{
+ int pc,n=f->sizecode,changed=0;
+ for (pc=0; pc<n; pc++)
+ {
+  Instruction i=f->code[pc];
+  int a=GETARG_A(i);
+  int b=GETARG_B(i);
+  if (flag[pc]&DEAD || GET_OPCODE(i)!=OP_MOVE)
+  {
+   pc+=Data(f,pc);
+   continue;
+  }
+  if (a==b && !(flag[pc]&PINNED))
+  {
+   flag[pc]|=DEAD;
+   changed++;
+  }
+  else if (pc+1<n && !(flag[pc+1]&(TARGET|PINNED|DEAD)) &&
+	   f->code[pc+1]==CREATE_ABC(OP_MOVE,b,a,0))
+  {
+   flag[++pc]|=DEAD;
+   changed++;
+  }
+ }
+ return changed;
+}
+
+/* LOADNIL of registers not set since entry, where all but parameters are nil */
+static int Nils(const Proto* f, lu_byte* flag)
+{
+ lu_byte nil[MAXSTACK];
+ int pc,r,n=f->sizecode,changed=0;
+ int first=f->numparams+((f->is_vararg&VARARG_NEEDSARG)!=0);
+ for (r=0; r<f->maxstacksize; r++) nil[r]=(r>=first);
+ for (pc=0; pc<n && !(flag[pc]&TARGET); pc++)
+ {
+  Instruction i=f->code[pc];
+  int a=GETARG_A(i);
+  if (flag[pc]&DEAD) continue;
+  if (GET_OPCODE(i)==OP_LOADNIL)
+  {
+   int b=GETARG_B(i);
+   for (r=a; r<=b && nil[r]; r++) ;
+   if (r>b)
+   {
+    flag[pc]|=DEAD;
+    changed++;
+   }
+   for (r=a; r<=b; r++) nil[r]=1;
+  }
+  else if (Writes(i)>=0)
+   nil[a]=0;
+  else
+   break;
+ }
+ return changed;
+}
+
+/* number of active locals at pc, which live in the lowest registers */
+static int Active(const Proto* f, int pc)
+{
+ int j,n=0;
+ for (j=0; j<f->sizelocvars; j++)
+  if (f->locvars[j].startpc<=pc && pc<f->locvars[j].endpc) n++;
+ return n;
+}
+
+/* is register r set again before it is read, going on from pc? */
+static int Dead(const Proto* f, const lu_byte* flag, int r, int pc)
+{
+ for (; pc<f->sizecode; pc++)
+ {
+  Instruction i=f->code[pc];
+  if (flag[pc]&DEAD) continue;
+  if (Reads(i,r)) return 0;
+  if (Writes(i)==r) return 1;
+  switch (GET_OPCODE(i))
+  {
+   case OP_RETURN:
+   case OP_TAILCALL:
+    return 1;
+   case OP_CALL:
+    if (r>=GETARG_A(i)) return 0;
+    break;
+   case OP_SETGLOBAL: case OP_SETUPVAL: case OP_SETTABLE: case OP_CLOSE:
+    break;
+   default:
+    if (Writes(i)<0) return 0;		/* jumps and the like */
+    break;
+  }
+ }
+ return 0;
+}
+
+/*
+** register coalescing: `op T ...; MOVE D T' becomes `op D ...' when T is a
+** temporary that nothing reads afterwards
+*/
+static int Coalesce(Proto* f, lu_byte* flag)
+{
+ int pc,n=f->sizecode,changed=0;
+ if (f->sizelineinfo==0) return 0;	/* stripped: no idea where locals are */
+ for (pc=0; pc+1<n; pc++)
+ {
+  Instruction i=f->code[pc];
+  Instruction m=f->code[pc+1];
+  int t=Writes(i);
+  if (t<0 || flag[pc]&(DATA|DEAD|PINNED) ||
+      flag[pc+1]&(TARGET|PINNED|DEAD) ||
+      GET_OPCODE(m)!=OP_MOVE || GETARG_B(m)!=t || GETARG_A(m)==t)
+   continue;
+  if (t<Active(f,pc) || t<Active(f,pc+1) || t<Active(f,pc+2) ||
+      !Dead(f,flag,t,pc+2))
+   continue;
+  SETARG_A(f->code[pc],GETARG_A(m));
+  flag[++pc]|=DEAD;
+  changed++;
+ }
+ return changed;
+}
+
+/* remove dead words, mending jumps, line information and local scopes */
+static void Compact(gafq_State* L, Proto* f, const lu_byte* flag)
+{
+ int pc,n=f->sizecode,m=0;
+ int* newpc=gafqM_newvector(L,n+1,int);
+ for (pc=0; pc<n; pc++)
+ {
+  newpc[pc]=m;
+  if (!(flag[pc]&DEAD)) m++;
+ }
+ newpc[n]=m;
+ for (pc=0; pc<n; pc++)
+ {
+  int t=Target(f->code[pc],pc);
+  if (!(flag[pc]&(DATA|DEAD)) && t>=0)
+   SETARG_sBx(f->code[pc],newpc[t]-newpc[pc]-1);
+ }
+ for (pc=0; pc<n; pc++)
+  if (!(flag[pc]&DEAD))
+  {
+   f->code[newpc[pc]]=f->code[pc];
+   if (f->sizelineinfo>0) f->lineinfo[newpc[pc]]=f->lineinfo[pc];
+  }
+ for (pc=0; pc<f->sizelocvars; pc++)
+ {
+  f->locvars[pc].startpc=newpc[f->locvars[pc].startpc];
+  f->locvars[pc].endpc=newpc[f->locvars[pc].endpc];
+ }
+ gafqM_freearray(L,newpc,n+1,int);
+ gafqM_reallocvector(L,f->code,f->sizecode,m,Instruction);
+ f->sizecode=m;
+ if (f->sizelineinfo>0)
+ {
+  gafqM_reallocvector(L,f->lineinfo,f->sizelineinfo,m,int);
+  f->sizelineinfo=m;
+ }
+ gafqM_reallocvector(L,f->icache,f->sizeicache,m,int);
+ f->sizeicache=m;
+}
+
+int OptimizeFunction(gafq_State* L, Proto* f)
+{
+ int k,ok=1;
+ Unfuse(f);
+ for (k=0; k<MAXROUNDS; k++)
+ {
+  int n=f->sizecode,changed;
+  lu_byte* flag=gafqM_newvector(L,n,lu_byte);
+  int* stack=gafqM_newvector(L,2*n+1,int);
+  memset(flag,0,n);
+  Scan(f,flag);
+  changed=Thread(f,flag);
+  Scan(f,flag);				/* targets may have moved */
+  changed+=Reach(f,flag,stack);
+  changed+=Moves(f,flag);
+  changed+=Nils(f,flag);
+  changed+=Coalesce(f,flag);
+  if (changed) Compact(L,f,flag);
+  gafqM_freearray(L,stack,2*n+1,int);
+  gafqM_freearray(L,flag,n,lu_byte);
+  if (!changed) break;
+ }
+ gafqK_fuse(f);
+ if (!gafqG_checkcode(f)) ok=0;
+ for (k=0; k<f->sizep; k++)
+  if (!OptimizeFunction(L,f->p[k])) ok=0;
+ return ok;
+}
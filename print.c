@@ -65,6 +65,9 @@ static void PrintConstant(const Proto* f, int i)
   case GAFQ_TSTRING:
 	PrintString(rawtsvalue(o));
 	break;
+  case GAFQ_TTABLE:
+	printf("switch");
+	break;
   default:				/* cannot happen */
 	printf("? type=%d",ttype(o));
 	break;
@@ -102,7 +105,7 @@ static void PrintCode(const Proto* f)
     if (o==OP_JMP) printf("%d",sbx); else printf("%d %d",a,sbx);
     break;
   }
-  switch (o)
+  switch (baseOp(o))
   {
    case OP_LOADK:
     printf("\t; "); PrintConstant(f,bx);
@@ -119,6 +122,9 @@ static void PrintCode(const Proto* f)
    case OP_SELF:
     if (ISK(c)) { printf("\t; "); PrintConstant(f,INDEXK(c)); }
     break;
+   case OP_APPEND:
+    if (ISK(b)) { printf("\t; "); PrintConstant(f,INDEXK(b)); }
+    break;
    case OP_SETTABLE:
    case OP_ADD:
    case OP_SUB:
@@ -148,6 +154,9 @@ static void PrintCode(const Proto* f)
     if (c==0) printf("\t; %d",(int)code[++pc]);
     else printf("\t; %d",c);
     break;
+   case OP_SWITCH:
+    printf("\t; %d case%s",c,(c==1)?"":"s");
+    break;
    default:
     break;
   }